@@ -0,0 +1,236 @@
+#ifndef _CHANNEL_H_
+#define _CHANNEL_H_
+
+#include "FiberSync.h"
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <cstddef>
+
+/*
+协程之间传递数据的多生产者多消费者通道
+有界通道满时send挂起发送协程，空时recv挂起接收协程，由对端通过调度器把它们重新调度，形成背压；
+容量为UNBOUNDED时send从不挂起
+元素按移动方式进出，支持只能移动的类型（如std::unique_ptr、大缓冲区），全程不拷贝
+close之后send立即失败；recv继续取完剩余元素，之后返回false
+和FiberSync中的原语一样，在协程之外调用时阻塞线程
+*/
+
+namespace sylar {
+
+	template<class T>
+	class Channel
+	{
+	public:
+		static const size_t UNBOUNDED = 0;
+
+		explicit Channel(size_t capacity = UNBOUNDED) : m_capacity(capacity) {}
+		Channel(const Channel&) = delete;
+		Channel& operator=(const Channel&) = delete;
+
+		//发送一个元素，满时挂起；通道已关闭返回false，元素被丢弃
+		bool send(T value)
+		{
+			FiberWaitQueue ready;
+			{
+				std::unique_lock<std::mutex> guard(m_guard);
+				while (!m_closed && full())
+				{
+					waitOn(m_senders, guard);
+				}
+				if (m_closed)
+				{
+					return false;
+				}
+				m_queue.push_back(std::move(value));
+				take(m_receivers, ready, 1);
+			}
+			ready.wakeAll();
+			return true;
+		}
+
+		//批量发送[first, last)，元素被移走；有空间就尽量多放，放不下时挂起等待
+		//返回成功发送的个数，小于区间长度说明中途通道被关闭
+		template<class Iterator>
+		size_t send(Iterator first, Iterator last)
+		{
+			size_t sent = 0;
+			while (first != last)
+			{
+				FiberWaitQueue ready;
+				{
+					std::unique_lock<std::mutex> guard(m_guard);
+					while (!m_closed && full())
+					{
+						waitOn(m_senders, guard);
+					}
+					if (m_closed)
+					{
+						break;
+					}
+					size_t n = 0;
+					for (; first != last && !full(); ++first, ++n)
+					{
+						m_queue.push_back(std::move(*first));
+					}
+					sent += n;
+					take(m_receivers, ready, n);
+				}
+				ready.wakeAll();
+			}
+			return sent;
+		}
+
+		//不挂起的发送，满或已关闭时返回false且不移走value
+		bool trySend(T&& value)
+		{
+			FiberWaitQueue ready;
+			{
+				std::lock_guard<std::mutex> guard(m_guard);
+				if (m_closed || full())
+				{
+					return false;
+				}
+				m_queue.push_back(std::move(value));
+				take(m_receivers, ready, 1);
+			}
+			ready.wakeAll();
+			return true;
+		}
+
+		//接收一个元素，空时挂起；通道已关闭且没有剩余元素时返回false
+		bool recv(T& out)
+		{
+			FiberWaitQueue ready;
+			{
+				std::unique_lock<std::mutex> guard(m_guard);
+				while (!m_closed && m_queue.empty())
+				{
+					waitOn(m_receivers, guard);
+				}
+				if (m_queue.empty())
+				{
+					return false;
+				}
+				out = std::move(m_queue.front());
+				m_queue.pop_front();
+				take(m_senders, ready, 1);
+			}
+			ready.wakeAll();
+			return true;
+		}
+
+		//批量接收，至少有一个元素时返回，最多取max个追加到out末尾
+		//返回取到的个数，0表示通道已关闭且没有剩余元素
+		size_t recv(std::vector<T>& out, size_t max)
+		{
+			if (max == 0)
+			{
+				return 0;
+			}
+			FiberWaitQueue ready;
+			size_t n = 0;
+			{
+				std::unique_lock<std::mutex> guard(m_guard);
+				while (!m_closed && m_queue.empty())
+				{
+					waitOn(m_receivers, guard);
+				}
+				for (; n < max && !m_queue.empty(); n++)
+				{
+					out.push_back(std::move(m_queue.front()));
+					m_queue.pop_front();
+				}
+				take(m_senders, ready, n);
+			}
+			ready.wakeAll();
+			return n;
+		}
+
+		//不挂起的接收，没有元素时返回false
+		bool tryRecv(T& out)
+		{
+			FiberWaitQueue ready;
+			{
+				std::lock_guard<std::mutex> guard(m_guard);
+				if (m_queue.empty())
+				{
+					return false;
+				}
+				out = std::move(m_queue.front());
+				m_queue.pop_front();
+				take(m_senders, ready, 1);
+			}
+			ready.wakeAll();
+			return true;
+		}
+
+		//关闭通道，唤醒所有挂起的发送者和接收者；重复关闭无影响
+		void close()
+		{
+			FiberWaitQueue ready;
+			{
+				std::lock_guard<std::mutex> guard(m_guard);
+				if (m_closed)
+				{
+					return;
+				}
+				m_closed = true;
+				take(m_senders, ready, (size_t)-1);
+				take(m_receivers, ready, (size_t)-1);
+			}
+			ready.wakeAll();
+		}
+
+		bool isClosed()
+		{
+			std::lock_guard<std::mutex> guard(m_guard);
+			return m_closed;
+		}
+		size_t size()
+		{
+			std::lock_guard<std::mutex> guard(m_guard);
+			return m_queue.size();
+		}
+		size_t getCapacity() const { return m_capacity; }
+
+	private:
+		bool full() const
+		{
+			return m_capacity != UNBOUNDED && m_queue.size() >= m_capacity;
+		}
+
+		//挂起直到被唤醒，返回时重新持有guard；被唤醒只说明状态变过，调用者需要重新检查条件
+		void waitOn(FiberWaitQueue& queue, std::unique_lock<std::mutex>& guard)
+		{
+			FiberWaiter waiter;
+			queue.push(&waiter);
+			waiter.wait(guard);
+			guard.lock();
+		}
+
+		//从queue中取出最多n个等待者放到ready，释放m_guard之后再唤醒
+		static void take(FiberWaitQueue& queue, FiberWaitQueue& ready, size_t n)
+		{
+			for (size_t i = 0; i < n; i++)
+			{
+				FiberWaiter* waiter = queue.pop();
+				if (!waiter)
+				{
+					break;
+				}
+				ready.push(waiter);
+			}
+		}
+
+	private:
+		std::mutex m_guard;
+		std::deque<T> m_queue;
+		size_t m_capacity;
+		bool m_closed = false;
+		FiberWaitQueue m_senders;//等待空间的发送者
+		FiberWaitQueue m_receivers;//等待元素的接收者
+	};
+}
+
+#endif
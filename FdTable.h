@@ -0,0 +1,87 @@
+#ifndef _FD_TABLE_H_
+#define _FD_TABLE_H_
+
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <cstddef>
+
+/*
+按fd下标的分段表，IOManager的事件上下文和FdManager的hook状态都用它存放
+表由固定大小的块组成，块在第一次用到时分配，之后既不移动也不释放，直到表析构
+查找只有两次load（块目录 + 块内下标），不加锁；分配新块时用互斥锁串行化
+元素在块内原地构造和复用，返回的指针在表的生命周期内一直有效
+*/
+
+namespace sylar {
+
+	template<class T>
+	class FdTable
+	{
+	public:
+		static const int CHUNK_BITS = 8;//每块256个fd
+		static const int CHUNK_SIZE = 1 << CHUNK_BITS;
+		static const int MAX_CHUNKS = 1 << 14;//最多支持4M个fd
+
+		FdTable() : m_chunks(new std::atomic<T*>[MAX_CHUNKS])
+		{
+			for (int i = 0; i < MAX_CHUNKS; i++)
+			{
+				m_chunks[i].store(nullptr, std::memory_order_relaxed);
+			}
+		}
+		~FdTable()
+		{
+			for (int i = 0; i < MAX_CHUNKS; i++)
+			{
+				delete[] m_chunks[i].load(std::memory_order_relaxed);
+			}
+		}
+		FdTable(const FdTable&) = delete;
+		FdTable& operator=(const FdTable&) = delete;
+
+		//fd所在的元素，所在的块还没有分配或fd超出范围返回nullptr
+		T* find(int fd) const
+		{
+			if (fd < 0 || (fd >> CHUNK_BITS) >= MAX_CHUNKS)
+			{
+				return nullptr;
+			}
+			T* chunk = m_chunks[fd >> CHUNK_BITS].load(std::memory_order_acquire);
+			return chunk ? &chunk[fd & (CHUNK_SIZE - 1)] : nullptr;
+		}
+
+		//fd所在的元素，块不存在时分配，并对块内每个元素调用init(elem, fd)后再发布
+		//fd超出范围返回nullptr
+		template<class Init>
+		T* get(int fd, Init init)
+		{
+			T* elem = find(fd);
+			if (elem || fd < 0 || (fd >> CHUNK_BITS) >= MAX_CHUNKS)
+			{
+				return elem;
+			}
+			std::lock_guard<std::mutex> lock(m_mutex);
+			std::atomic<T*>& slot = m_chunks[fd >> CHUNK_BITS];
+			T* chunk = slot.load(std::memory_order_relaxed);
+			if (!chunk)
+			{
+				chunk = new T[CHUNK_SIZE];
+				int base = fd & ~(CHUNK_SIZE - 1);
+				for (int i = 0; i < CHUNK_SIZE; i++)
+				{
+					init(chunk[i], base + i);
+				}
+				slot.store(chunk, std::memory_order_release);
+			}
+			return &chunk[fd & (CHUNK_SIZE - 1)];
+		}
+
+	private:
+		//块目录放在堆上，避免含有FdTable的对象（如栈上的IOManager）过大
+		std::unique_ptr<std::atomic<T*>[]> m_chunks;
+		std::mutex m_mutex;//只保护块的分配
+	};
+}
+
+#endif
@@ -10,101 +10,109 @@ namespace sylar {
 	//这些行代码定义了 Singleton 类模板的静态成员变量 instance 和 mutex。
 	// 静态成员变量需要在类外部定义和初始化。
 	template<typename T>
-	T* Singleton<T>::instance = nullptr;
+	std::atomic<T*> Singleton<T>::instance = { nullptr };
 	template<typename T>
 	std::mutex Singleton<T>::mutex;
 
-	FdCtx::FdCtx(int fd) :m_fd(fd) {
+	FdCtx::FdCtx() {
+	}
+	void FdCtx::reset(int fd) {
+		//先换代，还拿着旧指针的调用者比较generation就知道fd已经被复用
+		m_generation.fetch_add(1, std::memory_order_relaxed);
+		m_isInit.store(false, std::memory_order_relaxed);
+		m_isSocket.store(false, std::memory_order_relaxed);
+		m_isFile.store(false, std::memory_order_relaxed);
+		m_sysNonblock.store(false, std::memory_order_relaxed);
+		m_userNonblock.store(false, std::memory_order_relaxed);
+		m_isClosed.store(false, std::memory_order_relaxed);
+		m_fd.store(fd, std::memory_order_relaxed);
+		m_recvTimeout.store((uint64_t)-1, std::memory_order_relaxed);
+		m_sendTimeout.store((uint64_t)-1, std::memory_order_relaxed);
 		init();
 	}
 	FdCtx::~FdCtx() {
 	}
 	bool FdCtx::init() {
-		if (m_isInit) {//如果已经初始化
+		if (isInit()) {//如果已经初始化
 			return true;
 		}
+		int fd = m_fd.load(std::memory_order_relaxed);
+		bool socket = false;
+		bool file = false;
 		struct stat statbuf;
-		//fstat函数用于获取与文件描述符 m_fd 关联的文件状态信息存放到statbuf中。
+		//fstat函数用于获取与文件描述符 fd 关联的文件状态信息存放到statbuf中。
 		// 如果 fstat() 返回 -1，表示文件描述符无效或出现错误。
-		if (-1 == fstat(m_fd, &statbuf)) {
-			m_isInit = false;
-			m_isSocket = false;
-		}
-		else {
-			m_isInit = true;
-			m_isSocket = S_ISSOCK(statbuf.st_mode);//S_ISSOCK(statbuf.st_mode) 用于判断文件类型是否为套接字
+		bool ok = -1 != fstat(fd, &statbuf);
+		if (ok) {
+			socket = S_ISSOCK(statbuf.st_mode);//S_ISSOCK(statbuf.st_mode) 用于判断文件类型是否为套接字
+			file = S_ISREG(statbuf.st_mode) || S_ISBLK(statbuf.st_mode);
 		}
-		if (m_isSocket) {//表示与m_fd关联文件是套接字
-			int flags = fcntl_f(m_fd, F_GETFL, 0);//获取文件描述符状态
-			if (!(flag & O_NONBLOCK)) {//如果文件描述符不是非阻塞
-			fcntl_f(m_fd, F_SETFL, flags | O_NONBLOCK);//设置文件描述符为非阻塞
+		if (socket) {//表示与fd关联文件是套接字
+			int flags = fcntl_f(fd, F_GETFL, 0);//获取文件描述符状态
+			if (!(flags & O_NONBLOCK)) {//如果文件描述符不是非阻塞
+			fcntl_f(fd, F_SETFL, flags | O_NONBLOCK);//设置文件描述符为非阻塞
 			}
-			m_sysNonblock = true;//hook非阻塞设置成功
 		}
-		else {
-			m_sysNonblock = false;//非socket无需设置非阻塞
-		}
-		return m_isInit;
+		//非socket无需设置非阻塞
+		m_sysNonblock.store(socket, std::memory_order_relaxed);//hook非阻塞设置成功
+		m_isSocket.store(socket, std::memory_order_relaxed);
+		m_isFile.store(file, std::memory_order_relaxed);
+		m_isInit.store(ok, std::memory_order_relaxed);
+		return ok;
 	}
 
 	void FdCtx::setTimeout(int type, uint64_t v) {
 		if (type == SO_RCVTIMEO)
 		{
-			m_recvTimeout = v;
+			m_recvTimeout.store(v, std::memory_order_relaxed);
 		}
 		else
 		{
-            m_sendTimeout = v;
+            m_sendTimeout.store(v, std::memory_order_relaxed);
 		}
 	}
 	uint64_t FdCtx::getTimeout(int type) {
 		if (type == SO_RCVTIMEO) {
-			return m_recvTimeout;
+			return m_recvTimeout.load(std::memory_order_relaxed);
 		}
 		else {
-			return m_sendTimeout;
+			return m_sendTimeout.load(std::memory_order_relaxed);
 		}
 	}
 
 	FdManager::FdManager() {
-		m_datas.resize(64);
 	}
 
-	std::shared_ptr<FdCtx> FdManager::get(int fd, bool auto_create) {
-		if (fd == -1)
-		{
-			return nullptr;
+	FdCtx* FdManager::get(int fd, bool auto_create) {
+		//常见情况：fd已经登记，两次load即可返回
+		FdCtx* ctx = m_datas.find(fd);
+		if (ctx && ctx->m_isOpen.load(std::memory_order_acquire)) {
+			return ctx;
 		}
-		std::shared_lock<std::shared_mutex>read_lock(m_mutex);
-		//如果fd超过datas范围，auto——create为false，返回nullptr，表示没有新建对象需求
-		if (fd >= m_datas.size()) {
-			if (!auto_create) {
-				return nullptr;
-			}
+		if (!auto_create) {
+			return nullptr;
 		}
-		else
-		{
-			if (m_datas[fd] || !auto_create) {
-			 return m_datas[fd];
-			}
+		std::lock_guard<std::mutex> lock(m_mutex);
+		ctx = m_datas.get(fd, [](FdCtx&, int) {});
+		if (!ctx) {//fd为负数或超出表的范围
+			return nullptr;
 		}
-		//fd大小超过data，auto——create为true，新建对象
-		read_lock.unlock();
-		std::unique_lock<std::shared_mutex>write_lock(m_mutex);
-		if (m_datas.size() < fd)
-		{
-			m_datas.resize(fd *1.5);
+		if (!ctx->m_isOpen.load(std::memory_order_relaxed)) {
+			ctx->reset(fd);
+			ctx->m_isOpen.store(true, std::memory_order_release);
 		}
-		m_datas[fd] = std::make_shared<FdCtx>(fd);
-		return m_datas[fd];
+		return ctx;
 	}
 
 	void FdManager::del(int fd)
 	{
-		std::unique_lock<std::shared_mutex>write_lock(m_mutex);
-		if (fd >= m_datas.size()) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		FdCtx* ctx = m_datas.find(fd);
+		if (!ctx || !ctx->m_isOpen.load(std::memory_order_relaxed)) {
 			return;
 		}
-		m_datas[fd].reset();
+		//仍在使用这个指针的协程会看到fd已关闭
+		ctx->m_isClosed.store(true, std::memory_order_relaxed);
+		ctx->m_isOpen.store(false, std::memory_order_release);
 	}
-}s
\ No newline at end of file
+}
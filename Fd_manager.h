@@ -2,9 +2,10 @@
 #define _FD_MANAGER_H_
 #include<sys/stat.h>
 #include <memory>
-#include <shared_mutex>
-#include<vector>
+#include <mutex>
+#include <atomic>
 #include "thread.h"
+#include "FdTable.h"
 /*
 含有FdCtx和FdManager两个类
 管理文件描述符fd上下文和相关操作
@@ -13,32 +14,43 @@
 namespace sylar {
 
 	//管理文件描述符相关状态操作
-	class FdCtx :public std::enable_shared_from_this<FdCtx>
+	//在FdManager的表中原地复用，fd关闭后对象仍然有效，只是isClosed()为true
+	//fd号被重新打开时表项被重置，getGeneration()加一；其他线程可能同时读，所有字段都是relaxed原子量
+	//跨挂起持有指针的调用者先记下generation，恢复后不相等说明fd已经关闭并被复用
+	class FdCtx
 	{
+		friend class FdManager;
 	private:
-		bool m_isInit = false;//标记文件描述符是否已初始化
-		bool m_isSocket = false;//标记文件描述符是否为一个套接字
-		bool m_sysNonblock = false;//标记文件描述符是否为系统非阻塞
-		bool m_userNonblock = false;//标记文件描述符是否为用户非阻塞
-        bool m_isClosed = false;//标记文件描述符是否已关闭
-		int m_fd;//文件描述符值
+		std::atomic<bool> m_isInit = { false };//标记文件描述符是否已初始化
+		std::atomic<bool> m_isSocket = { false };//标记文件描述符是否为一个套接字
+		std::atomic<bool> m_isFile = { false };//常规文件或块设备，读写会阻塞线程而不会返回EAGAIN
+		std::atomic<bool> m_sysNonblock = { false };//标记文件描述符是否为系统非阻塞
+		std::atomic<bool> m_userNonblock = { false };//标记文件描述符是否为用户非阻塞
+		std::atomic<bool> m_isClosed = { false };//标记文件描述符是否已关闭
+		std::atomic<bool> m_isOpen = { false };//表中的这一项当前是否代表一个打开的fd
+		std::atomic<int> m_fd = { -1 };//文件描述符值
+		std::atomic<uint64_t> m_generation = { 0 };//表项被重新打开的次数
 
-		uint64_t m_recvTimeout = (uint64_t)-1; //读事件 超时时间 默认-1，表示没有超时限制
-		uint64_t m_sendTimeout = (uint64_t)-1; //写事件 超时时间 默认-1，表示没有超时限制
+		std::atomic<uint64_t> m_recvTimeout = { (uint64_t)-1 }; //读事件 超时时间 默认-1，表示没有超时限制
+		std::atomic<uint64_t> m_sendTimeout = { (uint64_t)-1 }; //写事件 超时时间 默认-1，表示没有超时限制
+		//fd被新打开时重置所有状态并重新初始化
+		void reset(int fd);
     public:
-        FdCtx(int fd);
+		FdCtx();
 		~FdCtx();
 
 		bool init();//初始化
-		bool isInit()const { return m_isInit; }
-		bool isSocket()const { return m_isSocket; }
-		bool isClosed()const {return m_isClosed; }
+		bool isInit()const { return m_isInit.load(std::memory_order_relaxed); }
+		bool isSocket()const { return m_isSocket.load(std::memory_order_relaxed); }
+		bool isFile()const { return m_isFile.load(std::memory_order_relaxed); }
+		bool isClosed()const {return m_isClosed.load(std::memory_order_relaxed); }
+		uint64_t getGeneration()const { return m_generation.load(std::memory_order_relaxed); }
 
-		void setUderNonblock(bool v) { m_userNonblock = v; }//设置获取用户层非阻塞状态
-        bool getUserNonblock()const { return m_userNonblock; }
+		void setUderNonblock(bool v) { m_userNonblock.store(v, std::memory_order_relaxed); }//设置获取用户层非阻塞状态
+        bool getUserNonblock()const { return m_userNonblock.load(std::memory_order_relaxed); }
 
-        void setSysNonblock(bool v) { m_sysNonblock = v; }//设置获取系统层非阻塞状态
-		bool getSysNonblock()const { return m_sysNonblock; }
+        void setSysNonblock(bool v) { m_sysNonblock.store(v, std::memory_order_relaxed); }//设置获取系统层非阻塞状态
+		bool getSysNonblock()const { return m_sysNonblock.load(std::memory_order_relaxed); }
 		//设置获取超时时间，type区分读写，v=ms
 		void setTimeout(int type, uint64_t v);
 		uint64_t getTimeout(int type);
@@ -53,36 +65,42 @@ namespace sylar {
 		FdManager();
 
 		//获取指定文件描述符的FdCtx，auto_create表示如果不存在是否自动创建Fdctx
-		std::shared_ptr<FdCtx> get(int fd,bool auto_create=false);
-        void del(int fd);//删除指定文件描述符的FdCtx
+		//查找不加锁也不增加引用计数，返回的指针一直有效
+		FdCtx* get(int fd,bool auto_create=false);
+        void del(int fd);//删除指定文件描述符的FdCtx，之前取得的指针看到isClosed()为true，fd号复用后generation不同
 	private:
-		std::shared_mutex m_mutex;//保护对m_datas的访问，
-		std::vector<std::shared_ptr<FdCtx>> m_datas;//FdCtx对象共享指针
+		std::mutex m_mutex;//串行化创建和删除，查找不需要
+		FdTable<FdCtx> m_datas;//按fd分段存放的FdCtx
 	};
 
 	template<class T>
 	class Singleton {
 	private:
-		static T* instance;// 对外提供的实例
-		static std::mutex mutex;//互斥锁
+		static std::atomic<T*> instance;// 对外提供的实例
+		static std::mutex mutex;//互斥锁，只在创建和销毁时使用
 		Singleton();
 		~Singleton();
         Singleton(const Singleton&) = delete;
 		Singleton& operator=(const Singleton&) = delete;
 	public:
 		static T* GetInstance() {
+			//双重检查，创建之后每次调用只有一次load
+			T* p = instance.load(std::memory_order_acquire);
+			if (p) {
+				return p;
+			}
 			std::lock_guard < std::mutex > lock(mutex);
-			if (instance == nullptr) {
-			instance = new T();
+			p = instance.load(std::memory_order_relaxed);
+			if (p == nullptr) {
+				p = new T();
+				instance.store(p, std::memory_order_release);
 			}
-			return instance;
+			return p;
 		}
 		static void DestroyInstance() {
 			std::lock_guard<std::mutex> lock(mutex);
-			if (instance) {
-				delete instance;
-				instance = nullptr;
-			}
+			T* p = instance.exchange(nullptr);
+			delete p;
 		}
 	};
 
@@ -0,0 +1,191 @@
+#include "FiberContext.h"
+
+#include <cstdint>
+
+#ifdef SYLAR_FIBER_ASM_CONTEXT
+
+//void sylar_context_swap(void** from_sp, void* to_sp)
+//把被调用者保存寄存器压到当前栈，栈顶写入*from_sp，再切到to_sp并按相反顺序恢复
+//sylar_context_entry是新上下文第一次被切入时的返回地址，负责调用入口函数
+extern "C" void sylar_context_swap(void** from_sp, void* to_sp);
+extern "C" void sylar_context_entry();
+
+#if defined(__x86_64__)
+
+//栈布局(低->高)：mxcsr|x87控制字, r15, r14, r13, r12, rbx, rbp, 返回地址
+asm(R"(
+	.text
+	.globl sylar_context_swap
+	.type sylar_context_swap, @function
+	.p2align 4
+sylar_context_swap:
+	pushq %rbp
+	pushq %rbx
+	pushq %r12
+	pushq %r13
+	pushq %r14
+	pushq %r15
+	subq $8, %rsp
+	stmxcsr (%rsp)
+	fnstcw 4(%rsp)
+	movq %rsp, (%rdi)
+	movq %rsi, %rsp
+	ldmxcsr (%rsp)
+	fldcw 4(%rsp)
+	addq $8, %rsp
+	popq %r15
+	popq %r14
+	popq %r13
+	popq %r12
+	popq %rbx
+	popq %rbp
+	ret
+	.size sylar_context_swap, .-sylar_context_swap
+
+	.globl sylar_context_entry
+	.type sylar_context_entry, @function
+	.p2align 4
+sylar_context_entry:
+	callq *%r12
+	ud2
+	.size sylar_context_entry, .-sylar_context_entry
+)");
+
+#elif defined(__aarch64__)
+
+//栈布局(低->高)：x19-x28, x29(fp), x30(lr), d8-d15
+asm(R"(
+	.text
+	.globl sylar_context_swap
+	.type sylar_context_swap, %function
+	.p2align 4
+sylar_context_swap:
+	sub sp, sp, #160
+	stp x19, x20, [sp, #0]
+	stp x21, x22, [sp, #16]
+	stp x23, x24, [sp, #32]
+	stp x25, x26, [sp, #48]
+	stp x27, x28, [sp, #64]
+	stp x29, x30, [sp, #80]
+	stp d8, d9, [sp, #96]
+	stp d10, d11, [sp, #112]
+	stp d12, d13, [sp, #128]
+	stp d14, d15, [sp, #144]
+	mov x9, sp
+	str x9, [x0]
+	mov sp, x1
+	ldp x19, x20, [sp, #0]
+	ldp x21, x22, [sp, #16]
+	ldp x23, x24, [sp, #32]
+	ldp x25, x26, [sp, #48]
+	ldp x27, x28, [sp, #64]
+	ldp x29, x30, [sp, #80]
+	ldp d8, d9, [sp, #96]
+	ldp d10, d11, [sp, #112]
+	ldp d12, d13, [sp, #128]
+	ldp d14, d15, [sp, #144]
+	add sp, sp, #160
+	ret
+	.size sylar_context_swap, .-sylar_context_swap
+
+	.globl sylar_context_entry
+	.type sylar_context_entry, %function
+	.p2align 4
+sylar_context_entry:
+	blr x19
+	brk #0
+	.size sylar_context_entry, .-sylar_context_entry
+)");
+
+#endif
+
+namespace sylar {
+
+	int context_init(FiberContext* ctx)
+	{
+		//主协程的寄存器在第一次切出时才保存
+		ctx->sp = nullptr;
+		return 0;
+	}
+
+	int context_make(FiberContext* ctx, void* stack, size_t size, void (*entry)())
+	{
+		if (!stack || size < 256)
+		{
+			return -1;
+		}
+		//栈从高地址向低地址增长，栈底按16字节对齐
+		uintptr_t top = ((uintptr_t)stack + size) & ~(uintptr_t)15;
+#if defined(__x86_64__)
+		uint64_t* frame = (uint64_t*)(top - 64);
+		frame[0] = 0x1F80 | ((uint64_t)0x037F << 32);//mxcsr和x87控制字的默认值
+		frame[1] = 0;//r15
+		frame[2] = 0;//r14
+		frame[3] = 0;//r13
+		frame[4] = (uint64_t)entry;//r12
+		frame[5] = 0;//rbx
+		frame[6] = 0;//rbp
+		frame[7] = (uint64_t)&sylar_context_entry;//返回地址，ret后rsp恰好16字节对齐
+#elif defined(__aarch64__)
+		uint64_t* frame = (uint64_t*)(top - 160);
+		for (int i = 0; i < 20; i++)
+		{
+			frame[i] = 0;
+		}
+		frame[0] = (uint64_t)entry;//x19
+		frame[11] = (uint64_t)&sylar_context_entry;//x30
+#endif
+		ctx->sp = frame;
+		return 0;
+	}
+
+	int context_swap(FiberContext* from, FiberContext* to)
+	{
+		sylar_context_swap(&from->sp, to->sp);
+		return 0;
+	}
+
+	const char* context_backend()
+	{
+#if defined(__x86_64__)
+		return "asm-x86_64";
+#else
+		return "asm-aarch64";
+#endif
+	}
+}
+
+#else
+
+namespace sylar {
+
+	int context_init(FiberContext* ctx)
+	{
+		return getcontext(&ctx->uc);
+	}
+
+	int context_make(FiberContext* ctx, void* stack, size_t size, void (*entry)())
+	{
+		if (getcontext(&ctx->uc))
+		{
+			return -1;
+		}
+		ctx->uc.uc_link = nullptr;//没有后继上下文，入口函数结束前必须主动切走
+		ctx->uc.uc_stack.ss_sp = stack;
+		ctx->uc.uc_stack.ss_size = size;
+		makecontext(&ctx->uc, entry, 0);
+		return 0;
+	}
+
+	int context_swap(FiberContext* from, FiberContext* to)
+	{
+		return swapcontext(&from->uc, &to->uc);
+	}
+
+	const char* context_backend()
+	{
+		return "ucontext";
+	}
+}
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef _FIBER_CONTEXT_H_
+#define _FIBER_CONTEXT_H_
+
+#include <cstddef>
+
+/*
+协程上下文切换后端，编译期选择
+x86-64 / aarch64 默认使用手写汇编，只保存被调用者保存寄存器和栈指针，切换不陷入内核；
+其余平台或定义了 SYLAR_FIBER_UCONTEXT 时回退到 ucontext（swapcontext 每次切换会有一次 rt_sigprocmask 系统调用）
+*/
+#if !defined(SYLAR_FIBER_UCONTEXT) && (defined(__x86_64__) || defined(__aarch64__))
+#define SYLAR_FIBER_ASM_CONTEXT 1
+#else
+#include <ucontext.h>
+#endif
+
+namespace sylar {
+
+	struct FiberContext
+	{
+#ifdef SYLAR_FIBER_ASM_CONTEXT
+		void* sp = nullptr;//挂起时寄存器保存在自己的栈上，这里只记录栈顶
+#else
+		ucontext_t uc;
+#endif
+	};
+
+	//以下函数成功返回0，失败返回非0，与getcontext/swapcontext的约定一致
+
+	//初始化当前执行流（主协程）的上下文
+	int context_init(FiberContext* ctx);
+	//在stack上构造一个新上下文，第一次切换进去时执行entry，entry不能返回
+	int context_make(FiberContext* ctx, void* stack, size_t size, void (*entry)());
+	//保存当前上下文到from，切换到to
+	int context_swap(FiberContext* from, FiberContext* to);
+
+	//当前使用的后端名称
+	const char* context_backend();
+}
+
+#endif
@@ -0,0 +1,398 @@
+#include "FiberSync.h"
+
+namespace sylar {
+
+	//锁被短暂持有时自旋比挂起再被调度回来便宜得多
+	static const int SPIN_COUNT = 64;
+
+	static inline void cpu_relax()
+	{
+#if defined(__x86_64__) || defined(__i386__)
+		__builtin_ia32_pause();
+#elif defined(__aarch64__)
+		asm volatile("yield" ::: "memory");
+#endif
+	}
+
+	FiberWaiter::FiberWaiter()
+	{
+		//只有调度器里的子协程可以挂起，其他情况阻塞线程
+		if (Fiber::IsInScheduler() && Scheduler::GetThis())
+		{
+			fiber = Fiber::GetThis();
+			scheduler = Scheduler::GetThis();
+		}
+	}
+
+	void FiberWaiter::wait(std::unique_lock<std::mutex>& guard)
+	{
+		if (fiber)
+		{
+			guard.unlock();
+			//wake()可能在yield之前就把协程放入队列，Scheduler::run持有协程的m_mutex，会等到这里切出后才恢复
+			Fiber::GetThis()->yield();
+			return;
+		}
+		guard.unlock();
+		std::unique_lock<std::mutex> lock(mutex);
+		cv.wait(lock, [this]() { return notified; });
+	}
+
+	void FiberWaiter::wake()
+	{
+		if (fiber)
+		{
+			//调度之后等待者所在的栈随时可能被回收，先把要用的取出来
+			std::shared_ptr<Fiber> f = std::move(fiber);
+			Scheduler* s = scheduler;
+			s->ScheduleLock(f);
+			return;
+		}
+		//持锁通知，等待线程在这之后才能返回并销毁cv
+		std::lock_guard<std::mutex> lock(mutex);
+		notified = true;
+		cv.notify_one();
+	}
+
+	void FiberWaitQueue::push(FiberWaiter* waiter)
+	{
+		waiter->next = nullptr;
+		if (m_tail)
+		{
+			m_tail->next = waiter;
+		}
+		else
+		{
+			m_head = waiter;
+		}
+		m_tail = waiter;
+	}
+
+	FiberWaiter* FiberWaitQueue::pop()
+	{
+		FiberWaiter* waiter = m_head;
+		if (waiter)
+		{
+			m_head = waiter->next;
+			if (!m_head)
+			{
+				m_tail = nullptr;
+			}
+			waiter->next = nullptr;
+		}
+		return waiter;
+	}
+
+	void FiberWaitQueue::wakeAll()
+	{
+		while (FiberWaiter* waiter = pop())
+		{
+			waiter->wake();
+		}
+	}
+
+	bool FiberMutex::try_lock()
+	{
+		bool expected = false;
+		return m_locked.compare_exchange_strong(expected, true, std::memory_order_acquire);
+	}
+
+	void FiberMutex::lock()
+	{
+		while (true)
+		{
+			for (int i = 0; i < SPIN_COUNT; i++)
+			{
+				if (!m_locked.load(std::memory_order_relaxed) && try_lock())
+				{
+					return;
+				}
+				cpu_relax();
+			}
+
+			std::unique_lock<std::mutex> guard(m_guard);
+			//先登记等待再尝试加锁，与unlock先释放再检查等待数配对，二者至少有一方能看到对方
+			m_waiting.fetch_add(1);
+			bool expected = false;
+			if (m_locked.compare_exchange_strong(expected, true))
+			{
+				m_waiting.fetch_sub(1);
+				return;
+			}
+			FiberWaiter waiter;
+			m_waiters.push(&waiter);
+			//被唤醒后重新竞争：不直接移交所有权，避免锁在等待者被调度回来之前一直空占着
+			waiter.wait(guard);
+		}
+	}
+
+	void FiberMutex::unlock()
+	{
+		m_locked.store(false);
+		//没有等待者时不碰m_guard，无竞争的lock/unlock只有一次CAS和一次store
+		if (m_waiting.load() == 0)
+		{
+			return;
+		}
+		FiberWaiter* waiter = nullptr;
+		{
+			std::lock_guard<std::mutex> guard(m_guard);
+			waiter = m_waiters.pop();
+			if (waiter)
+			{
+				m_waiting.fetch_sub(1);
+			}
+		}
+		if (waiter)
+		{
+			waiter->wake();
+		}
+	}
+
+	void FiberConditionVariable::wait(std::unique_lock<FiberMutex>& lock)
+	{
+		FiberWaiter waiter;
+		{
+			std::unique_lock<std::mutex> guard(m_guard);
+			//先入队再释放外部锁，之后的notify一定能看到这个等待者
+			m_waiters.push(&waiter);
+			lock.unlock();
+			waiter.wait(guard);
+		}
+		lock.lock();
+	}
+
+	void FiberConditionVariable::notify_one()
+	{
+		FiberWaiter* waiter = nullptr;
+		{
+			std::lock_guard<std::mutex> guard(m_guard);
+			waiter = m_waiters.pop();
+		}
+		if (waiter)
+		{
+			waiter->wake();
+		}
+	}
+
+	void FiberConditionVariable::notify_all()
+	{
+		FiberWaitQueue waiters;
+		{
+			std::lock_guard<std::mutex> guard(m_guard);
+			std::swap(waiters, m_waiters);
+		}
+		waiters.wakeAll();
+	}
+
+	bool FiberSemaphore::tryWait()
+	{
+		int count = m_count.load(std::memory_order_relaxed);
+		while (count > 0)
+		{
+			if (m_count.compare_exchange_weak(count, count - 1, std::memory_order_acquire))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void FiberSemaphore::wait()
+	{
+		while (true)
+		{
+			for (int i = 0; i < SPIN_COUNT; i++)
+			{
+				if (tryWait())
+				{
+					return;
+				}
+				cpu_relax();
+			}
+
+			std::unique_lock<std::mutex> guard(m_guard);
+			//与FiberMutex相同：先登记再检查计数，notify先加计数再检查等待数
+			m_waiting.fetch_add(1);
+			int count = m_count.load();
+			while (count > 0)
+			{
+				if (m_count.compare_exchange_weak(count, count - 1))
+				{
+					m_waiting.fetch_sub(1);
+					return;
+				}
+			}
+			FiberWaiter waiter;
+			m_waiters.push(&waiter);
+			waiter.wait(guard);
+		}
+	}
+
+	void FiberSemaphore::notify()
+	{
+		m_count.fetch_add(1);
+		if (m_waiting.load() == 0)
+		{
+			return;
+		}
+		FiberWaiter* waiter = nullptr;
+		{
+			std::lock_guard<std::mutex> guard(m_guard);
+			waiter = m_waiters.pop();
+			if (waiter)
+			{
+				m_waiting.fetch_sub(1);
+			}
+		}
+		//被唤醒的等待者重新去取计数，可能被其他调用者先取走，那时它会再次挂起
+		if (waiter)
+		{
+			waiter->wake();
+		}
+	}
+
+	bool FiberRWMutex::try_lock()
+	{
+		//有写者在等待时也可以直接拿，只有读者被挡在外面
+		//挂起前的复查也走这里，和FiberMutex一样用默认的顺序一致读，与释放方的检查配对
+		uint32_t state = m_state.load();
+		return !(state & (WRITER | READERS)) && m_state.compare_exchange_strong(state, state | WRITER);
+	}
+
+	void FiberRWMutex::lock()
+	{
+		bool registered = false;//是否计入了m_waitingWriters
+		while (true)
+		{
+			bool acquired = false;
+			for (int i = 0; i < SPIN_COUNT; i++)
+			{
+				if (try_lock())
+				{
+					acquired = true;
+					break;
+				}
+				cpu_relax();
+			}
+			if (acquired && !registered)
+			{
+				return;
+			}
+
+			std::unique_lock<std::mutex> guard(m_guard);
+			if (!acquired)
+			{
+				//与FiberMutex相同：先登记等待再检查状态，释放方先改状态再检查等待数
+				m_waiting.fetch_add(1);
+				if (!registered)
+				{
+					registered = true;
+					if (m_waitingWriters++ == 0)
+					{
+						m_state.fetch_or(WRITER_WAITING);
+					}
+				}
+				if (!try_lock())
+				{
+					FiberWaiter waiter;
+					m_writers.push(&waiter);
+					waiter.wait(guard);
+					continue;
+				}
+				m_waiting.fetch_sub(1);
+			}
+			//最后一个等待的写者拿到锁后清掉标记，之后来的读者要等这个写者释放
+			if (--m_waitingWriters == 0)
+			{
+				m_state.fetch_and(~WRITER_WAITING);
+			}
+			return;
+		}
+	}
+
+	void FiberRWMutex::unlock()
+	{
+		uint32_t state = m_state.fetch_and(~WRITER);
+		assert(state & WRITER);
+		(void)state;
+		if (m_waiting.load() != 0)
+		{
+			wakeNext();
+		}
+	}
+
+	bool FiberRWMutex::try_lock_shared()
+	{
+		uint32_t state = m_state.load();
+		while (!(state & (WRITER | WRITER_WAITING)))
+		{
+			if (m_state.compare_exchange_weak(state, state + 1))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void FiberRWMutex::lock_shared()
+	{
+		while (true)
+		{
+			for (int i = 0; i < SPIN_COUNT; i++)
+			{
+				if (try_lock_shared())
+				{
+					return;
+				}
+				cpu_relax();
+			}
+
+			std::unique_lock<std::mutex> guard(m_guard);
+			m_waiting.fetch_add(1);
+			//有写者在等待时不再放行新的读者，防止写者饿死
+			if (try_lock_shared())
+			{
+				m_waiting.fetch_sub(1);
+				return;
+			}
+			FiberWaiter waiter;
+			m_readers.push(&waiter);
+			waiter.wait(guard);
+		}
+	}
+
+	void FiberRWMutex::unlock_shared()
+	{
+		uint32_t state = m_state.fetch_sub(1);
+		assert(state & READERS);
+		//最后一个读者释放时才可能有人在等
+		if ((state & READERS) == 1 && m_waiting.load() != 0)
+		{
+			wakeNext();
+		}
+	}
+
+	void FiberRWMutex::wakeNext()
+	{
+		FiberWaitQueue ready;
+		{
+			std::lock_guard<std::mutex> guard(m_guard);
+			//有写者在等待时读者反正拿不到锁，只唤醒一个写者；否则所有读者一起去拿
+			if (FiberWaiter* writer = m_writers.pop())
+			{
+				m_waiting.fetch_sub(1);
+				ready.push(writer);
+			}
+			else
+			{
+				while (FiberWaiter* reader = m_readers.pop())
+				{
+					m_waiting.fetch_sub(1);
+					ready.push(reader);
+				}
+			}
+		}
+		ready.wakeAll();
+	}
+}
@@ -0,0 +1,156 @@
+#ifndef _FIBER_SYNC_H_
+#define _FIBER_SYNC_H_
+
+#include "fiber.h"
+#include "Scheduler.h"
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+/*
+协程感知的同步原语：FiberMutex、FiberConditionVariable、FiberSemaphore、FiberRWMutex
+在调度器的协程中等待时，把当前协程挂到等待队列上并yield，工作线程继续执行其他协程；
+释放方把一个等待者交回它所属的Scheduler重新调度，被唤醒的等待者重新竞争
+（不直接移交所有权：移交会让锁在等待者被调度回来之前一直空占着，竞争激烈时吞吐量很差）
+在协程之外（如主线程、普通线程）调用时退化为在条件变量上阻塞线程
+等待队列由每个对象内部的一把std::mutex保护，临界区只有几条指令，不会跨越yield
+*/
+
+namespace sylar {
+
+	//一个等待者，放在等待方的栈上，被唤醒之前一直有效
+	struct FiberWaiter
+	{
+		std::shared_ptr<Fiber> fiber;//协程等待者
+		Scheduler* scheduler = nullptr;
+		//线程等待者
+		std::mutex mutex;
+		std::condition_variable cv;
+		bool notified = false;
+
+		FiberWaiter* next = nullptr;
+
+		FiberWaiter();
+		//挂起直到被wake()，guard是保护等待队列的锁，挂起前释放
+		void wait(std::unique_lock<std::mutex>& guard);
+		//唤醒等待者，调用之后不能再访问它
+		void wake();
+	};
+
+	//先进先出的侵入式等待队列，由调用者加锁
+	class FiberWaitQueue
+	{
+	public:
+		bool empty() const { return !m_head; }
+		FiberWaiter* front() const { return m_head; }
+		void push(FiberWaiter* waiter);
+		FiberWaiter* pop();
+		//唤醒并清空队列中所有等待者，调用时不要持有保护原队列的锁
+		void wakeAll();
+	private:
+		FiberWaiter* m_head = nullptr;
+		FiberWaiter* m_tail = nullptr;
+	};
+
+	//互斥锁，满足Lockable要求，可以配合std::lock_guard/std::unique_lock使用
+	class FiberMutex
+	{
+	public:
+		FiberMutex() = default;
+		FiberMutex(const FiberMutex&) = delete;
+		FiberMutex& operator=(const FiberMutex&) = delete;
+
+		//先自旋尝试若干次，仍然失败再挂起
+		void lock();
+		bool try_lock();
+		//释放，有等待者时唤醒队首
+		void unlock();
+	private:
+		std::atomic<bool> m_locked = { false };
+		std::atomic<int> m_waiting = { 0 };//已登记但还没有被唤醒的等待者数
+		std::mutex m_guard;
+		FiberWaitQueue m_waiters;
+	};
+
+	//条件变量，配合FiberMutex使用
+	class FiberConditionVariable
+	{
+	public:
+		FiberConditionVariable() = default;
+		FiberConditionVariable(const FiberConditionVariable&) = delete;
+		FiberConditionVariable& operator=(const FiberConditionVariable&) = delete;
+
+		//释放lock并挂起，被唤醒后重新加锁再返回
+		void wait(std::unique_lock<FiberMutex>& lock);
+		template<class Predicate>
+		void wait(std::unique_lock<FiberMutex>& lock, Predicate pred)
+		{
+			while (!pred())
+			{
+				wait(lock);
+			}
+		}
+		void notify_one();
+		void notify_all();
+	private:
+		std::mutex m_guard;
+		FiberWaitQueue m_waiters;
+	};
+
+	//计数信号量
+	class FiberSemaphore
+	{
+	public:
+		explicit FiberSemaphore(int count = 0) : m_count(count) {}
+		FiberSemaphore(const FiberSemaphore&) = delete;
+		FiberSemaphore& operator=(const FiberSemaphore&) = delete;
+
+		//P操作，计数为0时先自旋再挂起
+		void wait();
+		bool tryWait();
+		//V操作，有等待者时唤醒队首
+		void notify();
+		int getCount() const { return m_count; }
+	private:
+		std::atomic<int> m_count;
+		std::atomic<int> m_waiting = { 0 };
+		std::mutex m_guard;
+		FiberWaitQueue m_waiters;
+	};
+
+	//读写锁，写优先：有写者在等待时新的读者排队
+	//状态放在一个原子量里，无竞争的加锁和释放只有一次CAS或一次原子减，有等待者时才碰m_guard
+	//释放时有写者在排队就唤醒一个写者，否则唤醒所有排队的读者，被唤醒者和FiberMutex一样重新竞争
+	class FiberRWMutex
+	{
+	public:
+		FiberRWMutex() = default;
+		FiberRWMutex(const FiberRWMutex&) = delete;
+		FiberRWMutex& operator=(const FiberRWMutex&) = delete;
+
+		//先自旋尝试若干次，仍然失败再挂起
+		void lock();
+		bool try_lock();
+		void unlock();
+
+		void lock_shared();
+		bool try_lock_shared();
+		void unlock_shared();
+	private:
+		//锁被释放且有等待者时调用，不持有m_guard
+		void wakeNext();
+
+		static const uint32_t WRITER = 1u << 31;//有写者持有锁
+		static const uint32_t WRITER_WAITING = 1u << 30;//有写者在等待，新的读者不能加锁
+		static const uint32_t READERS = WRITER_WAITING - 1;//持有读锁的数量
+
+		std::atomic<uint32_t> m_state = { 0 };
+		std::atomic<int> m_waiting = { 0 };//已登记但还没有被唤醒的等待者数
+		std::mutex m_guard;
+		int m_waitingWriters = 0;//还没拿到锁的写者数，持有m_guard时修改，决定WRITER_WAITING位
+		FiberWaitQueue m_writers;
+		FiberWaitQueue m_readers;
+	};
+}
+
+#endif
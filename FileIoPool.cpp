@@ -0,0 +1,161 @@
+#include "FileIoPool.h"
+#include "FiberSync.h"
+#include "fiber.h"
+#include "Scheduler.h"
+
+#include <chrono>
+#include <string>
+
+namespace sylar {
+
+	static inline uint64_t now_us()
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	//请求放在调用者协程的栈上，协程挂起期间一直有效
+	struct FileIoPool::Job
+	{
+		Callback cb;
+		FiberWaiter waiter;
+		uint64_t enqueueTime = 0;
+	};
+
+	//故意不析构，池线程一直运行到进程退出，避免与静态对象的析构顺序冲突
+	FileIoPool* FileIoPool::GetInstance()
+	{
+		static FileIoPool* s_pool = new FileIoPool();
+		return s_pool;
+	}
+
+	void FileIoPool::setThreadCount(size_t count)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_target = count;
+		//已经启动过才补足线程，没启动的等第一次提交
+		if (m_alive > 0)
+		{
+			while (m_alive < m_target)
+			{
+				spawnLocked();
+			}
+		}
+		//多出来的线程被唤醒后退出
+		m_cond.notify_all();
+	}
+
+	size_t FileIoPool::getThreadCount()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_target;
+	}
+
+	void FileIoPool::spawnLocked()
+	{
+		m_alive++;
+		m_threads.emplace_back(new Thread(std::bind(&FileIoPool::worker, this),
+			"file_io_" + std::to_string(m_spawned++)));
+	}
+
+	bool FileIoPool::surplusLocked() const
+	{
+		//线程数减到0时，已经排队的请求不会再有别的线程来执行，全部执行完才退出
+		return m_alive > m_target && (m_target > 0 || m_queue.empty());
+	}
+
+	void FileIoPool::run(Callback cb)
+	{
+		//只有调度器里的子协程可以挂起，其他情况直接执行
+		if (!Fiber::IsInScheduler() || !Scheduler::GetThis())
+		{
+			cb();
+			return;
+		}
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		if (m_target == 0)
+		{
+			lock.unlock();
+			cb();
+			return;
+		}
+		while (m_alive < m_target)
+		{
+			spawnLocked();
+		}
+
+		//挂起期间调度器里看不到这个协程，要让它等到协程被唤醒之后再停止
+		Scheduler::GetThis()->addExternalWait();
+		Job job;
+		job.cb = std::move(cb);
+		job.enqueueTime = now_us();
+		m_queue.push_back(&job);
+		m_stats.submitted++;
+		if (m_queue.size() > m_stats.maxQueueDepth)
+		{
+			m_stats.maxQueueDepth = m_queue.size();
+		}
+		m_cond.notify_one();
+		//释放锁后挂起，完成时由池线程把协程放回调度器
+		job.waiter.wait(lock);
+	}
+
+	void FileIoPool::worker()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (true)
+		{
+			m_cond.wait(lock, [this]() { return !m_queue.empty() || surplusLocked(); });
+			if (surplusLocked())
+			{
+				m_alive--;
+				//从m_threads中取出自己的Thread对象，返回时析构（detach），线程随后退出
+				std::unique_ptr<Thread> self;
+				for (auto it = m_threads.begin(); it != m_threads.end(); ++it)
+				{
+					if (it->get() == Thread::GetThis())
+					{
+						self = std::move(*it);
+						m_threads.erase(it);
+						break;
+					}
+				}
+				return;
+			}
+			Job* job = m_queue.front();
+			m_queue.pop_front();
+			uint64_t start = now_us();
+			uint64_t wait = start - job->enqueueTime;
+			m_stats.totalWaitUs += wait;
+			if (wait > m_stats.maxWaitUs)
+			{
+				m_stats.maxWaitUs = wait;
+			}
+			m_stats.running++;
+			lock.unlock();
+
+			job->cb();
+			uint64_t end = now_us();
+			//唤醒之后协程随时可能恢复并销毁job，之后不能再访问它
+			Scheduler* scheduler = job->waiter.scheduler;
+			job->waiter.wake();
+			//协程已经放回队列，调度器这时才可以停止
+			scheduler->removeExternalWait();
+
+			lock.lock();
+			m_stats.running--;
+			m_stats.completed++;
+			m_stats.totalRunUs += end - start;
+		}
+	}
+
+	FileIoPool::Stats FileIoPool::getStats()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Stats stats = m_stats;
+		stats.threads = m_alive;
+		stats.queueDepth = m_queue.size();
+		return stats;
+	}
+}
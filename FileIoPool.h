@@ -0,0 +1,76 @@
+#ifndef _FILE_IO_POOL_H_
+#define _FILE_IO_POOL_H_
+
+#include "InlineFunction.h"
+#include "thread.h"
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+/*
+常规文件IO的阻塞线程池
+常规文件不会返回EAGAIN，页缓存未命中或者慢速的NFS挂载会直接阻塞调用线程，连带这个工作线程上排队的所有协程
+hook的read/write/pread/pwrite/fsync/open等遇到常规文件时把调用交给这里的线程执行，调用者协程挂起，执行完再被调度回来
+io_uring反应器且内核支持时文件IO直接提交给io_uring，不经过这里
+*/
+
+namespace sylar {
+
+	class FileIoPool
+	{
+	public:
+		struct Stats
+		{
+			size_t threads = 0;//当前线程数
+			size_t queueDepth = 0;//正在排队的请求数
+			size_t maxQueueDepth = 0;//排队请求数的峰值
+			size_t running = 0;//正在执行的请求数
+			uint64_t submitted = 0;
+			uint64_t completed = 0;
+			uint64_t totalWaitUs = 0;//请求在队列中等待的总时间
+			uint64_t maxWaitUs = 0;//单个请求最长的排队时间
+			uint64_t totalRunUs = 0;//执行的总时间
+		};
+
+		//全局唯一的池，第一次提交请求时才创建线程
+		static FileIoPool* GetInstance();
+
+		//设置线程数，可以随时增减，多出来的线程执行完手上的请求后退出；0表示不卸载，在调用线程上直接执行，
+		//减到0时已经排队的请求仍然由池线程执行完
+		void setThreadCount(size_t count);
+		size_t getThreadCount();
+
+		//在池中执行cb，当前协程挂起直到执行完成；不在调度器的协程中或者线程数为0时直接执行
+		//cb在池中的线程上运行，需要的errno要在cb里取出
+		void run(Callback cb);
+
+		Stats getStats();
+
+	private:
+		FileIoPool() = default;
+
+		struct Job;
+		//池线程的主循环
+		void worker();
+		//调用时持有m_mutex
+		void spawnLocked();
+		//当前线程是否多出来、应该退出，调用时持有m_mutex
+		bool surplusLocked() const;
+
+	private:
+		std::mutex m_mutex;
+		std::condition_variable m_cond;
+		std::deque<Job*> m_queue;
+		std::vector<std::unique_ptr<Thread>> m_threads;
+		size_t m_target = 4;//目标线程数
+		size_t m_alive = 0;//正在运行的线程数
+		size_t m_spawned = 0;//创建过的线程数，用于线程命名
+		Stats m_stats;
+	};
+}
+
+#endif
@@ -1,9 +1,16 @@
-#include"Hook.h"
-#include "IOManager.h"
+#include"Hook.h"
+
+#include "IOManager.h"
 #include <dlfcn.h>
 #include <iostream>
 #include <cstdarg>
 #include "Fd_manager.h"
+#include "FileIoPool.h"
+#include "Resolver.h"
+#include <arpa/inet.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <string.h>
 
 
@@ -17,19 +24,36 @@
     XX(accept) \
     XX(read) \
     XX(readv) \
+    XX(pread) \
     XX(recv) \
     XX(recvfrom) \
     XX(recvmsg) \
+    XX(recvmmsg) \
     XX(write) \
     XX(writev) \
+    XX(pwrite) \
     XX(send) \
     XX(sendto) \
     XX(sendmsg) \
+    XX(sendmmsg) \
+    XX(sendfile) \
+    XX(splice) \
+    XX(tee) \
+    XX(poll) \
+    XX(ppoll) \
+    XX(select) \
+    XX(epoll_wait) \
+    XX(open) \
+    XX(openat) \
+    XX(fsync) \
+    XX(fdatasync) \
     XX(close) \
     XX(fcntl) \
     XX(ioctl) \
     XX(getsockopt) \
-    XX(setsockopt) 
+    XX(setsockopt) \
+    XX(getaddrinfo) \
+    XX(gethostbyname) 
 
 namespace sylar{
 
@@ -82,6 +106,58 @@ struct timer_info
     int cancelled = 0;
 };
 
+// park this fiber until fd is ready for event or the timeout fires
+// return 0 -> ready, retry the call; -1 -> timed out (errno = ETIMEDOUT) or addEvent failed
+static int wait_io(sylar::IOManager* iom, int fd, uint32_t event, uint64_t timeout, const std::shared_ptr<timer_info>& tinfo, const char* hook_fun_name)
+{
+    // timer
+    std::shared_ptr<sylar::Timer> timer;
+    std::weak_ptr<timer_info> winfo(tinfo);
+
+    // 1 timeout has been set -> add a conditional timer for canceling this operation
+    if(timeout != (uint64_t)-1) 
+    {
+        timer = iom->addConditionTimer(timeout, [winfo, fd, iom, event]() 
+        {
+            auto t = winfo.lock();
+            if(!t || t->cancelled) 
+            {
+                return;
+            }
+            t->cancelled = ETIMEDOUT;
+            // cancel this event and trigger once to return to this fiber
+            iom->cancelEvent(fd, (sylar::IOManager::Event)(event));
+        }, winfo);
+    }
+
+    // 2 add event -> callback is this fiber
+    int rt = iom->addEvent(fd, (sylar::IOManager::Event)(event));
+    if(rt) 
+    {
+        std::cout << hook_fun_name << " addEvent("<< fd << ", " << event << ")";
+        if(timer) 
+        {
+            timer->cancel();
+        }
+        return -1;
+    } 
+
+    sylar::Fiber::GetThis()->yield();
+
+    // 3 resume either by addEvent or cancelEvent
+    if(timer) 
+    {
+        timer->cancel();
+    }
+    // by cancelEvent
+    if(tinfo->cancelled == ETIMEDOUT) 
+    {
+        errno = tinfo->cancelled;
+        return -1;
+    }
+    return 0;
+}
+
 // universal template for read and write function
 template<typename OriginFun, typename... Args>
 static ssize_t do_io(int fd, OriginFun fun, const char* hook_fun_name, uint32_t event, int timeout_so, Args&&... args) 
@@ -91,7 +167,7 @@ static ssize_t do_io(int fd, OriginFun fun, const char* hook_fun_name, uint32_t
         return fun(fd, std::forward<Args>(args)...);
     }
 
-    std::shared_ptr<sylar::FdCtx> ctx = sylar::FdMgr::GetInstance()->get(fd);
+    sylar::FdCtx* ctx = sylar::FdMgr::GetInstance()->get(fd);
     if(!ctx) 
     {
         return fun(fd, std::forward<Args>(args)...);
@@ -108,78 +184,491 @@ static ssize_t do_io(int fd, OriginFun fun, const char* hook_fun_name, uint32_t
         return fun(fd, std::forward<Args>(args)...);
     }
 
+    // the fd number may be closed and reopened while we are suspended -> remember which open fd this is
+    uint64_t generation = ctx->getGeneration();
     // get the timeout
     uint64_t timeout = ctx->getTimeout(timeout_so);
     // timer condition
     std::shared_ptr<timer_info> tinfo(new timer_info);
+    sylar::IOManager* iom = sylar::IOManager::GetThis();
+    bool persistent = iom && iom->persistentEvents();
 
 retry:
-	// run the function
-    ssize_t n = fun(fd, std::forward<Args>(args)...);
-    
-    // EINTR ->Operation interrupted by system ->retry
-    while(n == -1 && errno == EINTR) 
+    ssize_t n;
+    uint32_t seq = 0;
+    // persistent registration -> readiness is latched, skip the syscall
+    // while no edge has arrived since the last EAGAIN
+    if(persistent && !iom->isReady(fd, (sylar::IOManager::Event)(event), seq))
+    {
+        n = -1;
+        errno = EAGAIN;
+    }
+    else
     {
+        // run the function
         n = fun(fd, std::forward<Args>(args)...);
+
+        // EINTR ->Operation interrupted by system ->retry
+        while(n == -1 && errno == EINTR)
+        {
+            n = fun(fd, std::forward<Args>(args)...);
+        }
     }
     
     // 0 resource was temporarily unavailable -> retry until ready 
     if(n == -1 && errno == EAGAIN) 
     {
-        sylar::IOManager* iom = sylar::IOManager::GetThis();
-        // timer
-        std::shared_ptr<sylar::Timer> timer;
-        std::weak_ptr<timer_info> winfo(tinfo);
+        if(persistent)
+        {
+            // edges newer than seq still count as ready -> addEvent fires at once
+            iom->setDrained(fd, (sylar::IOManager::Event)(event), seq);
+        }
+        if(wait_io(iom, fd, event, timeout, tinfo, hook_fun_name))
+        {
+            return -1;
+        }
+        // closed (and maybe reused by another open) while waiting -> never touch the new fd
+        if(ctx->isClosed() || ctx->getGeneration() != generation)
+        {
+            errno = EBADF;
+            return -1;
+        }
+        goto retry;
+    }
+    return n;
+}
+
+// true if the user asked for nonblocking behaviour on fd -> no waiting on their behalf
+static bool user_nonblock(int fd)
+{
+    sylar::FdCtx* ctx = sylar::FdMgr::GetInstance()->get(fd);
+    if(ctx && !ctx->isClosed() && ctx->isSocket())
+    {
+        return ctx->getUserNonblock();
+    }
+    // pipes and files are not touched by FdCtx -> the real flag is the user's
+    int flags = fcntl_f(fd, F_GETFL);
+    return flags != -1 && (flags & O_NONBLOCK);
+}
+
+// splice/tee move data between two fds and at least one of them is a pipe,
+// so EAGAIN can come from either end: the input has nothing to read or the output is full
+// fun(extra_flags) runs the original call with SPLICE_F_NONBLOCK added so the pipe end
+// never blocks the thread; on EAGAIN wait for the input if it is empty, else for the output
+template<typename Fun>
+static ssize_t do_splice(int fd_in, int fd_out, const char* hook_fun_name, unsigned int flags, Fun fun)
+{
+    sylar::IOManager* iom = sylar::IOManager::GetThis();
+    if(!sylar::t_hook_enable || !iom || (flags & SPLICE_F_NONBLOCK)
+        || user_nonblock(fd_in) || user_nonblock(fd_out))
+    {
+        return fun(0);
+    }
+    sylar::FdCtx* in_ctx = sylar::FdMgr::GetInstance()->get(fd_in);
+    sylar::FdCtx* out_ctx = sylar::FdMgr::GetInstance()->get(fd_out);
+    if((in_ctx && in_ctx->isClosed()) || (out_ctx && out_ctx->isClosed()))
+    {
+        errno = EBADF;
+        return -1;
+    }
 
-        // 1 timeout has been set -> add a conditional timer for canceling this operation
-        if(timeout != (uint64_t)-1) 
+    std::shared_ptr<timer_info> tinfo(new timer_info);
+    bool persistent = iom->persistentEvents();
+
+    while(true)
+    {
+        uint32_t in_seq = 0;
+        uint32_t out_seq = 0;
+        if(persistent)
         {
-            timer = iom->addConditionTimer(timeout, [winfo, fd, iom, event]() 
-            {
-                auto t = winfo.lock();
-                if(!t || t->cancelled) 
-                {
-                    return;
-                }
-                t->cancelled = ETIMEDOUT;
-                // cancel this event and trigger once to return to this fiber
-                iom->cancelEvent(fd, (sylar::IOManager::Event)(event));
-            }, winfo);
+            iom->isReady(fd_in, sylar::IOManager::READ, in_seq);
+            iom->isReady(fd_out, sylar::IOManager::WRITE, out_seq);
+        }
+
+        ssize_t n = fun(SPLICE_F_NONBLOCK);
+        while(n == -1 && errno == EINTR)
+        {
+            n = fun(SPLICE_F_NONBLOCK);
+        }
+        if(n != -1 || errno != EAGAIN)
+        {
+            return n;
         }
 
-        // 2 add event -> callback is this fiber
-        int rt = iom->addEvent(fd, (sylar::IOManager::Event)(event));
-        if(rt) 
+        int avail = 0;
+        bool in_empty = ioctl_f(fd_in, FIONREAD, &avail) == 0 && avail == 0;
+        int fd = in_empty ? fd_in : fd_out;
+        uint32_t event = in_empty ? sylar::IOManager::READ : sylar::IOManager::WRITE;
+        // pipes get an FdCtx too, so close() drops their IOManager registration
+        sylar::FdCtx* ctx = sylar::FdMgr::GetInstance()->get(fd, true);
+        uint64_t timeout = (uint64_t)-1;
+        if(ctx && ctx->isSocket())
         {
-            std::cout << hook_fun_name << " addEvent("<< fd << ", " << event << ")";
-            if(timer) 
+            timeout = ctx->getTimeout(in_empty ? SO_RCVTIMEO : SO_SNDTIMEO);
+        }
+        if(persistent)
+        {
+            iom->setDrained(fd, (sylar::IOManager::Event)(event), in_empty ? in_seq : out_seq);
+        }
+        if(wait_io(iom, fd, event, timeout, tinfo, hook_fun_name))
+        {
+            return -1;
+        }
+    }
+}
+
+// io_uring reactor -> submit the operation itself and resume with its result,
+// no EAGAIN round trip and no epoll_ctl per event
+// return false if the call has to go through do_io instead
+// timeout_so = 0 -> use timeout_ms instead of the socket's SO_RCVTIMEO/SO_SNDTIMEO
+template<typename Prep>
+static bool uring_io(int fd, int timeout_so, Prep prep, ssize_t& result, uint64_t timeout_ms = (uint64_t)-1)
+{
+    if(!sylar::t_hook_enable)
+    {
+        return false;
+    }
+
+    sylar::IOManager* iom = sylar::IOManager::GetThis();
+    if(!iom || iom->getReactor() != sylar::IOManager::IO_URING)
+    {
+        return false;
+    }
+
+    // same conditions as do_io: only blocking sockets in the user's view
+    sylar::FdCtx* ctx = sylar::FdMgr::GetInstance()->get(fd);
+    if(!ctx || ctx->isClosed() || !ctx->isSocket() || ctx->getUserNonblock())
+    {
+        return false;
+    }
+
+    io_uring_sqe sqe;
+    prep(sqe);
+    int res = 0;
+    uint64_t timeout = timeout_so ? ctx->getTimeout(timeout_so) : timeout_ms;
+    if(!iom->submitIo(sqe, timeout, res))
+    {
+        return false;
+    }
+
+    if(res < 0)
+    {
+        errno = -res;
+        result = -1;
+    }
+    else
+    {
+        result = res;
+    }
+    return true;
+}
+
+// regular files never return EAGAIN -> a cold page cache or a slow NFS mount blocks the
+// whole worker; hand the call to io_uring when the ring can do file I/O, else to the
+// blocking FileIoPool, parking this fiber until it completes
+// outside a scheduler fiber the call just runs here
+template<typename Prep, typename Fun>
+static ssize_t file_io(Prep prep, Fun fun)
+{
+    sylar::IOManager* iom = sylar::IOManager::GetThis();
+    if(iom && iom->uringFileIo() && sylar::Fiber::IsInScheduler())
+    {
+        io_uring_sqe sqe;
+        prep(sqe);
+        int res = 0;
+        if(iom->submitIo(sqe, (uint64_t)-1, res))
+        {
+            if(res < 0)
             {
-                timer->cancel();
+                errno = -res;
+                return -1;
             }
-            return -1;
-        } 
-        else 
+            return res;
+        }
+    }
+
+    // errno belongs to the pool thread -> carry it back
+    ssize_t n = -1;
+    int err = 0;
+    sylar::FileIoPool::GetInstance()->run([&]()
+    {
+        n = fun();
+        err = errno;
+    });
+    if(n == -1)
+    {
+        errno = err;
+    }
+    return n;
+}
+
+// true if fd was opened through the hooked open/openat and is a regular file or block device
+static bool hooked_file(int fd)
+{
+    if(!sylar::t_hook_enable)
+    {
+        return false;
+    }
+    sylar::FdCtx* ctx = sylar::FdMgr::GetInstance()->get(fd);
+    return ctx && !ctx->isClosed() && ctx->isFile();
+}
+
+// the kernel never transfers more than this in one read/write anyway
+static unsigned rw_len(size_t count)
+{
+    return count > 0x7ffff000 ? 0x7ffff000 : (unsigned)count;
+}
+
+// offset -1 -> use and advance the file position, like read/write
+static void prep_file_rw(io_uring_sqe& sqe, int op, int fd, const void* addr, unsigned len, off_t offset)
+{
+    sylar::IoUring::PrepRw(sqe, op, fd, addr, len, (uint64_t)offset);
+}
+
+static int do_open(int dirfd, const char* pathname, int flags, mode_t mode)
+{
+    int fd = (int)file_io([=](io_uring_sqe& sqe)
+    {
+        sylar::IoUring::PrepRw(sqe, IORING_OP_OPENAT, dirfd, pathname, mode, 0);
+        sqe.open_flags = flags;
+    }, [=]()
+    {
+        return openat_f(dirfd, pathname, flags, mode);
+    });
+    if(fd >= 0)
+    {
+        // classify the fd once, later calls only look at the FdCtx
+        sylar::FdMgr::GetInstance()->get(fd, true);
+    }
+    return fd;
+}
+
+// the socket is in O_NONBLOCK mode, so read/write style opcodes would complete with -EAGAIN;
+// the socket opcodes below wait for readiness inside io_uring regardless of the file flag
+static bool uring_recvmsg(int fd, struct msghdr* msg, int flags, ssize_t& result)
+{
+    return uring_io(fd, SO_RCVTIMEO, [&](io_uring_sqe& sqe)
+    {
+        sylar::IoUring::PrepRw(sqe, IORING_OP_RECVMSG, fd, msg, 1, 0);
+        sqe.msg_flags = flags;
+    }, result);
+}
+
+static bool uring_sendmsg(int fd, const struct msghdr* msg, int flags, ssize_t& result)
+{
+    return uring_io(fd, SO_SNDTIMEO, [&](io_uring_sqe& sqe)
+    {
+        sylar::IoUring::PrepRw(sqe, IORING_OP_SENDMSG, fd, msg, 1, 0);
+        sqe.msg_flags = flags;
+    }, result);
+}
+
+static bool uring_recv(int fd, void* buf, size_t len, int flags, ssize_t& result)
+{
+    return uring_io(fd, SO_RCVTIMEO, [&](io_uring_sqe& sqe)
+    {
+        sylar::IoUring::PrepRw(sqe, IORING_OP_RECV, fd, buf, len, 0);
+        sqe.msg_flags = flags;
+    }, result);
+}
+
+static bool uring_send(int fd, const void* buf, size_t len, int flags, ssize_t& result)
+{
+    return uring_io(fd, SO_SNDTIMEO, [&](io_uring_sqe& sqe)
+    {
+        sylar::IoUring::PrepRw(sqe, IORING_OP_SEND, fd, buf, len, 0);
+        sqe.msg_flags = flags;
+    }, result);
+}
+
+
+
+// one fd a hooked poll/select/epoll_wait waits on
+struct poll_interest
+{
+    int fd;
+    uint32_t events; // IOManager::READ | IOManager::WRITE
+    uint32_t seq[2] = { 0, 0 }; // persistent mode edge counts for READ and WRITE
+};
+
+// the fiber is registered on several fds and maybe a timer -> the first one to fire
+// reschedules it, the rest find it already woken
+struct poll_waker
+{
+    std::shared_ptr<sylar::Fiber> fiber;
+    sylar::Scheduler* scheduler = nullptr;
+    std::atomic<bool> woken = { false };
+
+    void wake()
+    {
+        if(!woken.exchange(true))
+        {
+            scheduler->ScheduleLock(fiber);
+        }
+    }
+};
+
+// an fd that another fiber is already waiting on cannot be registered twice -> recheck it this often
+static const uint64_t s_poll_retry_ms = 10;
+
+static uint64_t now_us()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// poll/select/epoll_wait only suspend inside a hooked fiber of an IOManager
+static bool can_park()
+{
+    return sylar::t_hook_enable && sylar::Fiber::IsInScheduler() && sylar::IOManager::GetThis();
+}
+
+// park this fiber until check() reports something, one of the interests becomes ready or timeout_ms passes
+// check() is the original call with a zero timeout: > 0 ready, -1 error, 0 nothing yet
+// readiness is always decided by check() -> an edge that turns out stale just loops
+// return the last check() result, 0 on timeout; timeout_ms < 0 waits forever
+template<typename Check>
+static int wait_ready(std::vector<poll_interest>& interests, int timeout_ms, Check check)
+{
+    sylar::IOManager* iom = sylar::IOManager::GetThis();
+    bool persistent = iom->persistentEvents();
+    const sylar::IOManager::Event kinds[2] = { sylar::IOManager::READ, sylar::IOManager::WRITE };
+    // microseconds -> never return before the full timeout, like the kernel
+    uint64_t deadline = timeout_ms < 0 ? (uint64_t)-1 : now_us() + timeout_ms * 1000ULL;
+
+    while(true)
+    {
+        if(persistent)
         {
-            sylar::Fiber::GetThis()->yield();
-     
-            // 3 resume either by addEvent or cancelEvent
-            if(timer) 
+            for(auto& in : interests)
             {
-                timer->cancel();
+                for(int i = 0; i < 2; i++)
+                {
+                    if(in.events & kinds[i])
+                    {
+                        iom->isReady(in.fd, kinds[i], in.seq[i]);
+                    }
+                }
             }
-            // by cancelEvent
-            if(tinfo->cancelled == ETIMEDOUT) 
+        }
+        int n = check();
+        if(n != 0)
+        {
+            return n;
+        }
+        uint64_t now = now_us();
+        if(now >= deadline)
+        {
+            return 0;
+        }
+
+        std::shared_ptr<poll_waker> waker = std::make_shared<poll_waker>();
+        waker->fiber = sylar::Fiber::GetThis();
+        waker->scheduler = sylar::Scheduler::GetThis();
+        std::vector<std::pair<int, sylar::IOManager::Event>> registered;
+        bool missed = false;
+        for(auto& in : interests)
+        {
+            for(int i = 0; i < 2; i++)
             {
-                errno = tinfo->cancelled;
-                return -1;
+                if(!(in.events & kinds[i]))
+                {
+                    continue;
+                }
+                if(persistent)
+                {
+                    // edges newer than what check() saw still fire at once
+                    iom->setDrained(in.fd, kinds[i], in.seq[i]);
+                }
+                if(iom->addEvent(in.fd, kinds[i], [waker]() { waker->wake(); }) == 0)
+                {
+                    // the fd may have no FdCtx -> close() only cleans up fds marked here
+                    iom->markPolled(in.fd);
+                    registered.emplace_back(in.fd, kinds[i]);
+                }
+                else
+                {
+                    missed = true;
+                }
             }
-            goto retry;
+        }
+
+        uint64_t wait = deadline == (uint64_t)-1 ? (uint64_t)-1 : (deadline - now + 999) / 1000;
+        if(missed || (registered.empty() && wait == (uint64_t)-1))
+        {
+            wait = std::min(wait, s_poll_retry_ms);
+        }
+        std::shared_ptr<sylar::Timer> timer;
+        if(wait != (uint64_t)-1)
+        {
+            timer = iom->addTimer(wait, [waker]() { waker->wake(); });
+        }
+
+        sylar::Fiber::GetThis()->yield();
+
+        // drop whatever did not fire, their callbacks would only find the waker used up
+        if(timer)
+        {
+            timer->cancel();
+        }
+        for(auto& r : registered)
+        {
+            iom->delEvent(r.first, r.second);
         }
     }
-    return n;
 }
 
+// pollfd events -> IOManager events, one interest per distinct fd
+static void poll_interests(const struct pollfd* fds, nfds_t nfds, std::vector<poll_interest>& interests)
+{
+    for(nfds_t i = 0; i < nfds; i++)
+    {
+        uint32_t events = 0;
+        if(fds[i].events & (POLLIN | POLLPRI | POLLRDNORM | POLLRDBAND | POLLRDHUP))
+        {
+            events |= sylar::IOManager::READ;
+        }
+        if(fds[i].events & (POLLOUT | POLLWRNORM | POLLWRBAND))
+        {
+            events |= sylar::IOManager::WRITE;
+        }
+        // negative fds are ignored by poll; errors and hangups are reported with any registration
+        if(fds[i].fd < 0 || !events)
+        {
+            continue;
+        }
+        poll_interest in;
+        in.fd = fds[i].fd;
+        in.events = events;
+        interests.push_back(in);
+    }
+    std::sort(interests.begin(), interests.end(),
+        [](const poll_interest& a, const poll_interest& b) { return a.fd < b.fd; });
+    size_t out = 0;
+    for(size_t i = 0; i < interests.size(); i++)
+    {
+        if(out && interests[out - 1].fd == interests[i].fd)
+        {
+            interests[out - 1].events |= interests[i].events;
+        }
+        else
+        {
+            interests[out++] = interests[i];
+        }
+    }
+    interests.resize(out);
+}
 
+static int do_poll(struct pollfd* fds, nfds_t nfds, int timeout_ms)
+{
+    std::vector<poll_interest> interests;
+    poll_interests(fds, nfds, interests);
+    return wait_ready(interests, timeout_ms, [=]()
+    {
+        int n = poll_f(fds, nfds, 0);
+        return n == -1 && errno == EINTR ? 0 : n;
+    });
+}
 
 extern "C"{
 
@@ -263,7 +752,7 @@ int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen,
         return connect_f(fd, addr, addrlen);
     }
 
-    std::shared_ptr<sylar::FdCtx> ctx = sylar::FdMgr::GetInstance()->get(fd);
+    sylar::FdCtx* ctx = sylar::FdMgr::GetInstance()->get(fd);
     if(!ctx || ctx->isClosed()) 
     {
         errno = EBADF;
@@ -280,9 +769,28 @@ int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen,
 
         return connect_f(fd, addr, addrlen);
     }
+    uint64_t generation = ctx->getGeneration();
 
     // attempt to connect
-    int n = connect_f(fd, addr, addrlen);
+    int n;
+    ssize_t res = 0;
+    bool submitted = uring_io(fd, 0, [&](io_uring_sqe& sqe)
+    {
+        sylar::IoUring::PrepRw(sqe, IORING_OP_CONNECT, fd, addr, 0, addrlen);
+    }, res, timeout_ms);
+    if(submitted && !(res == -1 && errno == EINPROGRESS))
+    {
+        // io_uring waited for the handshake -> res is the final result
+        // (older kernels may still report EINPROGRESS, then wait for WRITE below)
+        return (int)res;
+    }
+    sylar::IOManager* iom = sylar::IOManager::GetThis();
+    uint32_t seq = 0;
+    if(iom->persistentEvents())
+    {
+        iom->isReady(fd, sylar::IOManager::WRITE, seq);
+    }
+    n = submitted ? -1 : connect_f(fd, addr, addrlen);
     if(n == 0) 
     {
         return 0;
@@ -292,8 +800,13 @@ int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen,
         return n;
     }
 
+    // not writable until the handshake finishes -> only a newer edge may wake us
+    if(iom->persistentEvents())
+    {
+        iom->setDrained(fd, sylar::IOManager::WRITE, seq);
+    }
+
     // wait for write event is ready -> connect succeeds
-    sylar::IOManager* iom = sylar::IOManager::GetThis();
     std::shared_ptr<sylar::Timer> timer;
     std::shared_ptr<timer_info> tinfo(new timer_info);
     std::weak_ptr<timer_info> winfo(tinfo);
@@ -328,6 +841,12 @@ int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen,
             errno = tinfo->cancelled;
             return -1;
         }
+        // closed while connecting -> SO_ERROR would belong to whatever reused the fd
+        if(ctx->isClosed() || ctx->getGeneration() != generation)
+        {
+            errno = EBADF;
+            return -1;
+        }
     } 
     else 
     {
@@ -365,7 +884,19 @@ int connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen)
 
 int accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen)
 {
-	int fd = do_io(sockfd, accept_f, "accept", sylar::IOManager::READ, SO_RCVTIMEO, addr, addrlen);	
+	ssize_t res = 0;
+	int fd;
+	if(uring_io(sockfd, SO_RCVTIMEO, [&](io_uring_sqe& sqe)
+	{
+		sylar::IoUring::PrepRw(sqe, IORING_OP_ACCEPT, sockfd, addr, 0, (uint64_t)(uintptr_t)addrlen);
+	}, res))
+	{
+		fd = (int)res;
+	}
+	else
+	{
+		fd = do_io(sockfd, accept_f, "accept", sylar::IOManager::READ, SO_RCVTIMEO, addr, addrlen);
+	}
 	if(fd>=0)
 	{
 		sylar::FdMgr::GetInstance()->get(fd, true);
@@ -375,16 +906,61 @@ int accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen)
 
 ssize_t read(int fd, void *buf, size_t count)
 {
+	if(hooked_file(fd))
+	{
+		return file_io([=](io_uring_sqe& sqe) { prep_file_rw(sqe, IORING_OP_READ, fd, buf, rw_len(count), -1); },
+			[=]() { return read_f(fd, buf, count); });
+	}
+	ssize_t n;
+	if(uring_recv(fd, buf, count, 0, n))
+	{
+		return n;
+	}
 	return do_io(fd, read_f, "read", sylar::IOManager::READ, SO_RCVTIMEO, buf, count);	
 }
 
 ssize_t readv(int fd, const struct iovec *iov, int iovcnt)
 {
+	if(hooked_file(fd))
+	{
+		return file_io([=](io_uring_sqe& sqe) { prep_file_rw(sqe, IORING_OP_READV, fd, iov, iovcnt, -1); },
+			[=]() { return readv_f(fd, iov, iovcnt); });
+	}
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = (struct iovec*)iov;
+	msg.msg_iovlen = iovcnt;
+	ssize_t n;
+	if(uring_recvmsg(fd, &msg, 0, n))
+	{
+		return n;
+	}
 	return do_io(fd, readv_f, "readv", sylar::IOManager::READ, SO_RCVTIMEO, iov, iovcnt);	
 }
 
+ssize_t pread(int fd, void *buf, size_t count, off_t offset)
+{
+	if(hooked_file(fd))
+	{
+		// io_uring reads offset -1 as "use the file position" -> reject it here like the original
+		if(offset < 0)
+		{
+			errno = EINVAL;
+			return -1;
+		}
+		return file_io([=](io_uring_sqe& sqe) { prep_file_rw(sqe, IORING_OP_READ, fd, buf, rw_len(count), offset); },
+			[=]() { return pread_f(fd, buf, count, offset); });
+	}
+	return pread_f(fd, buf, count, offset);
+}
+
 ssize_t recv(int sockfd, void *buf, size_t len, int flags)
 {
+	ssize_t n;
+	if(uring_recv(sockfd, buf, len, flags, n))
+	{
+		return n;
+	}
 	return do_io(sockfd, recv_f, "recv", sylar::IOManager::READ, SO_RCVTIMEO, buf, len, flags);	
 }
 
@@ -395,21 +971,78 @@ ssize_t recvfrom(int sockfd, void *buf, size_t len, int flags, struct sockaddr *
 
 ssize_t recvmsg(int sockfd, struct msghdr *msg, int flags)
 {
+	ssize_t n;
+	if(uring_recvmsg(sockfd, msg, flags, n))
+	{
+		return n;
+	}
 	return do_io(sockfd, recvmsg_f, "recvmsg", sylar::IOManager::READ, SO_RCVTIMEO, msg, flags);	
 }
 
+// the socket is nonblocking underneath -> returns as soon as at least one datagram
+// is queued (like MSG_WAITFORONE) and only parks the fiber while the queue is empty
+int recvmmsg(int sockfd, struct mmsghdr *msgvec, unsigned int vlen, int flags, struct timespec *timeout)
+{
+	return do_io(sockfd, recvmmsg_f, "recvmmsg", sylar::IOManager::READ, SO_RCVTIMEO, msgvec, vlen, flags, timeout);
+}
+
 ssize_t write(int fd, const void *buf, size_t count)
 {
+	if(hooked_file(fd))
+	{
+		return file_io([=](io_uring_sqe& sqe) { prep_file_rw(sqe, IORING_OP_WRITE, fd, buf, rw_len(count), -1); },
+			[=]() { return write_f(fd, buf, count); });
+	}
+	ssize_t n;
+	if(uring_send(fd, buf, count, 0, n))
+	{
+		return n;
+	}
 	return do_io(fd, write_f, "write", sylar::IOManager::WRITE, SO_SNDTIMEO, buf, count);	
 }
 
 ssize_t writev(int fd, const struct iovec *iov, int iovcnt)
 {
+	if(hooked_file(fd))
+	{
+		return file_io([=](io_uring_sqe& sqe) { prep_file_rw(sqe, IORING_OP_WRITEV, fd, iov, iovcnt, -1); },
+			[=]() { return writev_f(fd, iov, iovcnt); });
+	}
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = (struct iovec*)iov;
+	msg.msg_iovlen = iovcnt;
+	ssize_t n;
+	if(uring_sendmsg(fd, &msg, 0, n))
+	{
+		return n;
+	}
 	return do_io(fd, writev_f, "writev", sylar::IOManager::WRITE, SO_SNDTIMEO, iov, iovcnt);	
 }
 
+ssize_t pwrite(int fd, const void *buf, size_t count, off_t offset)
+{
+	if(hooked_file(fd))
+	{
+		// see pread
+		if(offset < 0)
+		{
+			errno = EINVAL;
+			return -1;
+		}
+		return file_io([=](io_uring_sqe& sqe) { prep_file_rw(sqe, IORING_OP_WRITE, fd, buf, rw_len(count), offset); },
+			[=]() { return pwrite_f(fd, buf, count, offset); });
+	}
+	return pwrite_f(fd, buf, count, offset);
+}
+
 ssize_t send(int sockfd, const void *buf, size_t len, int flags)
 {
+	ssize_t n;
+	if(uring_send(sockfd, buf, len, flags, n))
+	{
+		return n;
+	}
 	return do_io(sockfd, send_f, "send", sylar::IOManager::WRITE, SO_SNDTIMEO, buf, len, flags);	
 }
 
@@ -420,9 +1053,227 @@ ssize_t sendto(int sockfd, const void *buf, size_t len, int flags, const struct
 
 ssize_t sendmsg(int sockfd, const struct msghdr *msg, int flags)
 {
+	ssize_t n;
+	if(uring_sendmsg(sockfd, msg, flags, n))
+	{
+		return n;
+	}
 	return do_io(sockfd, sendmsg_f, "sendmsg", sylar::IOManager::WRITE, SO_SNDTIMEO, msg, flags);	
 }
 
+// may return fewer than vlen when the send buffer fills up, like the original
+int sendmmsg(int sockfd, struct mmsghdr *msgvec, unsigned int vlen, int flags)
+{
+	return do_io(sockfd, sendmmsg_f, "sendmmsg", sylar::IOManager::WRITE, SO_SNDTIMEO, msgvec, vlen, flags);
+}
+
+// in_fd must be a file that supports mmap-like access -> only the output can block
+ssize_t sendfile(int out_fd, int in_fd, off_t *offset, size_t count)
+{
+	return do_io(out_fd, sendfile_f, "sendfile", sylar::IOManager::WRITE, SO_SNDTIMEO, in_fd, offset, count);
+}
+
+ssize_t splice(int fd_in, loff_t *off_in, int fd_out, loff_t *off_out, size_t len, unsigned int flags)
+{
+	return do_splice(fd_in, fd_out, "splice", flags, [=](unsigned int extra)
+	{
+		return splice_f(fd_in, off_in, fd_out, off_out, len, flags | extra);
+	});
+}
+
+ssize_t tee(int fd_in, int fd_out, size_t len, unsigned int flags)
+{
+	return do_splice(fd_in, fd_out, "tee", flags, [=](unsigned int extra)
+	{
+		return tee_f(fd_in, fd_out, len, flags | extra);
+	});
+}
+
+// readiness waits -> registered with the IOManager, the fiber yields until an fd fires or the timeout passes
+int poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+    // nothing to wait for and no timeout -> the original blocks forever as well
+    if(!can_park() || timeout == 0 || (nfds == 0 && timeout < 0))
+    {
+        return poll_f(fds, nfds, timeout);
+    }
+    return do_poll(fds, nfds, timeout);
+}
+
+// the signal mask is per thread, not per fiber -> a call that swaps it keeps the original behaviour
+int ppoll(struct pollfd *fds, nfds_t nfds, const struct timespec *tmo_p, const sigset_t *sigmask)
+{
+    if(!can_park() || sigmask || (tmo_p && tmo_p->tv_sec == 0 && tmo_p->tv_nsec == 0) || (nfds == 0 && !tmo_p))
+    {
+        return ppoll_f(fds, nfds, tmo_p, sigmask);
+    }
+    int timeout = -1;
+    if(tmo_p)
+    {
+        // round up, a 1ns timeout still waits
+        uint64_t ms = (uint64_t)tmo_p->tv_sec * 1000 + (tmo_p->tv_nsec + 999999) / 1000000;
+        timeout = ms > INT32_MAX ? INT32_MAX : (int)ms;
+    }
+    return do_poll(fds, nfds, timeout);
+}
+
+// translated to poll: no FD_SETSIZE scan per wakeup, and the same registration path
+int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout)
+{
+    if(!can_park() || nfds < 0 || nfds > FD_SETSIZE || (timeout && timeout->tv_sec == 0 && timeout->tv_usec == 0)
+        || (nfds == 0 && !timeout))
+    {
+        return select_f(nfds, readfds, writefds, exceptfds, timeout);
+    }
+
+    std::vector<struct pollfd> pfds;
+    for(int fd = 0; fd < nfds; fd++)
+    {
+        short events = 0;
+        if(readfds && FD_ISSET(fd, readfds))
+        {
+            events |= POLLIN;
+        }
+        if(writefds && FD_ISSET(fd, writefds))
+        {
+            events |= POLLOUT;
+        }
+        if(exceptfds && FD_ISSET(fd, exceptfds))
+        {
+            events |= POLLPRI;
+        }
+        if(events)
+        {
+            pfds.push_back({ fd, events, 0 });
+        }
+    }
+
+    int timeout_ms = -1;
+    uint64_t start = now_us();
+    if(timeout)
+    {
+        uint64_t ms = (uint64_t)timeout->tv_sec * 1000 + (timeout->tv_usec + 999) / 1000;
+        timeout_ms = ms > INT32_MAX ? INT32_MAX : (int)ms;
+    }
+    int n = do_poll(pfds.data(), pfds.size(), timeout_ms);
+    if(timeout)
+    {
+        // Linux select reports the time left
+        uint64_t left = std::max<int64_t>(0, (int64_t)timeout_ms * 1000 - (int64_t)(now_us() - start));
+        timeout->tv_sec = left / 1000000;
+        timeout->tv_usec = left % 1000000;
+    }
+    if(n < 0)
+    {
+        return n;
+    }
+    for(auto& p : pfds)
+    {
+        if(p.revents & POLLNVAL)
+        {
+            errno = EBADF;
+            return -1;
+        }
+    }
+
+    // same mapping as the kernel's select: errors and hangups count as readable/writable
+    int count = 0;
+    for(int set = 0; set < 3; set++)
+    {
+        fd_set* fs = set == 0 ? readfds : (set == 1 ? writefds : exceptfds);
+        short mask = set == 0 ? (POLLIN | POLLHUP | POLLERR) : (set == 1 ? (POLLOUT | POLLERR) : POLLPRI);
+        if(!fs)
+        {
+            continue;
+        }
+        FD_ZERO(fs);
+        for(auto& p : pfds)
+        {
+            if((p.events & (set == 0 ? POLLIN : (set == 1 ? POLLOUT : POLLPRI))) && (p.revents & mask))
+            {
+                FD_SET(p.fd, fs);
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+// a nested epoll fd is readable while it has events to report -> wait on it like a socket
+int epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout)
+{
+    if(!can_park() || timeout == 0)
+    {
+        return epoll_wait_f(epfd, events, maxevents, timeout);
+    }
+    std::vector<poll_interest> interests(1);
+    interests[0].fd = epfd;
+    interests[0].events = sylar::IOManager::READ;
+    return wait_ready(interests, timeout, [=]()
+    {
+        int n = epoll_wait_f(epfd, events, maxevents, 0);
+        return n == -1 && errno == EINTR ? 0 : n;
+    });
+}
+
+// opening a file can block on a slow filesystem as well
+int open(const char *pathname, int flags, ...)
+{
+	mode_t mode = 0;
+	if((flags & O_CREAT) || (flags & O_TMPFILE) == O_TMPFILE)
+	{
+		va_list va;
+		va_start(va, flags);
+		mode = va_arg(va, int);
+		va_end(va);
+	}
+	if(!sylar::t_hook_enable)
+	{
+		return open_f(pathname, flags, mode);
+	}
+	return do_open(AT_FDCWD, pathname, flags, mode);
+}
+
+int openat(int dirfd, const char *pathname, int flags, ...)
+{
+	mode_t mode = 0;
+	if((flags & O_CREAT) || (flags & O_TMPFILE) == O_TMPFILE)
+	{
+		va_list va;
+		va_start(va, flags);
+		mode = va_arg(va, int);
+		va_end(va);
+	}
+	if(!sylar::t_hook_enable)
+	{
+		return openat_f(dirfd, pathname, flags, mode);
+	}
+	return do_open(dirfd, pathname, flags, mode);
+}
+
+int fsync(int fd)
+{
+	if(hooked_file(fd))
+	{
+		return (int)file_io([=](io_uring_sqe& sqe) { sylar::IoUring::PrepRw(sqe, IORING_OP_FSYNC, fd, nullptr, 0, 0); },
+			[=]() { return fsync_f(fd); });
+	}
+	return fsync_f(fd);
+}
+
+int fdatasync(int fd)
+{
+	if(hooked_file(fd))
+	{
+		return (int)file_io([=](io_uring_sqe& sqe)
+		{
+			sylar::IoUring::PrepRw(sqe, IORING_OP_FSYNC, fd, nullptr, 0, 0);
+			sqe.fsync_flags = IORING_FSYNC_DATASYNC;
+		}, [=]() { return fdatasync_f(fd); });
+	}
+	return fdatasync_f(fd);
+}
+
 int close(int fd)
 {
 	if(!sylar::t_hook_enable)
@@ -430,11 +1281,11 @@ int close(int fd)
 		return close_f(fd);
 	}	
 
-	std::shared_ptr<sylar::FdCtx> ctx = sylar::FdMgr::GetInstance()->get(fd);
+	sylar::FdCtx* ctx = sylar::FdMgr::GetInstance()->get(fd);
+	auto iom = sylar::IOManager::GetThis();
 
 	if(ctx)
 	{
-		auto iom = sylar::IOManager::GetThis();
 		if(iom)
 		{	
 			iom->cancelAll(fd);
@@ -442,6 +1293,11 @@ int close(int fd)
 		// del fdctx
 		sylar::FdMgr::GetInstance()->del(fd);
 	}
+	else if(iom)
+	{
+		// no fdctx (pipe, eventfd, ...) -> may still be registered by poll/select, drop that before the fd number is reused
+		iom->cancelPolled(fd);
+	}
 	return close_f(fd);
 }
 
@@ -456,7 +1312,7 @@ int fcntl(int fd, int cmd, ... /* arg */ )
             {
                 int arg = va_arg(va, int); // Access the next int argument
                 va_end(va);
-                std::shared_ptr<sylar::FdCtx> ctx = sylar::FdMgr::GetInstance()->get(fd);
+                sylar::FdCtx* ctx = sylar::FdMgr::GetInstance()->get(fd);
                 if(!ctx || ctx->isClosed() || !ctx->isSocket()) 
                 {
                     return fcntl_f(fd, cmd, arg);
@@ -480,7 +1336,7 @@ int fcntl(int fd, int cmd, ... /* arg */ )
             {
                 va_end(va);
                 int arg = fcntl_f(fd, cmd);
-                std::shared_ptr<sylar::FdCtx> ctx = sylar::FdMgr::GetInstance()->get(fd);
+                sylar::FdCtx* ctx = sylar::FdMgr::GetInstance()->get(fd);
                 if(!ctx || ctx->isClosed() || !ctx->isSocket()) 
                 {
                     return arg;
@@ -563,7 +1419,7 @@ int ioctl(int fd, unsigned long request, ...)
     if(FIONBIO == request) 
     {
         bool user_nonblock = !!*(int*)arg;
-        std::shared_ptr<sylar::FdCtx> ctx = sylar::FdMgr::GetInstance()->get(fd);
+        sylar::FdCtx* ctx = sylar::FdMgr::GetInstance()->get(fd);
         if(!ctx || ctx->isClosed() || !ctx->isSocket()) 
         {
             return ioctl_f(fd, request, arg);
@@ -589,7 +1445,7 @@ int setsockopt(int sockfd, int level, int optname, const void *optval, socklen_t
     {
         if(optname == SO_RCVTIMEO || optname == SO_SNDTIMEO) 
         {
-            std::shared_ptr<sylar::FdCtx> ctx = sylar::FdMgr::GetInstance()->get(sockfd);
+            sylar::FdCtx* ctx = sylar::FdMgr::GetInstance()->get(sockfd);
             if(ctx) 
             {
                 const timeval* v = (const timeval*)optval;
@@ -600,4 +1456,163 @@ int setsockopt(int sockfd, int level, int optname, const void *optval, socklen_t
     return setsockopt_f(sockfd, level, optname, optval, optlen);	
 }
 
+// numeric hosts never touch the network -> the original handles them, including scope ids
+static bool numeric_host(const char* node)
+{
+    in_addr addr;
+    return inet_aton(node, &addr) || strchr(node, ':');
+}
+
+// the original getaddrinfo on the blocking pool -> for whatever the resolver does not cover
+static int pool_getaddrinfo(const char* node, const char* service, const struct addrinfo* hints, struct addrinfo** res)
+{
+    int rt = 0;
+    int err = 0;
+    sylar::FileIoPool::GetInstance()->run([&]()
+    {
+        rt = getaddrinfo_f(node, service, hints, res);
+        err = errno;
+    });
+    if(rt == EAI_SYSTEM)
+    {
+        errno = err;
+    }
+    return rt;
+}
+
+// socket types returned when the hints leave them open, same set and order as glibc
+static const struct
+{
+    int socktype;
+    int protocol;
+} s_socktypes[] = { { SOCK_STREAM, IPPROTO_TCP }, { SOCK_DGRAM, IPPROTO_UDP }, { SOCK_RAW, 0 } };
+
+int getaddrinfo(const char* node, const char* service, const struct addrinfo* hints, struct addrinfo** res)
+{
+    if(!sylar::t_hook_enable || !node || !sylar::Fiber::IsInScheduler() || !sylar::IOManager::GetThis())
+    {
+        return getaddrinfo_f(node, service, hints, res);
+    }
+
+    int flags = hints ? hints->ai_flags : 0;
+    int family = hints ? hints->ai_family : AF_UNSPEC;
+    int socktype = hints ? hints->ai_socktype : 0;
+    int protocol = hints ? hints->ai_protocol : 0;
+    if((flags & AI_NUMERICHOST) || numeric_host(node)
+        || (family != AF_UNSPEC && family != AF_INET && family != AF_INET6))
+    {
+        return getaddrinfo_f(node, service, hints, res);
+    }
+    // canonical names, v4-mapped results and service names from /etc/services stay with the original
+    char* end = nullptr;
+    long port = service ? strtol(service, &end, 10) : 0;
+    if((flags & AI_CANONNAME) || ((flags & AI_V4MAPPED) && family == AF_INET6)
+        || (service && (!*service || *end || port < 0 || port > 65535)))
+    {
+        return pool_getaddrinfo(node, service, hints, res);
+    }
+
+    std::vector<sockaddr_storage> addrs;
+    int rt = sylar::Resolver::GetInstance()->resolve(node, family, addrs);
+    if(rt)
+    {
+        return rt;
+    }
+
+    struct addrinfo* head = nullptr;
+    struct addrinfo** tail = &head;
+    for(auto& addr : addrs)
+    {
+        for(auto& type : s_socktypes)
+        {
+            if((socktype && socktype != type.socktype) || (protocol && protocol != type.protocol))
+            {
+                continue;
+            }
+            socklen_t len = addr.ss_family == AF_INET ? sizeof(sockaddr_in) : sizeof(sockaddr_in6);
+            // entry and address in one block like glibc -> the caller frees it with the original freeaddrinfo
+            struct addrinfo* ai = (struct addrinfo*)calloc(1, sizeof(struct addrinfo) + len);
+            if(!ai)
+            {
+                freeaddrinfo(head);
+                return EAI_MEMORY;
+            }
+            ai->ai_flags = flags;
+            ai->ai_family = addr.ss_family;
+            ai->ai_socktype = type.socktype;
+            ai->ai_protocol = type.protocol;
+            ai->ai_addrlen = len;
+            ai->ai_addr = (struct sockaddr*)(ai + 1);
+            memcpy(ai->ai_addr, &addr, len);
+            if(addr.ss_family == AF_INET)
+            {
+                ((sockaddr_in*)ai->ai_addr)->sin_port = htons((uint16_t)port);
+            }
+            else
+            {
+                ((sockaddr_in6*)ai->ai_addr)->sin6_port = htons((uint16_t)port);
+            }
+            *tail = ai;
+            tail = &ai->ai_next;
+        }
+    }
+    if(!head)
+    {
+        // a socket type / protocol pair not in the table -> let the original decide
+        return pool_getaddrinfo(node, service, hints, res);
+    }
+    *res = head;
+    return 0;
+}
+
+// glibc returns static storage valid until the next call; here it is per thread,
+// read it before the fiber yields again
+struct HostentBuffer
+{
+    struct hostent ent;
+    std::string name;
+    std::vector<in_addr> addrs;
+    std::vector<char*> list;
+    char* aliases[1];
+};
+
+struct hostent* gethostbyname(const char* name)
+{
+    in_addr numeric;
+    if(!sylar::t_hook_enable || !name || !sylar::Fiber::IsInScheduler() || !sylar::IOManager::GetThis()
+        || inet_aton(name, &numeric))
+    {
+        return gethostbyname_f(name);
+    }
+
+    std::vector<sockaddr_storage> addrs;
+    int rt = sylar::Resolver::GetInstance()->resolve(name, AF_INET, addrs);
+    if(rt)
+    {
+        h_errno = rt == EAI_AGAIN ? TRY_AGAIN : (rt == EAI_NODATA ? NO_DATA : HOST_NOT_FOUND);
+        return nullptr;
+    }
+
+    static thread_local HostentBuffer t_host;
+    t_host.name = name;
+    t_host.addrs.clear();
+    for(auto& addr : addrs)
+    {
+        t_host.addrs.push_back(((sockaddr_in*)&addr)->sin_addr);
+    }
+    t_host.list.clear();
+    for(auto& addr : t_host.addrs)
+    {
+        t_host.list.push_back((char*)&addr);
+    }
+    t_host.list.push_back(nullptr);
+    t_host.aliases[0] = nullptr;
+    t_host.ent.h_name = &t_host.name[0];
+    t_host.ent.h_aliases = t_host.aliases;
+    t_host.ent.h_addrtype = AF_INET;
+    t_host.ent.h_length = sizeof(in_addr);
+    t_host.ent.h_addr_list = t_host.list.data();
+    return &t_host.ent;
+}
+
 }
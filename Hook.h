@@ -1,12 +1,19 @@
 #ifndef _HOOK_H_
 #define _HOOK_H_
+
 #include <cstdarg>
 #include <unistd.h>
 #include <sys/socket.h>
 #include <sys/types.h>          
 #include <sys/uio.h>
+#include <sys/sendfile.h>
 #include <sys/ioctl.h>
 #include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/select.h>
+#include <sys/epoll.h>
 #include <dlfcn.h> // 包含 dlsym 和 RTLD_NEXT 的头文件
       
 
@@ -47,6 +54,9 @@ extern "C"
 	typedef ssize_t(*readv_fun)(int fd, const struct iovec* iov, int iovcnt);
 	extern readv_fun readv_f;
 
+	typedef ssize_t(*pread_fun)(int fd, void* buf, size_t count, off_t offset);
+	extern pread_fun pread_f;
+
 	typedef ssize_t(*recv_fun) (int sockfd, void* buf, size_t len, int flags);
 	extern recv_fun recv_f;
 
@@ -56,12 +66,18 @@ extern "C"
 	typedef ssize_t(*recvmsg_fun) (int sockfd, struct msghdr* msg, int flags);
 	extern recvmsg_fun recvmsg_f;
 
+	typedef int (*recvmmsg_fun) (int sockfd, struct mmsghdr* msgvec, unsigned int vlen, int flags, struct timespec* timeout);
+	extern recvmmsg_fun recvmmsg_f;
+
 	typedef ssize_t(*write_fun) (int fd, const void* buf, size_t count);
 	extern write_fun write_f;
 
 	typedef ssize_t(*writev_fun) (int fd, const struct iovec* iov, int iovcnt);
 	extern writev_fun writev_f;
 
+	typedef ssize_t(*pwrite_fun) (int fd, const void* buf, size_t count, off_t offset);
+	extern pwrite_fun pwrite_f;
+
 	typedef ssize_t(*send_fun) (int sockfd, const void* buf, size_t len, int flags);
 	extern send_fun send_f;
 
@@ -71,6 +87,42 @@ extern "C"
 	typedef ssize_t(*sendmsg_fun) (int sockfd, const struct msghdr* msg, int flags);
 	extern sendmsg_fun sendmsg_f;
 
+	typedef int (*sendmmsg_fun) (int sockfd, struct mmsghdr* msgvec, unsigned int vlen, int flags);
+	extern sendmmsg_fun sendmmsg_f;
+
+	typedef ssize_t(*sendfile_fun) (int out_fd, int in_fd, off_t* offset, size_t count);
+	extern sendfile_fun sendfile_f;
+
+	typedef ssize_t(*splice_fun) (int fd_in, loff_t* off_in, int fd_out, loff_t* off_out, size_t len, unsigned int flags);
+	extern splice_fun splice_f;
+
+	typedef ssize_t(*tee_fun) (int fd_in, int fd_out, size_t len, unsigned int flags);
+	extern tee_fun tee_f;
+
+	typedef int (*poll_fun) (struct pollfd* fds, nfds_t nfds, int timeout);
+	extern poll_fun poll_f;
+
+	typedef int (*ppoll_fun) (struct pollfd* fds, nfds_t nfds, const struct timespec* tmo_p, const sigset_t* sigmask);
+	extern ppoll_fun ppoll_f;
+
+	typedef int (*select_fun) (int nfds, fd_set* readfds, fd_set* writefds, fd_set* exceptfds, struct timeval* timeout);
+	extern select_fun select_f;
+
+	typedef int (*epoll_wait_fun) (int epfd, struct epoll_event* events, int maxevents, int timeout);
+	extern epoll_wait_fun epoll_wait_f;
+
+	typedef int (*open_fun) (const char* pathname, int flags, ...);
+	extern open_fun open_f;
+
+	typedef int (*openat_fun) (int dirfd, const char* pathname, int flags, ...);
+	extern openat_fun openat_f;
+
+	typedef int (*fsync_fun) (int fd);
+	extern fsync_fun fsync_f;
+
+	typedef int (*fdatasync_fun) (int fd);
+	extern fdatasync_fun fdatasync_f;
+
 	typedef int (*close_fun) (int fd);
 	extern close_fun close_f;
 
@@ -86,6 +138,12 @@ extern "C"
 	typedef int (*setsockopt_fun) (int sockfd, int level, int optname, const void* optval, socklen_t optlen);
 	extern setsockopt_fun setsockopt_f;
 
+	typedef int (*getaddrinfo_fun) (const char* node, const char* service, const struct addrinfo* hints, struct addrinfo** res);
+	extern getaddrinfo_fun getaddrinfo_f;
+
+	typedef struct hostent* (*gethostbyname_fun) (const char* name);
+	extern gethostbyname_fun gethostbyname_f;
+
 	// function prototype -> ��Ӧ.h���Ѿ����� ����ʡ��
 	// sleep function 
 	//�����ض��壨��85-120�У�
@@ -102,20 +160,42 @@ extern "C"
 	// read 
 	ssize_t read(int fd, void* buf, size_t count);
 	ssize_t readv(int fd, const struct iovec* iov, int iovcnt);
+	ssize_t pread(int fd, void* buf, size_t count, off_t offset);
 
 	ssize_t recv(int sockfd, void* buf, size_t len, int flags);
 	ssize_t recvfrom(int sockfd, void* buf, size_t len, int flags, struct sockaddr* src_addr, socklen_t* addrlen);
 	ssize_t recvmsg(int sockfd, struct msghdr* msg, int flags);
+	int recvmmsg(int sockfd, struct mmsghdr* msgvec, unsigned int vlen, int flags, struct timespec* timeout);
 
 	// write
 	ssize_t write(int fd, const void* buf, size_t count);
 	ssize_t writev(int fd, const struct iovec* iov, int iovcnt);
+	ssize_t pwrite(int fd, const void* buf, size_t count, off_t offset);
 
 	ssize_t send(int sockfd, const void* buf, size_t len, int flags);
 	ssize_t sendto(int sockfd, const void* buf, size_t len, int flags, const struct sockaddr* dest_addr, socklen_t addrlen);
 	ssize_t sendmsg(int sockfd, const struct msghdr* msg, int flags);
+	int sendmmsg(int sockfd, struct mmsghdr* msgvec, unsigned int vlen, int flags);
+
+	// zero copy -> the socket end waits like send/recv, a pipe end never blocks the thread
+	ssize_t sendfile(int out_fd, int in_fd, off_t* offset, size_t count);
+	ssize_t splice(int fd_in, loff_t* off_in, int fd_out, loff_t* off_out, size_t len, unsigned int flags);
+	ssize_t tee(int fd_in, int fd_out, size_t len, unsigned int flags);
+
+	// readiness -> every fd is registered with the IOManager and the fiber yields, the timeout runs on a timer;
+	// lets client libraries that wait in poll/select scale with fibers instead of threads
+	int poll(struct pollfd* fds, nfds_t nfds, int timeout);
+	int ppoll(struct pollfd* fds, nfds_t nfds, const struct timespec* tmo_p, const sigset_t* sigmask);
+	int select(int nfds, fd_set* readfds, fd_set* writefds, fd_set* exceptfds, struct timeval* timeout);
+	int epoll_wait(int epfd, struct epoll_event* events, int maxevents, int timeout);
 
 	// fd
+	// regular files opened here are offloaded: read/write/readv/writev/pread/pwrite/fsync
+	// run on io_uring or the FileIoPool while the calling fiber is parked
+	int open(const char* pathname, int flags, ...);
+	int openat(int dirfd, const char* pathname, int flags, ...);
+	int fsync(int fd);
+	int fdatasync(int fd);
 	int close(int fd);
 
 	// socket control
@@ -124,5 +204,10 @@ extern "C"
 
 	int getsockopt(int sockfd, int level, int optname, void* optval, socklen_t* optlen);
 	int setsockopt(int sockfd, int level, int optname, const void* optval, socklen_t optlen);
+
+	// name resolution -> queries go through sylar::Resolver (Resolver.h), the fiber is parked
+	// while waiting for the DNS server; results are cached by TTL, the list is freed with freeaddrinfo
+	int getaddrinfo(const char* node, const char* service, const struct addrinfo* hints, struct addrinfo** res);
+	struct hostent* gethostbyname(const char* name);
 }
 #endif
\ No newline at end of file
@@ -1,13 +1,23 @@
 #include"IOManager.h"
+#include"Fd_manager.h"
 #include <unistd.h>    
 #include <sys/epoll.h> 
 #include <fcntl.h>     
 #include <cstring>
+#include <signal.h>
+#include <sys/syscall.h>
 
 
-static bool debug = true;
+static bool debug = false;
 namespace sylar {
 
+	//共享epoll模式下定向唤醒某个工作线程的信号：默认动作是忽略，很少有程序使用（Go运行时也用它做抢占）
+	//工作线程平时屏蔽它，只在epoll_pwait期间放开，不会打断用户代码里的系统调用
+	static const int WAKE_SIGNAL = SIGURG;
+	static void wake_signal_handler(int)
+	{
+	}
+
 	IOManager* IOManager::GetThis()
 	{ //与static相比dynamic有检查
 		return dynamic_cast<IOManager*>(Scheduler::GetThis());
@@ -29,11 +39,12 @@ namespace sylar {
 	void IOManager::FdContext::resetEventContext(EventContext& ctx)
 	{
 		ctx.scheduler = nullptr;
+		ctx.thread = -1;
 		ctx.fiber.reset();
 		ctx.cb = nullptr;
 	}
 
-	void IOManager::FdContext::triggerEvent(IOManager::Event event)
+	void IOManager::FdContext::triggerEvent(IOManager::Event event, Scheduler::TaskBatch* batch)
 	{
 		//无指定事件，中断
 		assert(events & event);
@@ -45,40 +56,110 @@ namespace sylar {
 
 		// 触发器
 		EventContext& ctx = getEventContext(event);
-		if (ctx.cb)
+		if (batch && batch->getScheduler() == ctx.scheduler)
+		{
+			if (ctx.cb)
+			{
+				batch->add(&ctx.cb, ctx.thread);
+			}
+			else
+			{
+				batch->add(&ctx.fiber, ctx.thread);
+			}
+		}
+		else if (ctx.cb)
 		{
-			ctx.scheduler->ScheduleLock(&ctx.cb);
+			ctx.scheduler->ScheduleLock(&ctx.cb, ctx.thread);
 		}
 		else
 		{
-			ctx.scheduler->ScheduleLock(&ctx.fiber);
+			ctx.scheduler->ScheduleLock(&ctx.fiber, ctx.thread);
 		}
 
 		resetEventContext(ctx);
 		return; 
 
 	}
-	IOManager::IOManager(size_t threads, bool use_caller, const std::string& name) :
-		Scheduler(threads,  use_caller, name), TimerManager()
+	IOManager::IOManager(size_t threads, bool use_caller, const std::string& name, TimerManager::Backend timer_backend, Reactor reactor, int options) :
+		Scheduler(threads,  use_caller, name), TimerManager(timer_backend), m_options(options)
 	{
-		m_epfd = epoll_create(5000);
-		assert(m_epfd > 0);//错误就终止程序
-
-		int rt = pipe(m_tickleFds);//创建管道 
-		assert(!rt);//错误终止程序
-
-		//管道监听注册到epoll
-		epoll_event event;
-		event.events = EPOLLIN | EPOLLET;//标志位，采用边缘触发和读
-		event.data.fd = m_tickleFds[0];
+		size_t pollers = (m_options & PER_THREAD_EPOLL) ? getWorkerCount() : 1;
+		for (size_t i = 0; i < pollers; i++)
+		{
+			Poller* poller = new Poller();
+			m_pollers.emplace_back(poller);
+			poller->epfd = epoll_create(5000);
+			assert(poller->epfd > 0);//错误就终止程序
+
+			//创建非阻塞eventfd，配合边缘触发
+			poller->tickleFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+			assert(poller->tickleFd >= 0);//错误终止程序
+
+			//eventfd监听注册到epoll
+			epoll_event event;
+			event.events = EPOLLIN | EPOLLET;//标志位，采用边缘触发和读
+			event.data.ptr = nullptr;//data.ptr为空表示唤醒通道，其他fd的data.ptr指向FdContext
+			int rt = epoll_ctl(poller->epfd, EPOLL_CTL_ADD, poller->tickleFd, &event);
+			assert(!rt);
+		}
 
-		//修改管道描述符以非阻塞的方式，配合边缘触发
-		rt = fcntl(m_tickleFds[0], F_SETFL, O_NONBLOCK);
-		assert(!rt);//每次要判断rt是否成功
-		rt = epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_tickleFds[0], &event);//将 m_tickleFds[0];作为读事件放入到event监听集合中
-		assert(!rt);
-		contextResize(32);//初始化32个文件描述符上下文的数组
+		if (pollers == 1)
+		{
+			//程序自己处理了这个信号时不覆盖，被唤醒时会多调用一次它的处理函数
+			struct sigaction old;
+			if (sigaction(WAKE_SIGNAL, nullptr, &old) == 0 && !(old.sa_flags & SA_SIGINFO)
+				&& (old.sa_handler == SIG_DFL || old.sa_handler == SIG_IGN))
+			{
+				struct sigaction sa;
+				memset(&sa, 0, sizeof(sa));
+				sa.sa_handler = wake_signal_handler;
+				sa.sa_flags = SA_RESTART;
+				sigemptyset(&sa.sa_mask);
+				sigaction(WAKE_SIGNAL, &sa, nullptr);
+			}
+		}
 
+		if (reactor == IO_URING)
+		{
+			m_uring.reset(new IoUring());
+			bool ok = m_uring->init(4096);
+			//cancelAll按fd取消在途操作（IORING_ASYNC_CANCEL_FD）需要5.19以上的内核，旧内核对未知的cancel_flags返回-EINVAL
+			//在一个没有在途操作的fd上试一次，支持时返回-ENOENT
+			if (ok)
+			{
+				io_uring_sqe sqe;
+				IoUring::PrepRw(sqe, IORING_OP_ASYNC_CANCEL, m_uring->getFd(), nullptr, 0, 0);
+				sqe.cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+				int res = m_uring->submitAndWait(sqe);
+				if (res == -EINVAL)
+				{
+					ok = false;
+					errno = EOPNOTSUPP;
+				}
+				else if (res < 0 && res != -ENOENT)
+				{
+					ok = false;
+					errno = -res;
+				}
+			}
+			//ring的fd也注册到每个epoll，有完成事件时唤醒idle线程收割
+			for (size_t i = 0; ok && i < m_pollers.size(); i++)
+			{
+				epoll_event event;
+				event.events = EPOLLIN | EPOLLET;
+				event.data.ptr = m_uring.get();
+				ok = !epoll_ctl(m_pollers[i]->epfd, EPOLL_CTL_ADD, m_uring->getFd(), &event);
+			}
+			if (!ok)
+			{
+				std::cerr << "IOManager: io_uring unavailable (" << strerror(errno) << "), fall back to epoll" << std::endl;
+				for (auto& poller : m_pollers)
+				{
+					epoll_ctl(poller->epfd, EPOLL_CTL_DEL, m_uring->getFd(), nullptr);
+				}
+				m_uring.reset();
+			}
+		}
 		start();//启动Scheduler，开启线程池，准备处理任务.
 	}
 
@@ -86,45 +167,161 @@ namespace sylar {
 	IOManager::~IOManager()
 	{
 		stop();//Scheduler关闭线程池
-		close(m_epfd);//关闭epoll句柄
-		close(m_tickleFds[0]); //关闭管道读写端 
-		close(m_tickleFds[1]);
+		m_uring.reset();//所有提交的操作都已完成（m_pendingEventCount为0）
+		for (auto& poller : m_pollers)
+		{
+			close(poller->epfd);//关闭epoll句柄
+			close(poller->tickleFd);
+		}
+		//fd上下文由m_fdContexts析构时释放
+	}
+	int IOManager::addEvent(int fd, Event event, Callback cb)
+	{
+		//所在的块还没有分配时分配并给每个上下文填上fd编号
+		FdContext* fd_ctx = m_fdContexts.get(fd, [](FdContext& ctx, int i) { ctx.fd = i; });
+		if (!fd_ctx)
+		{
+			std::cerr << "addEvent: fd " << fd << " out of range" << std::endl;
+			return -1;
+		}
 
-		//将fdcontext的文件描述符一个个关闭
-		for (size_t i = 0; i < m_fdContexts.size(); i++)
+		std::lock_guard<std::mutex> lock(fd_ctx->mutex);
+
+		//同一个事件不能重复添加
+		if (fd_ctx->events & event)
 		{
-			if (m_fdContexts[i])
-			{
-				delete m_fdContexts[i];
-			}
+			return -1;
+		}
+
+		if (m_options & PERSISTENT_EVENTS)
+		{
+			return addPersistentEvent(fd_ctx, event, cb);
+		}
+
+		int op = fd_ctx->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+		epoll_event epevent;
+		epevent.events = EPOLLET | fd_ctx->events | event;
+		epevent.data.ptr = fd_ctx;
+
+		//已有注册时沿用原来的epoll，否则注册到当前线程的epoll
+		int poller = fd_ctx->events ? fd_ctx->poller : selectPoller(fd);
+		int rt = epoll_ctl(m_pollers[poller]->epfd, op, fd, &epevent);
+		if (rt)
+		{
+			std::cerr << "addEvent::epoll_ctl failed: " << strerror(errno) << std::endl;
+			return -1;
+		}
+		fd_ctx->poller = poller;
+
+		++m_pendingEventCount;
+
+		fd_ctx->events = (Event)(fd_ctx->events | event);
+
+		//事件触发时调度回调函数，没有回调函数则重新调度当前协程
+		FdContext::EventContext& event_ctx = fd_ctx->getEventContext(event);
+		assert(!event_ctx.scheduler && !event_ctx.fiber && !event_ctx.cb);
+		event_ctx.scheduler = Scheduler::GetThis();
+		if (m_options & PER_THREAD_EPOLL)
+		{
+			event_ctx.thread = getWorkerThreadId(fd_ctx->poller);
+		}
+		if (cb)
+		{
+			event_ctx.cb.swap(cb);
+		}
+		else
+		{
+			event_ctx.fiber = Fiber::GetThis();
+			assert(event_ctx.fiber->get_state() == Fiber::RUNNING);
 		}
+		return 0;
 	}
-	void IOManager::contextResize(size_t size)
+
+	int IOManager::addPersistentEvent(FdContext* fd_ctx, Event event, Callback& cb)
 	{
-		m_fdContexts.resize(size);
-		//便利m_fdcontext向量，初始化未初始化的fdcontext对象
-		for (size_t i = 0; i < m_fdContexts.size(); i++)
+		if (!fd_ctx->persistent)
 		{
-			if (m_fdContexts[i] == nullptr)
+			epoll_event epevent;
+			epevent.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+			epevent.data.ptr = fd_ctx;
+			//fd可能还留着一次性模式下的注册
+			int poller = fd_ctx->events ? fd_ctx->poller : selectPoller(fd_ctx->fd);
+			int epfd = m_pollers[poller]->epfd;
+			int rt = epoll_ctl(epfd, EPOLL_CTL_ADD, fd_ctx->fd, &epevent);
+			if (rt && errno == EEXIST)
+			{
+				rt = epoll_ctl(epfd, EPOLL_CTL_MOD, fd_ctx->fd, &epevent);
+			}
+			if (rt)
 			{
-				m_fdContexts[i] = new FdContext();
-				m_fdContexts[i]->fd = i;//文件描述符编号赋值
+				std::cerr << "addEvent::epoll_ctl failed: " << strerror(errno) << std::endl;
+				return -1;
 			}
+			fd_ctx->poller = poller;
+			fd_ctx->persistent = true;
+		}
+
+		++m_pendingEventCount;
+		fd_ctx->events = (Event)(fd_ctx->events | event);
+
+		FdContext::EventContext& event_ctx = fd_ctx->getEventContext(event);
+		assert(!event_ctx.scheduler && !event_ctx.fiber && !event_ctx.cb);
+		event_ctx.scheduler = Scheduler::GetThis();
+		if (m_options & PER_THREAD_EPOLL)
+		{
+			event_ctx.thread = getWorkerThreadId(fd_ctx->poller);
+		}
+		if (cb)
+		{
+			event_ctx.cb.swap(cb);
+		}
+		else
+		{
+			event_ctx.fiber = Fiber::GetThis();
+		}
+
+		//EAGAIN之后、注册之前已经来过边沿，边缘触发不会再通知，立即触发
+		if (event_ctx.isReady())
+		{
+			fd_ctx->triggerEvent(event);
+			--m_pendingEventCount;
 		}
+		return 0;
 	}
-	bool IOManager::delEvent(int fd, Event event)
+
+	IOManager::FdContext* IOManager::getContext(int fd)
 	{
-		FdContext* fd_ctx = nullptr;
+		return m_fdContexts.find(fd);
+	}
 
-		std::shared_lock<std::shared_mutex>read_lock(m_mutex);//读锁
-		if ((int)m_fdContexts.size() > fd)//查找fdcontext如果没查找到代表数组中没这个文件描述符，返回false;
+	bool IOManager::isReady(int fd, Event event, uint32_t& seq)
+	{
+		FdContext* fd_ctx = getContext(fd);
+		if (!fd_ctx)
 		{
-			fd_ctx = m_fdContexts[fd];
-			read_lock.unlock();
+			seq = 0;
+			return true;
 		}
-		else
+		FdContext::EventContext& event_ctx = fd_ctx->getEventContext(event);
+		seq = event_ctx.edges.load(std::memory_order_acquire);
+		return event_ctx.isReady();
+	}
+
+	void IOManager::setDrained(int fd, Event event, uint32_t seq)
+	{
+		FdContext* fd_ctx = getContext(fd);
+		if (fd_ctx)
+		{
+			fd_ctx->getEventContext(event).drained.store(seq, std::memory_order_release);
+		}
+	}
+
+	bool IOManager::delEvent(int fd, Event event)
+	{
+		//查找fdcontext如果没查找到代表表中没这个文件描述符，返回false;
+		FdContext* fd_ctx = getContext(fd);
+		if (!fd_ctx)
 		{
-			read_lock.unlock();
 			return false;
 		}
 
@@ -140,16 +337,23 @@ namespace sylar {
 		//对原有的事件状态取反就是删除原有的状态
 		// 比如说传入参数是读事件，我们取反就是删除了这个读事件,但可能还要写事件
 		Event new_events = (Event)(fd_ctx->events & ~event);
-		int op = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
-		epoll_event epevent;
-		epevent.events = EPOLLET | new_events;
-		epevent.data.ptr = fd_ctx;//这是为了epoll触发时能快速找到与该事件相关联的FdContext对象
-        
-		int rt = epoll_ctl(m_epfd, op, fd, &epevent);
-		if (rt)
+		if (!fd_ctx->persistent)//常驻注册的fd不动epoll
 		{
-			std::cerr << "delEvent::epoll_ctl failed: " << strerror(errno) << std::endl;
-			return -1;
+			int op = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+			epoll_event epevent;
+			epevent.events = EPOLLET | new_events;
+			epevent.data.ptr = fd_ctx;//这是为了epoll触发时能快速找到与该事件相关联的FdContext对象
+
+			int rt = epoll_ctl(getEpfd(fd_ctx), op, fd, &epevent);
+			if (rt)
+			{
+				std::cerr << "delEvent::epoll_ctl failed: " << strerror(errno) << std::endl;
+				return -1;
+			}
+			if (!new_events)
+			{
+				fd_ctx->poller = -1;
+			}
 		}
 
 		--m_pendingEventCount;//减少待处理事件
@@ -161,16 +365,9 @@ namespace sylar {
 		return true;
 	}
 	bool IOManager::cancelEvent(int fd, Event event) {
-		FdContext* fd_ctx = nullptr;
-		std::shared_lock<std::shared_mutex>read_lock(m_mutex);
-		if ((int)m_fdContexts.size() > fd)
-		{
-			fd_ctx = m_fdContexts[fd];
-			read_lock.unlock();
-		}
-		else
+		FdContext* fd_ctx = getContext(fd);
+		if (!fd_ctx)
 		{
-			read_lock.unlock();
 			return false;
 		}
 
@@ -180,17 +377,24 @@ namespace sylar {
 		{
 			return false;
 		}
-		Event new_events = (Event)(fd_ctx->events & ~event);
-		int op =new_events?EPOLL_CTL_MOD:EPOLL_CTL_DEL;
-		epoll_event epevent;
-        epevent.events = EPOLLET | new_events;
-		epevent.data.ptr = fd_ctx;
-
-		int rt = epoll_ctl(m_epfd, op, fd, &epevent);
-		if (rt)
+		if (!fd_ctx->persistent)//常驻注册的fd不动epoll
 		{
-			std::cerr << "cancelEvent::epoll_ctl failed: " << strerror(errno) << std::endl;
-		    return -1;
+			Event new_events = (Event)(fd_ctx->events & ~event);
+			int op = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+			epoll_event epevent;
+			epevent.events = EPOLLET | new_events;
+			epevent.data.ptr = fd_ctx;
+
+			int rt = epoll_ctl(getEpfd(fd_ctx), op, fd, &epevent);
+			if (rt)
+			{
+				std::cerr << "cancelEvent::epoll_ctl failed: " << strerror(errno) << std::endl;
+				return -1;
+			}
+			if (!new_events)
+			{
+				fd_ctx->poller = -1;
+			}
 		}
 		--m_pendingEventCount;
 
@@ -201,36 +405,53 @@ namespace sylar {
 
 	bool IOManager::cancelAll(int fd)
 	{
-		FdContext* fd_ctx = nullptr;
-		std::shared_lock<std::shared_mutex>read_lock(m_mutex);
-		if ((int)m_fdContexts.size() > fd)
+		if (m_uring)
 		{
-			fd_ctx = m_fdContexts[fd];
-			read_lock.unlock();
+			//取消该fd上所有在途的io_uring操作，被取消的协程以EBADF返回，取消本身的完成事件忽略
+			io_uring_sqe sqe;
+			IoUring::PrepRw(sqe, IORING_OP_ASYNC_CANCEL, fd, nullptr, 0, 0);
+			sqe.cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+			sqe.user_data = 0;
+			m_uring->submit(&sqe, 1);
 		}
-		else
+
+		FdContext* fd_ctx = getContext(fd);
+		if (!fd_ctx)
 		{
-			read_lock.unlock();
 			return false;
 		}
 
 		std::lock_guard<std::mutex>lock(fd_ctx->mutex);
-
-		if (!fd_ctx->events)
-		{
-			return false;
-		}
+		fd_ctx->polled.store(false, std::memory_order_relaxed);
 
 		int op = EPOLL_CTL_DEL;
 		epoll_event epevent;
 		epevent.events = 0;
 		epevent.data.ptr = fd_ctx;
 
-		int rt = epoll_ctl(m_epfd, op, fd, &epevent);
-		if (rt)
+		if (fd_ctx->persistent)
 		{
-			std::cerr << "IOManager::epoll_ctl failed: " << strerror(errno) << std::endl;
-			return -1;
+			//fd即将关闭：解除常驻注册，锁存状态恢复为未知，fd号被复用时重新注册
+			epoll_ctl(getEpfd(fd_ctx), op, fd, &epevent);
+			fd_ctx->persistent = false;
+			fd_ctx->poller = -1;
+			fd_ctx->read.drained = fd_ctx->read.edges - 1;
+			fd_ctx->write.drained = fd_ctx->write.edges - 1;
+		}
+		else if (fd_ctx->events)
+		{
+			int rt = epoll_ctl(getEpfd(fd_ctx), op, fd, &epevent);
+			if (rt)
+			{
+				std::cerr << "IOManager::epoll_ctl failed: " << strerror(errno) << std::endl;
+				return -1;
+			}
+			fd_ctx->poller = -1;
+		}
+
+		if (!fd_ctx->events)
+		{
+			return false;
 		}
 
 		if (fd_ctx->events & READ)
@@ -248,16 +469,232 @@ namespace sylar {
 
 	}
 
+	void IOManager::markPolled(int fd)
+	{
+		FdContext* fd_ctx = getContext(fd);
+		//已经标记过时只读一次，不写共享的缓存行
+		if (fd_ctx && !fd_ctx->polled.load(std::memory_order_relaxed))
+		{
+			fd_ctx->polled.store(true, std::memory_order_relaxed);
+		}
+	}
+
+	bool IOManager::cancelPolled(int fd)
+	{
+		FdContext* fd_ctx = getContext(fd);
+		if (!fd_ctx || !fd_ctx->polled.exchange(false, std::memory_order_relaxed))
+		{
+			return false;
+		}
+		return cancelAll(fd);
+	}
+
+	//一次io_uring操作，放在发起协程的栈上，直到它的所有完成事件都收到后才恢复协程
+	struct IoRequest
+	{
+		std::shared_ptr<Fiber> fiber;
+		Scheduler* scheduler = nullptr;
+		int res = 0;
+		int pending = 0;//还没收到的完成事件数：操作本身，加上可能的超时
+		bool timedout = false;
+	};
+
+	bool IOManager::submitIo(const io_uring_sqe& sqe, uint64_t timeout_ms, int& res)
+	{
+		if (!m_uring)
+		{
+			return false;
+		}
+
+		IoRequest req;
+		req.fiber = Fiber::GetThis();
+		req.scheduler = Scheduler::GetThis();
+
+		//user_data最低位区分操作本身和链接在后面的超时
+		io_uring_sqe sqes[2];
+		sqes[0] = sqe;
+		sqes[0].user_data = (uint64_t)(uintptr_t)&req;
+		unsigned count = 1;
+		__kernel_timespec ts;
+		if (timeout_ms != (uint64_t)-1)
+		{
+			ts.tv_sec = timeout_ms / 1000;
+			ts.tv_nsec = (timeout_ms % 1000) * 1000000;
+			sqes[0].flags |= IOSQE_IO_LINK;
+			IoUring::PrepRw(sqes[1], IORING_OP_LINK_TIMEOUT, -1, &ts, 1, 0);
+			sqes[1].user_data = (uint64_t)(uintptr_t)&req | 1;
+			count = 2;
+		}
+		req.pending = count;
+
+		++m_pendingEventCount;
+		int rt = m_uring->submit(sqes, count);
+		if (rt)
+		{
+			--m_pendingEventCount;
+			return false;
+		}
+
+		//完成事件可能在yield之前就被其他线程收割，Scheduler::run持有协程的m_mutex，会等到这里切出后才恢复
+		Fiber::GetThis()->yield();
+
+		res = req.res;
+		if (res == -ECANCELED)
+		{
+			//超时取消的按超时返回，其余取消都来自cancelAll（fd被关闭）
+			res = req.timedout ? -ETIMEDOUT : -EBADF;
+		}
+		return true;
+	}
+
+	void IOManager::completeIo(uint64_t user_data, int res)
+	{
+		if (user_data == 0)//cancelAll提交的取消请求
+		{
+			return;
+		}
+		IoRequest* req = (IoRequest*)(uintptr_t)(user_data & ~(uint64_t)1);
+		if (user_data & 1)
+		{
+			req->timedout = (res == -ETIME);
+		}
+		else
+		{
+			req->res = res;
+		}
+		//收割在IoUring的完成队列锁内串行进行，pending不需要原子操作
+		if (--req->pending == 0)
+		{
+			//调度之后req所在的栈随时可能被回收，先把要用的取出来
+			std::shared_ptr<Fiber> fiber = std::move(req->fiber);
+			Scheduler* scheduler = req->scheduler;
+			scheduler->ScheduleLock(fiber);
+			--m_pendingEventCount;//先调度再减计数，与triggerEvent的顺序一致，避免调度器提前判定可以停止
+		}
+	}
+
+	bool IOManager::wakePoller(Poller* poller)
+	{
+		//上一次唤醒还没有被消费，被唤醒的线程回到调度循环后自然会看到新任务，不必再写
+		if (poller->wakePending.exchange(true))
+		{
+			return false;
+		}
+		//eventfd以边缘触发注册，内核只唤醒一个阻塞在epoll_wait上的线程
+		int rt = eventfd_write(poller->tickleFd, 1);
+		assert(rt == 0);
+		return true;
+	}
+
 	void IOManager::tickle()
 	{
 		if (!hasIdleThreads())//这个函数在scheduler检查是否有空闲线程，没有直接返回
 		{
 			return;
 		}
-		//如果有空闲线程，函数会向管道 m_tickleFds[1] 写入一个字符 "T"。
-		// 这个写操作的目的是向等待在 m_tickleFds[0]（管道的另一端）的线程发送一个信号，通知它有新任务可以处理了。
-		int rt = write(m_tickleFds[1], "T", 1);
-		assert(rt == 1);
+		if (m_pollers.size() == 1)
+		{
+			wakePoller(m_pollers[0].get());
+			return;
+		}
+		//每个线程等在自己的epoll上，轮流挑一个正在等待且还没有被唤醒的线程
+		size_t n = m_pollers.size();
+		size_t start = m_nextTickle++;
+		for (size_t i = 0; i < n; i++)
+		{
+			Poller* poller = m_pollers[(start + i) % n].get();
+			if (poller->waiting && wakePoller(poller))
+			{
+				return;
+			}
+		}
+	}
+
+	void IOManager::tickleThread(int thread)
+	{
+		int index = getWorkerIndex(thread);
+		if (index < 0)
+		{
+			return;
+		}
+		if (m_pollers.size() > 1)
+		{
+			wakePoller(m_pollers[index].get());
+			return;
+		}
+		//共享模式下所有线程等在同一个epoll上，写eventfd不知道会唤醒哪一个，改为给目标线程发信号打断epoll_pwait
+		//调用者先入队再检查idle，与目标线程先置idle再检查任务配对：要么它看到任务不阻塞，要么这里看到它空闲
+		//信号在目标线程屏蔽期间到达会保持挂起，到epoll_pwait时立即返回，不会丢失
+		if (isWorkerIdle(index))
+		{
+			syscall(SYS_tgkill, getpid(), thread, WAKE_SIGNAL);
+		}
+	}
+
+	int IOManager::selectPoller(int fd)
+	{
+		if (m_pollers.size() == 1)
+		{
+			return 0;
+		}
+		int index = getLocalWorkerIndex();
+		if (index >= 0)
+		{
+			return index;
+		}
+		//调用线程在stop()之前不参与调度，不把fd放到它的epoll上
+		size_t first = (useCaller() && m_pollers.size() > 1) ? 1 : 0;
+		return (int)(first + (size_t)fd % (m_pollers.size() - first));
+	}
+
+	int IOManager::CreateReusePortListener(const sockaddr* addr, socklen_t addrlen, int backlog)
+	{
+		int fd = ::socket(addr->sa_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (fd < 0)
+		{
+			std::cerr << "CreateReusePortListener::socket failed: " << strerror(errno) << std::endl;
+			return -1;
+		}
+		int on = 1;
+		if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on))
+			|| setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on))
+			|| bind(fd, addr, addrlen)
+			|| ::listen(fd, backlog))
+		{
+			std::cerr << "CreateReusePortListener failed: " << strerror(errno) << std::endl;
+			::close(fd);
+			return -1;
+		}
+		//交给hook管理，accept在协程中等待而不是阻塞线程
+		FdMgr::GetInstance()->get(fd, true);
+		return fd;
+	}
+
+	int IOManager::listenReusePort(const sockaddr* addr, socklen_t addrlen, int backlog, std::function<void(int)> cb)
+	{
+		size_t n = getWorkerCount();
+		size_t first = (useCaller() && n > 1) ? 1 : 0;
+		std::vector<int> fds;
+		for (size_t i = first; i < n; i++)
+		{
+			int fd = CreateReusePortListener(addr, addrlen, backlog);
+			if (fd < 0)
+			{
+				for (int f : fds)
+				{
+					FdMgr::GetInstance()->del(f);
+					::close(f);
+				}
+				return -1;
+			}
+			fds.push_back(fd);
+		}
+		for (size_t i = 0; i < fds.size(); i++)
+		{
+			int fd = fds[i];
+			ScheduleLock([cb, fd]() { cb(fd); }, getWorkerThreadId(first + i));
+		}
+		return (int)fds.size();
 	}
 
 	bool IOManager::stopping()
@@ -272,6 +709,25 @@ namespace sylar {
 		static const uint64_t MAX_EVENTS = 256;
 		//使用std::unique_ptr动态分配一个大小为MAX_EVENTS的epoll_event数组，用于存储epoll_wait返回的事件。
 		std::unique_ptr<epoll_event[]> events(new epoll_event[MAX_EVENTS]);
+		//共享模式等在唯一的epoll上，按线程模式等在本线程的epoll上
+		int index = m_pollers.size() == 1 ? 0 : getLocalWorkerIndex();
+		assert(index >= 0);
+		Poller* poller = m_pollers[index].get();
+		//一轮收集到的定时器回调和就绪事件各自作为一批提交，每批只加一次锁、只做一次唤醒决策
+		TaskBatch batch(this);
+		std::vector<Callback> cbs;
+		//共享模式下只在epoll_pwait期间接收唤醒信号
+		bool shared = m_pollers.size() == 1;
+		sigset_t old_mask, wait_mask;
+		if (shared)
+		{
+			sigset_t block;
+			sigemptyset(&block);
+			sigaddset(&block, WAKE_SIGNAL);
+			pthread_sigmask(SIG_BLOCK, &block, &old_mask);
+			wait_mask = old_mask;
+			sigdelset(&wait_mask, WAKE_SIGNAL);
+		}
 
 		while (true)
 		{
@@ -279,6 +735,13 @@ namespace sylar {
 			if (stopping())
 			{
 				if(debug)std::cout << "name = " << getName() << " idle exits in thread: " << Thread::GetThreadId() << std::endl;
+				TimerManager::ClearCurrentTime();//线程离开事件循环，缓存的时间不再刷新
+				if (shared)
+				{
+					pthread_sigmask(SIG_SETMASK, &old_mask, nullptr);
+				}
+				//stop()的多次tickle被合并成一次唤醒，由退出的线程依次唤醒下一个仍在等待的线程
+				tickle();
                 break;
 			}
 
@@ -286,9 +749,17 @@ namespace sylar {
 			while (true)
 			{
 				static const uint64_t MAX_TIMEOUT = 5000;//定义最大超时时间5000ms
+				//先声明等待再检查任务和定时器，与tickle先入队再检查waiting配对
+				poller->waiting = true;
 				uint64_t next_timeout = getNextTimer();
 				next_timeout = std::min(next_timeout, MAX_TIMEOUT);
-				rt = epoll_wait(m_epfd, events.get(), MAX_EVENTS, next_timeout);
+				//已经有可执行的任务就只收集就绪事件，不阻塞
+				if (hasReadyTasks())
+				{
+					next_timeout = 0;
+				}
+				rt = epoll_pwait(poller->epfd, events.get(), MAX_EVENTS, next_timeout, shared ? &wait_mask : nullptr);
+				poller->waiting = false;
 
 				if (rt < 0 && errno == EINTR)//rt小于0代表无限阻塞，errno是EINTR(表示信号中断)
 				{
@@ -301,28 +772,44 @@ namespace sylar {
 
 			};//end epoll_wait
 
-			std::vector<std::function<void()>>cbs;//存储超时的回调函数
+			//每轮循环只读一次时钟，本轮的超时判断和随后在本线程执行的任务添加定时器都用这个时间
+			TimerManager::UpdateCurrentTime();
+
 			listExpiredCb(cbs);//获取所有超时的定时器回调，添加到cbs中
 			if (!cbs.empty())
 			{
-				for (const auto& cb : cbs)
+				for (auto& cb : cbs)
 				{
-					ScheduleLock(cb);
+					batch.add(&cb);//转移回调，不拷贝
 				}
+				batch.submit();
 				cbs.clear();
 			}
 
+			//本轮触发的事件数：提交batch之后才从m_pendingEventCount中减去，
+			//与triggerEvent先调度再减计数的顺序一致，避免调度器在任务入队之前判定可以停止
+			size_t triggered = 0;
+
 			//遍历所有的rt，代表多少个事件准备了
 			for (int i = 0; i < rt; i++)
 			{
 				epoll_event &event = events[i];//获取第i个epoll_event,用于处理该事件
 
 				//检查当前时间是否为tickle(唤醒空闲线程)
-				if (event.data.fd == m_tickleFds[0])
+				if (event.data.ptr == nullptr)
+				{
+					//先读取再清除标志：读取与清除之间的tickle看到标志还在就不写，本线程回到调度循环后会看到它的任务；
+					//反过来的话，清除之后写入的计数可能被这次读取吞掉，标志却一直留着，之后的tickle都不再写eventfd
+					eventfd_t dummy;
+					eventfd_read(poller->tickleFd, &dummy);//一次读取就清空eventfd计数
+					poller->wakePending = false;
+					continue;
+				}
+
+				//io_uring有完成事件，边缘触发，必须一次收割干净
+				if (event.data.ptr == m_uring.get())
 				{
-					uint8_t dummy[256];
-					//循环读取管道内容来消耗所有的唤醒信号，防止后续重复触发
-					while (read(m_tickleFds[0], dummy, sizeof(dummy)) > 0);
+					m_uring->reap([this](uint64_t user_data, int res) { completeIo(user_data, res); });
 					continue;
 				}
 
@@ -330,6 +817,31 @@ namespace sylar {
 				FdContext *fd_ctx =(FdContext* )event.data.ptr;//通过 event.data.ptr 获取与当前事件关联的 FdContext 指针 fd_ctx，该指针包含了与文件描述符相关的上下文信息。
 				std::lock_guard<std::mutex> lock(fd_ctx->mutex);
 
+				//常驻注册的fd：锁存边沿并唤醒等待者，不修改epoll
+				if (fd_ctx->persistent)
+				{
+					bool error = event.events & (EPOLLERR | EPOLLHUP);
+					if (error || (event.events & (EPOLLIN | EPOLLRDHUP)))
+					{
+						fd_ctx->read.edges++;
+						if (fd_ctx->events & READ)
+						{
+							fd_ctx->triggerEvent(READ, &batch);
+							triggered++;
+						}
+					}
+					if (error || (event.events & EPOLLOUT))
+					{
+						fd_ctx->write.edges++;
+						if (fd_ctx->events & WRITE)
+						{
+							fd_ctx->triggerEvent(WRITE, &batch);
+							triggered++;
+						}
+					}
+					continue;
+				}
+
 				//如果当前事件是错误或挂起（EPOLLERR 或 EPOLLHUP），则将其转换为可读或可写事件（EPOLLIN 或 EPOLLOUT），以便后续处理。
 				if (event.events & (EPOLLERR | EPOLLHUP))
 				{
@@ -339,7 +851,7 @@ namespace sylar {
 				int real_events = NONE;
 				if (event.events & EPOLLIN)
 				{
-					real_events != READ;
+					real_events |= READ;
 				}
 				if (event.events & EPOLLOUT)
 				{
@@ -357,25 +869,30 @@ namespace sylar {
 				int op = left_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
 				event.events = EPOLLET | left_events;//如果left_event没有事件了那么就只剩下边缘触发了events设置了
 				//根据之前计算的操作（op），调用 epoll_ctl 更新或删除 epoll 监听，如果失败，打印错误并继续处理下一个事件。
-				int rt2= epoll_ctl(m_epfd, op, fd_ctx->fd, &event);
+				int rt2= epoll_ctl(poller->epfd, op, fd_ctx->fd, &event);
 				if (rt2)
 				{
 					std::cerr << "idle::epoll_ctl failed: " << strerror(errno) << std::endl;
 					continue;
 				}
+				if (!left_events)
+				{
+					fd_ctx->poller = -1;
+				}
 
 				if (real_events & READ)
 				{
-					fd_ctx->triggerEvent(READ);
-					--m_pendingEventCount;
+					fd_ctx->triggerEvent(READ, &batch);
+					triggered++;
 				}
 				if (real_events & WRITE)
 				{
-                    fd_ctx->triggerEvent(WRITE);
-                    --m_pendingEventCount;
-
+					fd_ctx->triggerEvent(WRITE, &batch);
+					triggered++;
 				}
 			}
+			batch.submit();
+			m_pendingEventCount -= triggered;
 			//当前线程的协程主动让出控制权，调度器可以选择执行其他任务或再次进入 idle 状态。
 			Fiber::GetThis()->yield();
 		}
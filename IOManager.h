@@ -1,8 +1,12 @@
 #pragma once 
 #include"Scheduler.h"
 #include"Timer.h"
+#include"IoUring.h"
+#include"FdTable.h"
 #include <unistd.h>    
 #include <sys/epoll.h> 
+#include <sys/eventfd.h>
+#include <sys/socket.h>
 #include <fcntl.h>     
 #include <cstring>
 namespace sylar {
@@ -19,14 +23,37 @@ namespace sylar {
 			WRITE = 0X4//写事件，对应于epoll的EPOLLOUT事件。
 
 		};
+		//反应器后端
+		enum Reactor
+		{
+			EPOLL,//就绪通知：系统调用返回EAGAIN后注册事件，就绪后重试
+			IO_URING//完成通知：hook直接把读写操作提交给io_uring，完成后带着结果恢复协程
+		};
+		//构造选项，按位组合
+		enum Option
+		{
+			//fd第一次等待时以EPOLLIN|EPOLLOUT|EPOLLET注册，之后一直留在epoll中直到cancelAll（hook的close）
+			//边沿到来时只在FdContext中锁存并唤醒等待者，不再每次触发后MOD/DEL
+			PERSISTENT_EVENTS = 0x1,
+			//每个工作线程一个epoll实例和一个eventfd，fd注册在第一次等待它的线程的epoll上
+			//事件就绪后协程被指定回该线程恢复，一个连接的IO始终在同一个线程上处理
+			PER_THREAD_EPOLL = 0x2
+		};
 	private:
 		struct FdContext//用于描述一个文件描述的事件上下文
 		{
 			struct EventContext//描述一个具体事件的上下文，如读事件或写事件。
 			{
 				Scheduler* scheduler = nullptr;//关联调度器
+				int thread = -1;//指定恢复的线程，PER_THREAD_EPOLL模式下是fd所在epoll的线程
 				std::shared_ptr<Fiber> fiber;//关联回调线数（协程）
-				std::function<void()>cb;//关联回调函数
+				Callback cb;//关联回调函数
+
+				//PERSISTENT_EVENTS模式的就绪锁存：edges是收到的边沿数，drained是最近一次EAGAIN之前看到的边沿数
+				//二者不同表示上次EAGAIN之后来过新边沿，fd可能就绪
+				std::atomic<uint32_t> edges = { 0 };
+				std::atomic<uint32_t> drained = { (uint32_t)-1 };
+				bool isReady() const { return edges.load(std::memory_order_acquire) != drained.load(std::memory_order_acquire); }
 			};
 
 			EventContext read;
@@ -35,30 +62,69 @@ namespace sylar {
 			int fd = 0;
 
 			Event events = NONE;//当前注册的事件目前是没有事件，但可能变成 READ、WRITE 或二者的组合。
+			bool persistent = false;//已按PERSISTENT_EVENTS常驻注册在epoll中
+			std::atomic<bool> polled = { false };//hook的poll/select在这个fd上注册过事件
+			int poller = -1;//注册所在的Poller下标，没有注册时为-1
 			std::mutex mutex;
 			EventContext& getEventContext(Event event);//根据时间类型获取相应的事件上下文
 			void resetEventContext(EventContext& ctx);//重置事件上下文
-			void triggerEvent(Event event);//触发事件
+			//触发事件；batch不为空且等待者属于同一个调度器时放入batch，由调用者统一提交
+			void triggerEvent(Event event, Scheduler::TaskBatch* batch = nullptr);
 
 		};
 	public:
-		//threads线程数量，use_caller是否讲主线程或调度线程包含进行，name调度器的名字
-		IOManager(size_t threads = 1, bool use_caller = true, const std::string& name = "IOManager");//允许设置线程数，是否使用调用者线程和名称
+		//threads线程数量，use_caller是否讲主线程或调度线程包含进行，name调度器的名字，timer_backend定时器存储后端
+		//reactor为IO_URING但内核不支持时回退到EPOLL，options为Option的组合
+		IOManager(size_t threads = 1, bool use_caller = true, const std::string& name = "IOManager",
+			TimerManager::Backend timer_backend = TimerManager::RBTREE, Reactor reactor = EPOLL, int options = 0);//允许设置线程数，是否使用调用者线程和名称
 		~IOManager();
 		//时间管理方法
-		int addEvent(int fd, Event event, std::function<void()>cb = nullptr);//添加一个事件到文件描述符fd上，关联一个回调函数cb
+		int addEvent(int fd, Event event, Callback cb = nullptr);//添加一个事件到文件描述符fd上，关联一个回调函数cb
 
 		bool delEvent(int fd, Event event);//删除文件描述符的某个事件
 
 		bool cancelEvent(int fd, Event event);//取消文件描述符的某个事件，触发回调函数
 
 		bool cancelAll(int fd);
+		//hook的poll/select等待的fd可能没有FdCtx，注册事件时用markPolled标记
+		//hook的close对没有FdCtx的fd调用cancelPolled，只有标记过的fd才执行cancelAll，清理常驻注册
+		void markPolled(int fd);
+		bool cancelPolled(int fd);
+
+		//PERSISTENT_EVENTS模式下，常驻注册的fd的addEvent在上次EAGAIN之后已经来过边沿时立即触发
+		//hook在系统调用前用isReady检查锁存的就绪状态，返回EAGAIN后用setDrained标记
+		bool persistentEvents() const { return m_options & PERSISTENT_EVENTS; }
+		//fd可能就绪返回true，seq返回当前边沿数；未常驻注册的fd状态未知，总是返回true
+		bool isReady(int fd, Event event, uint32_t& seq);
+		//系统调用返回EAGAIN后调用，seq为调用前isReady给出的边沿数
+		void setDrained(int fd, Event event, uint32_t seq);
+
+		//实际使用的反应器后端
+		Reactor getReactor() const { return m_uring ? IO_URING : EPOLL; }
+		//io_uring后端：提交sqe（user_data由这里填写）并挂起当前协程，完成后把结果（失败为-errno）写入res
+		//timeout_ms为(uint64_t)-1表示不超时，超时res为-ETIMEDOUT
+		//提交失败（未使用io_uring或队列满）返回false，调用者应走epoll路径
+		bool submitIo(const io_uring_sqe& sqe, uint64_t timeout_ms, int& res);
+		//io_uring后端能否处理常规文件的读写和open（IORING_FEAT_RW_CUR_POS，5.6起），不能时文件IO走FileIoPool
+		bool uringFileIo() const { return m_uring && (m_uring->getFeatures() & IORING_FEAT_RW_CUR_POS); }
+
+		//创建一个绑定到addr并开始监听的SO_REUSEPORT非阻塞socket，失败返回-1
+		static int CreateReusePortListener(const sockaddr* addr, socklen_t addrlen, int backlog);
+		//为每个工作线程（使用调用线程时不含它，除非只有它一个）创建一个SO_REUSEPORT监听socket，
+		//并在该线程上运行cb(listen_fd)；内核按连接的四元组哈希把新连接分给各个监听socket
+		//PER_THREAD_EPOLL模式下accept和它所在协程之后的读写都留在这个线程上，cb处理新连接时
+		//可用ScheduleLock(f, Thread::GetThreadId())把连接协程也固定在本线程
+		//返回创建的监听socket数，失败返回-1并关闭已创建的socket
+		int listenReusePort(const sockaddr* addr, socklen_t addrlen, int backlog, std::function<void(int)> cb);
 
 		static IOManager* GetThis();
 	protected:
 		//通知调度器有任务调度
-		//写pipe让idle协程从epoll_wait退出，待idle协程yield后Scheduler：：run就可以调度其他任务
+		//写eventfd让一个idle协程从epoll_wait退出，待idle协程yield后Scheduler：：run就可以调度其他任务
+		//被唤醒的线程读取eventfd之前，重复的tickle只置标志不再写eventfd
 		void tickle() override;
+		//PER_THREAD_EPOLL模式下直接唤醒该线程的epoll_wait；共享模式下该线程空闲时用SIGURG打断它的epoll_pwait
+		void tickleThread(int thread) override;
 		//判断调度器是否可以停止
 		//判断条件是Scheduler::stopping()外加IOManager的m_pendingEventcount为0，表示没有IO事件可调度
 		bool stopping() override;
@@ -66,16 +132,45 @@ namespace sylar {
 		//真正执行是idle协程推出后，调度器在下一轮调度时执行
 		void idle()override;//这里是scheduler的重写，当没有事件处理，线程处于空闲
 		void onTimerInsertedAtFront()override;//因为Timer类成员函数重写当有新的定时器插入到前面的处理逻辑
-		void contextResize(size_t size);//调整文件描述符上下文数组大小
 	private:
-		int m_epfd = 0;//用于epoll的文件描述符
-		int m_tickleFds[2];//线程间通信的管道文件描述符，0是读，1是写
+		//处理一个io_uring完成事件
+		void completeIo(uint64_t user_data, int res);
+		//查找fd的上下文，不存在返回nullptr，只有两次load
+		FdContext* getContext(int fd);
+		//PERSISTENT_EVENTS模式的addEvent，调用时持有fd_ctx->mutex
+		int addPersistentEvent(FdContext* fd_ctx, Event event, Callback& cb);
+
+		//一个epoll实例及其唤醒通道
+		struct Poller
+		{
+			int epfd = -1;//用于epoll的文件描述符
+			//线程间通知用的eventfd，以边缘触发注册在epoll中，每次写入只唤醒一个epoll_wait中的线程
+			int tickleFd = -1;
+			//已写入eventfd但还没有被idle线程读走，期间的tickle合并为一次
+			std::atomic<bool> wakePending = { false };
+			//所属线程正在（或即将）阻塞在epoll_wait中，PER_THREAD_EPOLL模式下tickle据此挑选线程
+			std::atomic<bool> waiting = { false };
+		};
+		//给还没有注册的fd选择Poller：共享模式只有一个；按线程模式优先当前工作线程，
+		//其他线程（如构造IOManager的线程）调用时按fd分散到会运行调度的工作线程
+		int selectPoller(int fd);
+		//fd_ctx已注册所在的epoll，调用时持有fd_ctx->mutex
+		int getEpfd(FdContext* fd_ctx) const { return m_pollers[fd_ctx->poller]->epfd; }
+		//写eventfd唤醒一个Poller，上一次唤醒还没有被消费时不再写
+		bool wakePoller(Poller* poller);
+	private:
+		//共享模式一个Poller，所有线程等待在同一个epoll上；PER_THREAD_EPOLL模式下标与工作线程下标一致
+		std::vector<std::unique_ptr<Poller>> m_pollers;
+		//PER_THREAD_EPOLL模式下tickle轮询的起点
+		std::atomic<size_t> m_nextTickle = { 0 };
+		//io_uring后端，为空表示使用epoll；ring的fd以边缘触发注册在每个epoll中
+		std::unique_ptr<IoUring> m_uring;
+		int m_options = 0;
 
 		//原子计数器，用于记录待处理的事件数量。
 		// 使用atomic的好处是这个变量再进行加或-都是不会被多线程影响
 		std::atomic<size_t>m_pendingEventCount = { 0 };
-		std::shared_mutex m_mutex;//读写锁
-
-		std::vector<FdContext*>m_fdContexts;//文件描述符上下文组数，用于存储描述符的FdContext
+		//文件描述符上下文表，按fd分段存放FdContext，查找不加锁
+		FdTable<FdContext> m_fdContexts;
 	};
 }
\ No newline at end of file
@@ -0,0 +1,201 @@
+#ifndef _INLINE_FUNCTION_H_
+#define _INLINE_FUNCTION_H_
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/*
+只能移动的可调用对象，调度任务、协程入口、定时器和IO事件回调都用它代替std::function
+可调用对象不超过Capacity字节（默认64，够放一个shared_ptr加上若干个指针和整数）且移动不抛异常时
+直接构造在内部缓冲区中，不分配内存；更大的才放到堆上
+std::function只有16字节的内部缓冲区，捕获一个shared_ptr再加几个整数的lambda就要分配内存，
+而且它要求可拷贝，在队列、协程和定时器之间传递时容易不经意地拷贝一份
+只能移动也意味着它可以持有std::unique_ptr之类只能移动的捕获
+空的std::function和空指针构造出来的对象也是空的，与std::function的行为一致
+*/
+
+namespace sylar {
+
+	template<class Signature, size_t Capacity = 64>
+	class InlineFunction;
+
+	template<class R, class... Args, size_t Capacity>
+	class InlineFunction<R(Args...), Capacity>
+	{
+	public:
+		InlineFunction() noexcept {}
+		InlineFunction(std::nullptr_t) noexcept {}
+
+		template<class F, class = typename std::enable_if<
+			!std::is_same<typename std::decay<F>::type, InlineFunction>::value
+			&& std::is_invocable_r<R, typename std::decay<F>::type&, Args...>::value>::type>
+		InlineFunction(F&& f)
+		{
+			typedef typename std::decay<F>::type Functor;
+			if (isEmpty(f))
+			{
+				return;
+			}
+			if constexpr (FitsInline<Functor>::value)
+			{
+				new (m_storage) Functor(std::forward<F>(f));
+				m_ops = &InlineOps<Functor>::ops;
+			}
+			else
+			{
+				*reinterpret_cast<Functor**>(m_storage) = new Functor(std::forward<F>(f));
+				m_ops = &HeapOps<Functor>::ops;
+			}
+		}
+
+		InlineFunction(InlineFunction&& other) noexcept
+		{
+			moveFrom(other);
+		}
+		InlineFunction& operator=(InlineFunction&& other) noexcept
+		{
+			if (this != &other)
+			{
+				reset();
+				moveFrom(other);
+			}
+			return *this;
+		}
+		InlineFunction& operator=(std::nullptr_t) noexcept
+		{
+			reset();
+			return *this;
+		}
+		template<class F, class = typename std::enable_if<
+			!std::is_same<typename std::decay<F>::type, InlineFunction>::value
+			&& std::is_invocable_r<R, typename std::decay<F>::type&, Args...>::value>::type>
+		InlineFunction& operator=(F&& f)
+		{
+			return *this = InlineFunction(std::forward<F>(f));
+		}
+		InlineFunction(const InlineFunction&) = delete;
+		InlineFunction& operator=(const InlineFunction&) = delete;
+
+		~InlineFunction()
+		{
+			reset();
+		}
+
+		void swap(InlineFunction& other) noexcept
+		{
+			InlineFunction tmp(std::move(other));
+			other = std::move(*this);
+			*this = std::move(tmp);
+		}
+
+		explicit operator bool() const noexcept { return m_ops != nullptr; }
+
+		//与std::function相同，const对象也可以调用，被调用的对象本身可以修改自己的状态
+		R operator()(Args... args) const
+		{
+			if (!m_ops)
+			{
+				throw std::bad_function_call();
+			}
+			return m_ops->invoke(m_storage, std::forward<Args>(args)...);
+		}
+
+		friend bool operator==(const InlineFunction& f, std::nullptr_t) noexcept { return !f; }
+		friend bool operator==(std::nullptr_t, const InlineFunction& f) noexcept { return !f; }
+		friend bool operator!=(const InlineFunction& f, std::nullptr_t) noexcept { return (bool)f; }
+		friend bool operator!=(std::nullptr_t, const InlineFunction& f) noexcept { return (bool)f; }
+
+	private:
+		//每种被保存的类型一张操作表，对象本身只多一个指针
+		struct Ops
+		{
+			R(*invoke)(void* storage, Args&&... args);
+			//把storage中的对象移动到dst并析构原对象
+			void (*relocate)(void* dst, void* src) noexcept;
+			void (*destroy)(void* storage) noexcept;
+		};
+
+		template<class Functor>
+		struct FitsInline : std::integral_constant<bool,
+			sizeof(Functor) <= Capacity && alignof(std::max_align_t) % alignof(Functor) == 0
+			&& std::is_nothrow_move_constructible<Functor>::value> {};
+
+		template<class Functor>
+		struct InlineOps
+		{
+			static R invoke(void* storage, Args&&... args)
+			{
+				return std::invoke(*static_cast<Functor*>(storage), std::forward<Args>(args)...);
+			}
+			static void relocate(void* dst, void* src) noexcept
+			{
+				Functor* f = static_cast<Functor*>(src);
+				new (dst) Functor(std::move(*f));
+				f->~Functor();
+			}
+			static void destroy(void* storage) noexcept
+			{
+				static_cast<Functor*>(storage)->~Functor();
+			}
+			static constexpr Ops ops = { &invoke, &relocate, &destroy };
+		};
+
+		//放不下时缓冲区里只存指针，移动只是拷贝指针
+		template<class Functor>
+		struct HeapOps
+		{
+			static R invoke(void* storage, Args&&... args)
+			{
+				return std::invoke(**static_cast<Functor**>(storage), std::forward<Args>(args)...);
+			}
+			static void relocate(void* dst, void* src) noexcept
+			{
+				*static_cast<Functor**>(dst) = *static_cast<Functor**>(src);
+			}
+			static void destroy(void* storage) noexcept
+			{
+				delete *static_cast<Functor**>(storage);
+			}
+			static constexpr Ops ops = { &invoke, &relocate, &destroy };
+		};
+
+		template<class F>
+		static bool isEmpty(const F&) { return false; }
+		template<class S>
+		static bool isEmpty(const std::function<S>& f) { return !f; }
+		template<class T>
+		static bool isEmpty(T* p) { return !p; }
+		template<class T, class C>
+		static bool isEmpty(T C::* p) { return !p; }
+
+		void moveFrom(InlineFunction& other) noexcept
+		{
+			if (other.m_ops)
+			{
+				other.m_ops->relocate(m_storage, other.m_storage);
+				m_ops = other.m_ops;
+				other.m_ops = nullptr;
+			}
+		}
+		void reset() noexcept
+		{
+			if (m_ops)
+			{
+				const Ops* ops = m_ops;
+				m_ops = nullptr;
+				ops->destroy(m_storage);
+			}
+		}
+
+		alignas(std::max_align_t) mutable unsigned char m_storage[Capacity];
+		const Ops* m_ops = nullptr;
+	};
+
+	//调度器、协程、定时器和IO事件使用的回调类型
+	typedef InlineFunction<void()> Callback;
+}
+
+#endif
@@ -0,0 +1,194 @@
+#include "IoUring.h"
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+
+namespace sylar {
+
+	static int sys_io_uring_setup(unsigned entries, io_uring_params* p)
+	{
+		return (int)syscall(__NR_io_uring_setup, entries, p);
+	}
+
+	static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+	{
+		return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+	}
+
+	IoUring::IoUring()
+	{
+	}
+
+	IoUring::~IoUring()
+	{
+		if (m_sqes)
+		{
+			munmap(m_sqes, m_sqesSize);
+		}
+		if (m_cqRing && m_cqRing != m_sqRing)
+		{
+			munmap(m_cqRing, m_cqRingSize);
+		}
+		if (m_sqRing)
+		{
+			munmap(m_sqRing, m_sqRingSize);
+		}
+		if (m_fd >= 0)
+		{
+			::close(m_fd);
+		}
+	}
+
+	bool IoUring::init(unsigned entries)
+	{
+		io_uring_params params;
+		memset(&params, 0, sizeof(params));
+		params.flags = IORING_SETUP_CLAMP;
+		m_fd = sys_io_uring_setup(entries, &params);
+		if (m_fd < 0)
+		{
+			m_fd = -1;
+			return false;
+		}
+
+		m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		m_features = params.features;
+		bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+		if (single_mmap)
+		{
+			m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+		}
+
+		m_sqRing = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+		if (m_sqRing == MAP_FAILED)
+		{
+			m_sqRing = nullptr;
+			return false;
+		}
+		if (single_mmap)
+		{
+			m_cqRing = m_sqRing;
+		}
+		else
+		{
+			m_cqRing = mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+			if (m_cqRing == MAP_FAILED)
+			{
+				m_cqRing = nullptr;
+				return false;
+			}
+		}
+		m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+		m_sqes = (io_uring_sqe*)mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+		if (m_sqes == MAP_FAILED)
+		{
+			m_sqes = nullptr;
+			return false;
+		}
+
+		char* sq = (char*)m_sqRing;
+		m_sqHead = (unsigned*)(sq + params.sq_off.head);
+		m_sqTail = (unsigned*)(sq + params.sq_off.tail);
+		m_sqMask = (unsigned*)(sq + params.sq_off.ring_mask);
+		m_sqEntries = (unsigned*)(sq + params.sq_off.ring_entries);
+		m_sqFlags = (unsigned*)(sq + params.sq_off.flags);
+		m_sqArray = (unsigned*)(sq + params.sq_off.array);
+
+		char* cq = (char*)m_cqRing;
+		m_cqHead = (unsigned*)(cq + params.cq_off.head);
+		m_cqTail = (unsigned*)(cq + params.cq_off.tail);
+		m_cqMask = (unsigned*)(cq + params.cq_off.ring_mask);
+		m_cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+		return true;
+	}
+
+	int IoUring::submit(const io_uring_sqe* sqes, unsigned count)
+	{
+		std::lock_guard<std::mutex> lock(m_sqMutex);
+		unsigned head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+		unsigned tail = *m_sqTail;//只有持锁的提交者会写tail
+		if (tail - head + count > *m_sqEntries)
+		{
+			return -EBUSY;
+		}
+		for (unsigned i = 0; i < count; i++)
+		{
+			unsigned index = (tail + i) & *m_sqMask;
+			m_sqes[index] = sqes[i];
+			m_sqArray[index] = index;
+		}
+		__atomic_store_n(m_sqTail, tail + count, __ATOMIC_RELEASE);
+
+		//没有SQPOLL时内核只在io_uring_enter里读取tail，失败时可以把tail退回去
+		int rt;
+		do
+		{
+			rt = sys_io_uring_enter(m_fd, count, 0, 0);
+		} while (rt < 0 && errno == EINTR);
+		if (rt < 0)
+		{
+			int err = errno;
+			__atomic_store_n(m_sqTail, tail, __ATOMIC_RELEASE);
+			return -err;
+		}
+		//链接的请求总是一起被取走，这里只可能是全部提交
+		return 0;
+	}
+
+	int IoUring::reap(const std::function<void(uint64_t, int)>& cb)
+	{
+		std::lock_guard<std::mutex> lock(m_cqMutex);
+		int count = 0;
+		while (true)
+		{
+			unsigned head = *m_cqHead;
+			unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+			while (head != tail)
+			{
+				io_uring_cqe& cqe = m_cqes[head & *m_cqMask];
+				cb(cqe.user_data, cqe.res);
+				head++;
+				count++;
+			}
+			__atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+
+			//完成队列曾经满过，积压在内核里的完成事件需要进一次内核才会刷进来
+			if (!(__atomic_load_n(m_sqFlags, __ATOMIC_ACQUIRE) & IORING_SQ_CQ_OVERFLOW))
+			{
+				break;
+			}
+			sys_io_uring_enter(m_fd, 0, 0, IORING_ENTER_GETEVENTS);
+		}
+		return count;
+	}
+
+	int IoUring::submitAndWait(const io_uring_sqe& sqe)
+	{
+		int rt = submit(&sqe, 1);
+		if (rt < 0)
+		{
+			return rt;
+		}
+		int res = 0;
+		while (!reap([&res](uint64_t, int r) { res = r; }))
+		{
+			sys_io_uring_enter(m_fd, 0, 1, IORING_ENTER_GETEVENTS);
+		}
+		return res;
+	}
+
+	void IoUring::PrepRw(io_uring_sqe& sqe, int op, int fd, const void* addr, unsigned len, uint64_t off)
+	{
+		memset(&sqe, 0, sizeof(sqe));
+		sqe.opcode = (uint8_t)op;
+		sqe.fd = fd;
+		sqe.off = off;
+		sqe.addr = (uint64_t)(uintptr_t)addr;
+		sqe.len = len;
+	}
+}
@@ -0,0 +1,68 @@
+#ifndef _IO_URING_H_
+#define _IO_URING_H_
+
+#include <linux/io_uring.h>
+#include <functional>
+#include <mutex>
+#include <cstdint>
+
+/*
+io_uring的最小封装，直接使用io_uring_setup/io_uring_enter系统调用，不依赖liburing
+一个实例被IOManager的所有线程共享：提交队列和完成队列各由一把互斥锁保护
+不使用SQPOLL，提交时立即调用io_uring_enter；ring的fd注册在epoll中，有完成事件时可读
+*/
+
+namespace sylar {
+
+	class IoUring
+	{
+	public:
+		IoUring();
+		~IoUring();
+
+		//创建ring，失败（内核不支持或被禁用）返回false
+		bool init(unsigned entries);
+		int getFd() const { return m_fd; }
+		//io_uring_setup返回的IORING_FEAT_*
+		uint32_t getFeatures() const { return m_features; }
+
+		//把count个已填好的sqe拷贝进提交队列并提交，成功返回0，失败返回-errno且一个都没有提交
+		int submit(const io_uring_sqe* sqes, unsigned count);
+		//取出所有完成事件，对每个调用cb(user_data, res)，返回处理的个数
+		int reap(const std::function<void(uint64_t, int)>& cb);
+		//提交一个sqe并等待它完成，返回完成事件的res，提交失败返回-errno
+		//只在ring上没有其他操作时使用（初始化时探测内核特性），否则会取走别人的完成事件
+		int submitAndWait(const io_uring_sqe& sqe);
+
+		//填写一个读写类sqe
+		static void PrepRw(io_uring_sqe& sqe, int op, int fd, const void* addr, unsigned len, uint64_t off);
+
+	private:
+		int m_fd = -1;
+		uint32_t m_features = 0;
+
+		//提交队列
+		std::mutex m_sqMutex;
+		void* m_sqRing = nullptr;
+		size_t m_sqRingSize = 0;
+		unsigned* m_sqHead = nullptr;
+		unsigned* m_sqTail = nullptr;
+		unsigned* m_sqMask = nullptr;
+		unsigned* m_sqEntries = nullptr;
+		unsigned* m_sqFlags = nullptr;
+		unsigned* m_sqArray = nullptr;
+		io_uring_sqe* m_sqes = nullptr;
+		size_t m_sqesSize = 0;
+
+		//完成队列，和提交队列共用一次mmap时m_cqRing等于m_sqRing
+		std::mutex m_cqMutex;
+		void* m_cqRing = nullptr;
+		size_t m_cqRingSize = 0;
+		unsigned* m_cqHead = nullptr;
+		unsigned* m_cqTail = nullptr;
+		unsigned* m_cqMask = nullptr;
+		io_uring_cqe* m_cqes = nullptr;
+	};
+}
+
+#endif
@@ -0,0 +1,872 @@
+#include "Resolver.h"
+#include "UdpSocket.h"
+#include "FileIoPool.h"
+#include "IOManager.h"
+#include "Hook.h"
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <sstream>
+
+namespace sylar {
+
+	static const uint16_t DNS_PORT = 53;
+	static const uint16_t TYPE_A = 1;
+	static const uint16_t TYPE_CNAME = 5;
+	static const uint16_t TYPE_SOA = 6;
+	static const uint16_t TYPE_AAAA = 28;
+	static const uint16_t TYPE_OPT = 41;
+	static const uint16_t CLASS_IN = 1;
+	static const uint16_t RCODE_NXDOMAIN = 3;
+	//EDNS0通告的UDP报文大小，超过时服务器置TC位
+	static const uint16_t EDNS_PAYLOAD = 1232;
+	static const size_t MAX_SERVERS = 3;
+	//每秒最多stat一次hosts文件和resolv.conf
+	static const uint64_t RELOAD_INTERVAL_MS = 1000;
+
+	static inline uint64_t now_ms()
+	{
+		return std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	static std::string to_lower(const std::string& s)
+	{
+		std::string r(s);
+		for (char& c : r)
+		{
+			if (c >= 'A' && c <= 'Z')
+			{
+				c = c - 'A' + 'a';
+			}
+		}
+		return r;
+	}
+
+	//文件不存在返回0，和“从未加载”的-1区分开
+	static int64_t file_mtime(const std::string& path)
+	{
+		struct stat st;
+		if (::stat(path.c_str(), &st) != 0)
+		{
+			return 0;
+		}
+		return (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+	}
+
+	static bool parse_addr(const std::string& s, uint16_t port, sockaddr_storage& addr)
+	{
+		memset(&addr, 0, sizeof(addr));
+		sockaddr_in* in = (sockaddr_in*)&addr;
+		if (inet_pton(AF_INET, s.c_str(), &in->sin_addr) == 1)
+		{
+			in->sin_family = AF_INET;
+			in->sin_port = htons(port);
+			return true;
+		}
+		sockaddr_in6* in6 = (sockaddr_in6*)&addr;
+		if (inet_pton(AF_INET6, s.c_str(), &in6->sin6_addr) == 1)
+		{
+			in6->sin6_family = AF_INET6;
+			in6->sin6_port = htons(port);
+			return true;
+		}
+		return false;
+	}
+
+	//名字总长不超过253，每个标签1~63个字符
+	static bool valid_name(const std::string& name)
+	{
+		size_t len = name.size();
+		if (len > 0 && name[len - 1] == '.')
+		{
+			len--;
+		}
+		if (len == 0 || len > 253)
+		{
+			return false;
+		}
+		size_t label = 0;
+		for (size_t i = 0; i < len; i++)
+		{
+			if (name[i] == '.')
+			{
+				if (label == 0)
+				{
+					return false;
+				}
+				label = 0;
+			}
+			else if (++label > 63)
+			{
+				return false;
+			}
+		}
+		return label > 0;
+	}
+
+	static void put16(std::vector<uint8_t>& out, uint16_t v)
+	{
+		out.push_back(v >> 8);
+		out.push_back(v & 0xff);
+	}
+
+	static uint16_t get16(const uint8_t* p)
+	{
+		return (uint16_t)(p[0] << 8 | p[1]);
+	}
+
+	static uint32_t get32(const uint8_t* p)
+	{
+		return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+	}
+
+	//一个问题的查询报文，带EDNS0的OPT记录
+	static void build_query(const std::string& fqdn, uint16_t id, uint16_t qtype, std::vector<uint8_t>& out)
+	{
+		out.clear();
+		put16(out, id);
+		put16(out, 0x0100);//RD
+		put16(out, 1);//QDCOUNT
+		put16(out, 0);
+		put16(out, 0);
+		put16(out, 1);//ARCOUNT
+		size_t start = 0;
+		while (start < fqdn.size())
+		{
+			size_t dot = fqdn.find('.', start);
+			if (dot == std::string::npos)
+			{
+				dot = fqdn.size();
+			}
+			out.push_back((uint8_t)(dot - start));
+			out.insert(out.end(), fqdn.begin() + start, fqdn.begin() + dot);
+			start = dot + 1;
+		}
+		out.push_back(0);
+		put16(out, qtype);
+		put16(out, CLASS_IN);
+		//OPT：根名字、类型、UDP报文大小、扩展RCODE和标志、RDLEN
+		out.push_back(0);
+		put16(out, TYPE_OPT);
+		put16(out, EDNS_PAYLOAD);
+		put16(out, 0);
+		put16(out, 0);
+		put16(out, 0);
+	}
+
+	//跳过一个可能带压缩指针的名字
+	static bool skip_name(const uint8_t* p, size_t len, size_t& off)
+	{
+		while (off < len)
+		{
+			uint8_t c = p[off];
+			if (c == 0)
+			{
+				off++;
+				return true;
+			}
+			if ((c & 0xc0) == 0xc0)
+			{
+				off += 2;
+				return off <= len;
+			}
+			if (c & 0xc0)
+			{
+				return false;
+			}
+			off += c + 1;
+		}
+		return false;
+	}
+
+	struct DnsResponse
+	{
+		uint16_t qtype = 0;
+		int rcode = 0;
+		bool truncated = false;
+		std::vector<sockaddr_storage> addrs;
+		uint32_t ttl = UINT32_MAX;//地址和CNAME记录的最小TTL
+		uint32_t negativeTtl = 0;//SOA的TTL和MINIMUM字段取小，没有SOA为0
+	};
+
+	//解析id对应的应答，报文不完整或者不是这个查询的应答返回false
+	static bool parse_response(const uint8_t* p, size_t len, uint16_t id, DnsResponse& resp)
+	{
+		if (len < 12 || get16(p) != id)
+		{
+			return false;
+		}
+		uint16_t flags = get16(p + 2);
+		if (!(flags & 0x8000) || get16(p + 4) != 1)
+		{
+			return false;
+		}
+		resp.truncated = flags & 0x0200;
+		resp.rcode = flags & 0x0f;
+		uint16_t ancount = get16(p + 6);
+		uint16_t nscount = get16(p + 8);
+
+		size_t off = 12;
+		if (!skip_name(p, len, off) || off + 4 > len)
+		{
+			return false;
+		}
+		resp.qtype = get16(p + off);
+		off += 4;
+
+		for (int i = 0; i < ancount + nscount; i++)
+		{
+			if (!skip_name(p, len, off) || off + 10 > len)
+			{
+				//截断的应答后面的记录可能不完整
+				return resp.truncated;
+			}
+			uint16_t type = get16(p + off);
+			uint16_t cls = get16(p + off + 2);
+			uint32_t ttl = get32(p + off + 4);
+			uint16_t rdlen = get16(p + off + 8);
+			off += 10;
+			if (off + rdlen > len)
+			{
+				return resp.truncated;
+			}
+			const uint8_t* rdata = p + off;
+			off += rdlen;
+			if (cls != CLASS_IN)
+			{
+				continue;
+			}
+			if (i < ancount)
+			{
+				sockaddr_storage addr;
+				memset(&addr, 0, sizeof(addr));
+				if (type == TYPE_A && rdlen == 4 && resp.qtype == TYPE_A)
+				{
+					sockaddr_in* in = (sockaddr_in*)&addr;
+					in->sin_family = AF_INET;
+					memcpy(&in->sin_addr, rdata, 4);
+				}
+				else if (type == TYPE_AAAA && rdlen == 16 && resp.qtype == TYPE_AAAA)
+				{
+					sockaddr_in6* in6 = (sockaddr_in6*)&addr;
+					in6->sin6_family = AF_INET6;
+					memcpy(&in6->sin6_addr, rdata, 16);
+				}
+				else if (type != TYPE_CNAME)
+				{
+					continue;
+				}
+				resp.ttl = std::min(resp.ttl, ttl);
+				if (addr.ss_family != AF_UNSPEC)
+				{
+					resp.addrs.push_back(addr);
+				}
+			}
+			else if (type == TYPE_SOA && rdlen >= 20)
+			{
+				//RFC 2308：否定应答的缓存时间取SOA记录的TTL和MINIMUM字段中较小的
+				resp.negativeTtl = std::min(ttl, get32(rdata + rdlen - 4));
+			}
+		}
+		return true;
+	}
+
+	Resolver* Resolver::GetInstance()
+	{
+		static Resolver* s_resolver = new Resolver();
+		return s_resolver;
+	}
+
+	void Resolver::reloadHosts()
+	{
+		std::string path;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			uint64_t now = now_ms();
+			if (m_hostsMtime != -1 && now < m_hostsChecked + RELOAD_INTERVAL_MS)
+			{
+				return;
+			}
+			m_hostsChecked = now;
+			path = m_hostsPath;
+		}
+		int64_t mtime = file_mtime(path);
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (mtime == m_hostsMtime && path == m_hostsPath)
+			{
+				return;
+			}
+		}
+
+		//在锁外读文件，读完再替换
+		std::unordered_map<std::string, std::vector<sockaddr_storage>> hosts;
+		std::ifstream in(path);
+		std::string line;
+		while (std::getline(in, line))
+		{
+			size_t hash = line.find('#');
+			if (hash != std::string::npos)
+			{
+				line.resize(hash);
+			}
+			std::istringstream ss(line);
+			std::string ip, name;
+			sockaddr_storage addr;
+			if (!(ss >> ip) || !parse_addr(ip, 0, addr))
+			{
+				continue;
+			}
+			while (ss >> name)
+			{
+				hosts[to_lower(name)].push_back(addr);
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (path == m_hostsPath)
+		{
+			m_hosts.swap(hosts);
+			m_hostsMtime = mtime;
+		}
+	}
+
+	bool Resolver::lookupHosts(const std::string& name, int family, std::vector<sockaddr_storage>& addrs)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto it = m_hosts.find(name);
+		if (it == m_hosts.end())
+		{
+			return false;
+		}
+		addrs.clear();
+		//AF_UNSPEC时IPv4在前，与DNS查询的顺序一致
+		for (int f : { AF_INET, AF_INET6 })
+		{
+			if (family != AF_UNSPEC && family != f)
+			{
+				continue;
+			}
+			for (auto& addr : it->second)
+			{
+				//同一个地址可能在文件中出现多次
+				if (addr.ss_family == f && std::none_of(addrs.begin(), addrs.end(),
+					[&](const sockaddr_storage& a) { return memcmp(&a, &addr, sizeof(addr)) == 0; }))
+				{
+					addrs.push_back(addr);
+				}
+			}
+		}
+		if (addrs.empty())
+		{
+			return false;
+		}
+		m_stats.hostsHits++;
+		return true;
+	}
+
+	void Resolver::reloadConfig()
+	{
+		std::string path;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			path = m_configPath;
+			uint64_t now = now_ms();
+			if (m_configMtime != -1 && now < m_configChecked + RELOAD_INTERVAL_MS)
+			{
+				return;
+			}
+			m_configChecked = now;
+		}
+		int64_t mtime = file_mtime(path);
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (mtime == m_configMtime)
+			{
+				return;
+			}
+		}
+
+		Config config;
+		std::ifstream in(path);
+		std::string line;
+		while (std::getline(in, line))
+		{
+			size_t comment = line.find_first_of("#;");
+			if (comment != std::string::npos)
+			{
+				line.resize(comment);
+			}
+			std::istringstream ss(line);
+			std::string key, value;
+			if (!(ss >> key))
+			{
+				continue;
+			}
+			sockaddr_storage addr;
+			if (key == "nameserver" && ss >> value && config.servers.size() < MAX_SERVERS
+				&& parse_addr(value, DNS_PORT, addr))
+			{
+				config.servers.push_back(addr);
+			}
+			else if (key == "search" || key == "domain")
+			{
+				//两者同时出现时以最后一个为准
+				config.search.clear();
+				while (ss >> value)
+				{
+					config.search.push_back(value);
+				}
+			}
+			else if (key == "options")
+			{
+				while (ss >> value)
+				{
+					if (value.compare(0, 6, "ndots:") == 0)
+					{
+						config.ndots = std::min(atoi(value.c_str() + 6), 15);
+					}
+					else if (value.compare(0, 8, "timeout:") == 0)
+					{
+						config.timeoutMs = std::max(atoi(value.c_str() + 8), 1) * 1000ULL;
+					}
+					else if (value.compare(0, 9, "attempts:") == 0)
+					{
+						config.attempts = std::max(std::min(atoi(value.c_str() + 9), 5), 1);
+					}
+				}
+			}
+		}
+		//与glibc一样，没有配置服务器时使用本机
+		if (config.servers.empty())
+		{
+			sockaddr_storage addr;
+			parse_addr("127.0.0.1", DNS_PORT, addr);
+			config.servers.push_back(addr);
+		}
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_config = std::move(config);
+		m_configMtime = mtime;
+	}
+
+	int Resolver::resolve(const std::string& name, int family, std::vector<sockaddr_storage>& addrs)
+	{
+		addrs.clear();
+		if (family != AF_UNSPEC && family != AF_INET && family != AF_INET6)
+		{
+			return EAI_FAMILY;
+		}
+		if (!valid_name(name))
+		{
+			return EAI_NONAME;
+		}
+		std::string lower = to_lower(name);
+		std::string host = lower.back() == '.' ? lower.substr(0, lower.size() - 1) : lower;
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stats.lookups++;
+		}
+		reloadHosts();
+		if (lookupHosts(host, family, addrs))
+		{
+			return 0;
+		}
+
+		std::string key = std::to_string(family) + "/" + lower;
+		std::unique_lock<std::mutex> lock(m_mutex);
+		auto it = m_cache.find(key);
+		if (it != m_cache.end())
+		{
+			if (it->second.expire > now_ms())
+			{
+				m_stats.cacheHits++;
+				addrs = it->second.addrs;
+				return it->second.error;
+			}
+			m_cache.erase(it);
+		}
+
+		auto pit = m_pending.find(key);
+		if (pit != m_pending.end())
+		{
+			//同一个名字已经在查询，挂起等结果
+			m_stats.coalesced++;
+			std::shared_ptr<Pending> pending = pit->second;
+			FiberWaiter waiter;
+			pending->waiters.push(&waiter);
+			waiter.wait(lock);
+			addrs = pending->addrs;
+			return pending->error;
+		}
+		std::shared_ptr<Pending> pending = std::make_shared<Pending>();
+		m_pending[key] = pending;
+		lock.unlock();
+
+		//只有在开启hook的调度器协程中，UDP收发才会挂起协程而不是阻塞线程
+		bool suspendable = is_hook_enable() && Fiber::IsInScheduler() && IOManager::GetThis();
+		Answer answer = suspendable ? query(lower, family) : fallback(host, family);
+		if (answer.truncated)
+		{
+			answer = fallback(host, family);
+		}
+
+		lock.lock();
+		uint32_t ttl = std::min(answer.ttl, answer.error ? m_maxNegativeTtl : m_maxTtl);
+		if (ttl > 0 && answer.error != EAI_AGAIN)
+		{
+			if (m_cache.size() >= m_capacity)
+			{
+				uint64_t now = now_ms();
+				for (auto i = m_cache.begin(); i != m_cache.end();)
+				{
+					i = i->second.expire <= now ? m_cache.erase(i) : std::next(i);
+				}
+				if (m_cache.size() >= m_capacity && !m_cache.empty())
+				{
+					m_cache.erase(m_cache.begin());
+				}
+			}
+			if (m_capacity > 0)
+			{
+				CacheEntry& entry = m_cache[key];
+				entry.error = answer.error;
+				entry.addrs = answer.addrs;
+				entry.expire = now_ms() + ttl * 1000ULL;
+			}
+		}
+		pending->done = true;
+		pending->error = answer.error;
+		pending->addrs = answer.addrs;
+		m_pending.erase(key);
+		FiberWaitQueue waiters;
+		std::swap(waiters, pending->waiters);
+		lock.unlock();
+		waiters.wakeAll();
+
+		addrs = std::move(answer.addrs);
+		return answer.error;
+	}
+
+	Resolver::Answer Resolver::query(const std::string& name, int family)
+	{
+		reloadConfig();
+		Config config;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			config = m_config;
+			if (!m_servers.empty())
+			{
+				config.servers = m_servers;
+			}
+			if (m_timeoutMs)
+			{
+				config.timeoutMs = m_timeoutMs;
+			}
+			if (m_attempts)
+			{
+				config.attempts = m_attempts;
+			}
+		}
+
+		//以点结尾的是完整的名字；点数不少于ndots时先试原名字再加search后缀，否则反过来
+		std::vector<std::string> candidates;
+		if (name.back() == '.')
+		{
+			candidates.push_back(name.substr(0, name.size() - 1));
+		}
+		else
+		{
+			int dots = std::count(name.begin(), name.end(), '.');
+			if (dots >= config.ndots)
+			{
+				candidates.push_back(name);
+			}
+			for (auto& domain : config.search)
+			{
+				std::string fqdn = name + "." + domain;
+				if (fqdn.back() == '.')
+				{
+					fqdn.pop_back();
+				}
+				if (valid_name(fqdn))
+				{
+					candidates.push_back(fqdn);
+				}
+			}
+			if (dots < config.ndots)
+			{
+				candidates.push_back(name);
+			}
+		}
+
+		Answer answer;
+		uint32_t negativeTtl = UINT32_MAX;
+		bool nodata = false;
+		for (auto& fqdn : candidates)
+		{
+			answer = queryName(fqdn, family, config);
+			if (answer.error == 0 || answer.error == EAI_AGAIN || answer.truncated)
+			{
+				return answer;
+			}
+			nodata = nodata || answer.error == EAI_NODATA;
+			negativeTtl = std::min(negativeTtl, answer.ttl);
+		}
+		//与glibc一样，有一个候选名字存在（只是没有该类型的地址）就报告EAI_NODATA
+		if (nodata)
+		{
+			answer.error = EAI_NODATA;
+		}
+		answer.ttl = negativeTtl;
+		return answer;
+	}
+
+	Resolver::Answer Resolver::queryName(const std::string& fqdn, int family, const Config& config)
+	{
+		static thread_local std::mt19937 s_rng(std::random_device{}());
+
+		std::vector<uint16_t> types;
+		if (family != AF_INET6)
+		{
+			types.push_back(TYPE_A);
+		}
+		if (family != AF_INET)
+		{
+			types.push_back(TYPE_AAAA);
+		}
+
+		Answer answer;
+		std::vector<uint8_t> packet;
+		uint8_t buf[4096];
+		for (int attempt = 0; attempt < config.attempts; attempt++)
+		{
+			for (auto& server : config.servers)
+			{
+				socklen_t len = server.ss_family == AF_INET ? sizeof(sockaddr_in) : sizeof(sockaddr_in6);
+				UdpSocket sock(server.ss_family);
+				//connect之后只收这个服务器发来的报文
+				if (!sock.isValid() || !sock.connect((const sockaddr*)&server, len))
+				{
+					continue;
+				}
+
+				uint16_t ids[2];
+				DnsResponse resps[2];
+				bool answered[2] = { false, false };
+				size_t remaining = types.size();
+				for (size_t i = 0; i < types.size(); i++)
+				{
+					ids[i] = (uint16_t)s_rng();
+					build_query(fqdn, ids[i], types[i], packet);
+					if (sock.sendTo(packet.data(), packet.size()) < 0)
+					{
+						break;
+					}
+				}
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					m_stats.queries += types.size();
+				}
+
+				uint64_t deadline = now_ms() + config.timeoutMs;
+				while (remaining > 0)
+				{
+					uint64_t now = now_ms();
+					if (now >= deadline)
+					{
+						errno = ETIMEDOUT;
+						break;
+					}
+					sock.setRecvTimeout(deadline - now);
+					ssize_t n = sock.recvFrom(buf, sizeof(buf));
+					if (n < 0)
+					{
+						break;
+					}
+					for (size_t i = 0; i < types.size(); i++)
+					{
+						if (!answered[i] && parse_response(buf, n, ids[i], resps[i]) && resps[i].qtype == types[i])
+						{
+							answered[i] = true;
+							remaining--;
+							break;
+						}
+					}
+				}
+				if (remaining > 0)
+				{
+					//超时或者ICMP端口不可达，换下一个服务器
+					if (errno == ETIMEDOUT)
+					{
+						std::lock_guard<std::mutex> lock(m_mutex);
+						m_stats.timeouts++;
+					}
+					continue;
+				}
+
+				bool failed = false;
+				bool nxdomain = false;
+				answer.addrs.clear();
+				answer.ttl = UINT32_MAX;
+				uint32_t negativeTtl = UINT32_MAX;
+				for (size_t i = 0; i < types.size(); i++)
+				{
+					if (resps[i].truncated)
+					{
+						answer.truncated = true;
+						return answer;
+					}
+					if (resps[i].rcode == RCODE_NXDOMAIN)
+					{
+						nxdomain = true;
+					}
+					else if (resps[i].rcode != 0)
+					{
+						//SERVFAIL、REFUSED等，换下一个服务器
+						failed = true;
+					}
+					if (resps[i].addrs.empty())
+					{
+						negativeTtl = std::min(negativeTtl, resps[i].negativeTtl);
+					}
+					else
+					{
+						answer.addrs.insert(answer.addrs.end(), resps[i].addrs.begin(), resps[i].addrs.end());
+						answer.ttl = std::min(answer.ttl, resps[i].ttl);
+					}
+				}
+				if (!answer.addrs.empty())
+				{
+					answer.error = 0;
+					return answer;
+				}
+				if (failed)
+				{
+					continue;
+				}
+				answer.error = nxdomain ? EAI_NONAME : EAI_NODATA;
+				answer.ttl = negativeTtl;
+				return answer;
+			}
+		}
+		answer.addrs.clear();
+		answer.error = EAI_AGAIN;
+		answer.ttl = 0;
+		return answer;
+	}
+
+	Resolver::Answer Resolver::fallback(const std::string& name, int family)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stats.fallbacks++;
+		}
+		addrinfo hints;
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_family = family;
+		hints.ai_socktype = SOCK_STREAM;
+		addrinfo* res = nullptr;
+		int rt = 0;
+		FileIoPool::GetInstance()->run([&]()
+		{
+			rt = getaddrinfo_f(name.c_str(), nullptr, &hints, &res);
+		});
+
+		Answer answer;
+		answer.error = rt;
+		if (rt != 0)
+		{
+			return answer;
+		}
+		for (addrinfo* ai = res; ai; ai = ai->ai_next)
+		{
+			sockaddr_storage addr;
+			memset(&addr, 0, sizeof(addr));
+			memcpy(&addr, ai->ai_addr, ai->ai_addrlen);
+			answer.addrs.push_back(addr);
+		}
+		freeaddrinfo(res);
+		std::stable_partition(answer.addrs.begin(), answer.addrs.end(),
+			[](const sockaddr_storage& addr) { return addr.ss_family == AF_INET; });
+		return answer;
+	}
+
+	void Resolver::setNameservers(const std::vector<sockaddr_storage>& servers)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_servers = servers;
+	}
+
+	void Resolver::setHostsFile(const std::string& path)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_hostsPath = path;
+		m_hostsMtime = -1;
+		m_hosts.clear();
+	}
+
+	void Resolver::setConfigFile(const std::string& path)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_configPath = path;
+		m_configMtime = -1;
+	}
+
+	void Resolver::setTimeout(uint64_t ms)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_timeoutMs = ms;
+	}
+
+	void Resolver::setAttempts(int attempts)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_attempts = attempts;
+	}
+
+	void Resolver::setCacheCapacity(size_t capacity)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_capacity = capacity;
+		while (m_cache.size() > m_capacity)
+		{
+			m_cache.erase(m_cache.begin());
+		}
+	}
+
+	void Resolver::setMaxTtl(uint32_t seconds)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_maxTtl = seconds;
+	}
+
+	void Resolver::setMaxNegativeTtl(uint32_t seconds)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_maxNegativeTtl = seconds;
+	}
+
+	void Resolver::clearCache()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_cache.clear();
+	}
+
+	Resolver::Stats Resolver::getStats()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Stats stats = m_stats;
+		stats.cacheSize = m_cache.size();
+		return stats;
+	}
+}
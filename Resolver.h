@@ -0,0 +1,138 @@
+#ifndef _RESOLVER_H_
+#define _RESOLVER_H_
+
+#include "FiberSync.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+协程友好的域名解析
+glibc的getaddrinfo/gethostbyname在调用线程上同步等待DNS应答，一次解析就把工作线程连同上面排队的协程阻塞一个往返
+这里自己实现A/AAAA查询：查询通过被hook的UDP socket发出，等应答时协程挂起
+解析顺序：hosts文件 -> 进程内缓存 -> DNS；缓存按应答中的TTL过期，NXDOMAIN/无记录按SOA的最小TTL做否定缓存
+同一个名字的并发请求合并成一次查询，其他请求挂起等第一个请求的结果
+配置默认读/etc/resolv.conf（nameserver、search/domain、options ndots/timeout/attempts），hosts文件和resolv.conf修改后自动重新加载
+不在开启hook的调度器协程中或者应答被截断（TC）时，交给阻塞IO线程池执行原始的getaddrinfo
+*/
+
+namespace sylar {
+
+	class Resolver
+	{
+	public:
+		struct Stats
+		{
+			uint64_t lookups = 0;
+			uint64_t hostsHits = 0;//hosts文件命中
+			uint64_t cacheHits = 0;
+			uint64_t coalesced = 0;//合并到进行中的查询的请求
+			uint64_t queries = 0;//发出的DNS报文
+			uint64_t timeouts = 0;
+			uint64_t fallbacks = 0;//交给原始getaddrinfo的请求
+			size_t cacheSize = 0;
+		};
+
+		static Resolver* GetInstance();
+
+		//解析name，family为AF_INET、AF_INET6或AF_UNSPEC（IPv4地址排在前面），addrs中的端口为0
+		//成功返回0，失败返回getaddrinfo的错误码：EAI_NONAME（名字不存在）、EAI_NODATA（没有该类型的地址）、EAI_AGAIN（服务器无应答）
+		int resolve(const std::string& name, int family, std::vector<sockaddr_storage>& addrs);
+
+		//覆盖resolv.conf中的服务器，传空恢复使用resolv.conf
+		void setNameservers(const std::vector<sockaddr_storage>& servers);
+		void setHostsFile(const std::string& path);
+		//替换/etc/resolv.conf的路径
+		void setConfigFile(const std::string& path);
+		//每次尝试等待应答的时间和每个服务器的尝试次数，覆盖resolv.conf中的timeout/attempts
+		void setTimeout(uint64_t ms);
+		void setAttempts(int attempts);
+		//缓存的条目上限、正向缓存TTL上限和否定缓存TTL上限，单位秒
+		void setCacheCapacity(size_t capacity);
+		void setMaxTtl(uint32_t seconds);
+		void setMaxNegativeTtl(uint32_t seconds);
+		void clearCache();
+
+		Stats getStats();
+
+	private:
+		Resolver() = default;
+
+		struct Config
+		{
+			std::vector<sockaddr_storage> servers;
+			std::vector<std::string> search;
+			int ndots = 1;
+			uint64_t timeoutMs = 5000;
+			int attempts = 2;
+		};
+
+		struct CacheEntry
+		{
+			int error = 0;
+			std::vector<sockaddr_storage> addrs;
+			uint64_t expire = 0;//毫秒
+		};
+
+		//进行中的查询，等待者挂在waiters上
+		struct Pending
+		{
+			FiberWaitQueue waiters;
+			bool done = false;
+			int error = 0;
+			std::vector<sockaddr_storage> addrs;
+		};
+
+		//查询一个名字的结果，ttl为0表示不缓存
+		struct Answer
+		{
+			int error = 0;
+			std::vector<sockaddr_storage> addrs;
+			uint32_t ttl = 0;
+			bool truncated = false;
+		};
+
+		//hosts文件和resolv.conf按修改时间重新加载，每秒最多检查一次
+		void reloadHosts();
+		void reloadConfig();
+		bool lookupHosts(const std::string& name, int family, std::vector<sockaddr_storage>& addrs);
+
+		//按search/ndots规则依次尝试候选名字
+		Answer query(const std::string& name, int family);
+		//向服务器查询一个完整的名字，family为AF_UNSPEC时A和AAAA同时发出
+		Answer queryName(const std::string& fqdn, int family, const Config& config);
+		//原始的getaddrinfo，在阻塞IO线程池中执行，结果不缓存
+		Answer fallback(const std::string& name, int family);
+
+	private:
+		std::mutex m_mutex;
+		std::unordered_map<std::string, CacheEntry> m_cache;//key为family和小写的名字
+		std::unordered_map<std::string, std::shared_ptr<Pending>> m_pending;
+		size_t m_capacity = 4096;
+		uint32_t m_maxTtl = 3600;
+		uint32_t m_maxNegativeTtl = 300;
+
+		std::string m_hostsPath = "/etc/hosts";
+		std::unordered_map<std::string, std::vector<sockaddr_storage>> m_hosts;//小写的名字 -> 文件中的顺序
+		int64_t m_hostsMtime = -1;//纳秒
+		uint64_t m_hostsChecked = 0;
+
+		std::string m_configPath = "/etc/resolv.conf";
+		Config m_config;//resolv.conf
+		std::vector<sockaddr_storage> m_servers;//setNameservers设置的服务器
+		uint64_t m_timeoutMs = 0;//0表示使用resolv.conf
+		int m_attempts = 0;
+		int64_t m_configMtime = -1;
+		uint64_t m_configChecked = 0;
+
+		Stats m_stats;
+	};
+}
+
+#endif
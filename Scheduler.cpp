@@ -1,9 +1,26 @@
 #include"Scheduler.h"
+#include<algorithm>
 static bool debug = false;//默认为false
 
 namespace sylar {
 	//用于保存当前线程的调度器对象。
 	static thread_local Scheduler* t_scheduler = nullptr;
+	//当前线程作为工作线程时对应的本地队列，以及它所属的调度器
+	static thread_local void* t_worker = nullptr;
+	static thread_local Scheduler* t_worker_scheduler = nullptr;
+
+	//每调度这么多次，优先检查一次注入队列和本地队列最旧的任务，防止后进先出导致饥饿
+	static const uint64_t FAIRNESS_INTERVAL = 61;
+
+	//粗粒度单调时钟，纳秒，用于排队延迟、优先级老化和插空poll
+	//每个任务入队都要读一次时钟，精确时钟在提交任务的线程上是明显的开销；粗粒度时钟只读内存，
+	//分辨率是一个内核时钟节拍（1~4ms），对毫秒级的老化时间和排队延迟统计足够
+	static inline uint64_t coarse_now_ns()
+	{
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+		return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+	}
 
 	Scheduler* Scheduler::GetThis()
 	{
@@ -24,6 +41,12 @@ namespace sylar {
 		Thread::SetName(m_name);//设置当前线程名为调度器名称 m_name
 
 		//使用主线程作为工作线程，为了实现更高效的任务调度和管理
+		//每个工作线程（包括作为工作线程的主线程）一个本地队列
+		for (size_t i = 0; i < threads; i++)
+		{
+			m_workers.emplace_back(new Worker());
+		}
+
 		if (use_caller)//如果user_caller为true,表示当前线程也要作为一个工作线程使用
 		{
 			threads--;//因为此时作为了工作线程，所以线程数量-1
@@ -36,6 +59,8 @@ namespace sylar {
 			Fiber::SetSchedulerFiber(m_schedulerFiber.get());//设置调度协程
 			m_rootThread = Thread::GetThreadId();//获取主线程ID
 			m_threadIds.push_back(m_rootThread);//将主线程ID添加到线程ID列表中
+			//主线程固定使用第一个本地队列，在它开始调度之前就能接收指定给它的任务
+			m_workers[0]->thread_id = m_rootThread;
 		}
 		m_threadCount = threads;//剩余协程数量
 		if (debug) std::cout << "Scheduler::Scheduler() success\n";
@@ -53,7 +78,7 @@ namespace sylar {
 	{
         //判断调度器是否已经停止
 		std::lock_guard<std::mutex> lock(m_mutex);
-		return m_stopping &&m_tasks.empty()&&m_activeThreadCount==0;
+		return m_stopping &&m_taskCount==0&&m_activeThreadCount==0&&m_externalWaits==0;
 	}
 	void Scheduler::start()
 	{
@@ -69,6 +94,8 @@ namespace sylar {
 		{
             m_threads[i].reset(new Thread(std::bind(&Scheduler::run, this), m_name + "_" + std::to_string(i)));//创建
 			m_threadIds.push_back(m_threads[i]->getId());//将线程ID添加到线程ID列表中
+			//第i个工作线程在启动时就绑定到固定的本地队列，下标与m_threadIds一致
+			m_workers[m_threadIds.size() - 1]->thread_id = m_threadIds.back();
 		}
 		if(debug)std::cout << "Scheduler::start() success\n";
 	}
@@ -86,41 +113,51 @@ namespace sylar {
 			Fiber::GetThis();//分配了线程的主协程和调度协程
 		}
 
+		//领取本线程的本地队列，start()持有m_mutex直到所有线程都绑定好队列
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+		}
+		Worker* worker = getWorker(thread_id);
+		assert(worker);
+		t_worker = worker;
+		t_worker_scheduler = this;
+
 		//创建空闲协程，std::make_shared时c++引入的一个函数，
 		// 用于创建 std::shared_ptr 对象。相比于直接使用 std::shared_ptr 构造函数，std::make_shared 更高效且更安全，
 		// 因为它在单个内存分配中同时分配了控制块和对象，避免了额外的内存分配和指针操作。
 		std::shared_ptr<Fiber> idle_fiber= std::make_shared<Fiber>(std::bind(&Scheduler::idle, this));//子协程
+		//执行一次idle协程：它可能阻塞在等待上（任务可能刚被其他线程取走），所以总是计为空闲线程，保证能被tickle唤醒
+		auto run_idle = [&]()
+		{
+			worker->idle = true;
+			m_idleThreadCount++;
+			idle_fiber->resume();
+			m_idleThreadCount--;
+			worker->idle = false;
+			worker->last_poll = coarse_now_ns();
+		};
 		ScheduleTask task;
+		//本线程的回调协程复用缓存，存放已处于TERM状态的协程
+		std::vector<std::shared_ptr<Fiber>> fiber_cache;
 
 		while (true)
 		{
 			task.reset();
-			bool tickle_me = false;//是否唤醒了其他线程进行任务调度
-			
+			//idle协程发现已有可执行的任务时不会阻塞：IOManager只做一次不等待的epoll_wait，Scheduler直接返回
+			if (worker->poll_pending && idle_fiber->get_state() != Fiber::TERM)
 			{
-				std::lock_guard<std::mutex> lock(m_mutex);//互斥锁防止共享资源的竞争
-				auto it = m_tasks.begin();
-				//遍历任务队列
-				while (it != m_tasks.end())
-				{
-					if (it->thread != -1 && it->thread != thread_id)//不能等于当前thread_id,其目的是让人任何的线程都可以执行。
-					{
-                        ++it;
-						tickle_me = true;
-						continue;
-					}
-
-		            //取出任务
-					assert(it->fiber || it->cb);
-					task = *it;
-					m_tasks.erase(it);
-					m_activeThreadCount++;
-					break;
-				}
-				tickle_me = tickle_me || (it != m_tasks.end());//如果任务队列不为空，则唤醒其他线程进行任务调度
+				worker->poll_pending = false;
+				run_idle();
+			}
+			//先计入活跃线程再取任务，保证stopping()不会在任务出队与开始执行之间误判
+			m_activeThreadCount++;
+			if (!popTask(task))
+			{
+				m_activeThreadCount--;
 			}
-			if (tickle_me)//这里虽然写了唤醒但并没有具体的逻辑代码，具体的在io+scheduler
+			else if (m_taskCount > 0)
 			{
+				//取到后若队列中仍有任务，唤醒其他线程来处理
 				tickle();
 			}
 
@@ -131,20 +168,40 @@ namespace sylar {
 					std::lock_guard<std::mutex>lock (task.fiber->m_mutex);
 					if (task.fiber->get_state() != Fiber::TERM)
 					{
+						task.fiber->setPriority(task.priority);
 						task.fiber->resume();
+						recordCpu(worker, task.fiber.get());
 					}
 				}
 				m_activeThreadCount--;//线程完成后就不再处于活跃状态，而是进入空闲
 				task.reset();
 			}
 			else if (task.cb)
-			{//函数被调度
-				std::shared_ptr<Fiber> cb_fiber = std::make_shared<Fiber>(task.cb);
+			{//函数被调度，优先复用缓存中已结束的协程，只需重置上下文，不再重新分配协程对象和栈
+				std::shared_ptr<Fiber> cb_fiber;
+				if (!fiber_cache.empty())
+				{
+					cb_fiber.swap(fiber_cache.back());
+					fiber_cache.pop_back();
+					cb_fiber->reset(std::move(task.cb));
+				}
+				else
+				{
+					cb_fiber = std::make_shared<Fiber>(std::move(task.cb));
+				}
 				{
 					std::lock_guard<std::mutex>lock(cb_fiber->m_mutex);
+					cb_fiber->setPriority(task.priority);
 					cb_fiber->resume();
+					recordCpu(worker, cb_fiber.get());
 				}
 				m_activeThreadCount--;
+				//已执行完毕且没有其他地方持有的协程放回缓存；半路yield的协程由持有者负责再次调度
+				if (cb_fiber->get_state() == Fiber::TERM && cb_fiber.use_count() == 1
+					&& fiber_cache.size() < m_fiberCacheLimit)
+				{
+					fiber_cache.push_back(std::move(cb_fiber));
+				}
 				task.reset();
 			}
 			//无任务 -> 执行空闲协程
@@ -156,22 +213,661 @@ namespace sylar {
 					//如果调度器没有调度任务，那么idle协程回不断的resume/yield,不会结束进入一个忙等待，如果idle协程结束了
 					//一定是调度器停止了，直到有任务才执行上面的if/else，在这里idle_fiber就是不断的和主协程进行交互的子协程
 					if (debug) std::cout << "Schedule::run() ends in thread: " << thread_id << std::endl;
+					t_worker = nullptr;
+					t_worker_scheduler = nullptr;
 					break;
 				}
-				m_idleThreadCount++;
-				idle_fiber->resume();
-				m_idleThreadCount--;
+				run_idle();
 			}
 		}
     }
+	Scheduler::Worker* Scheduler::getLocalWorker()
+	{
+		if (t_worker_scheduler != this)
+		{
+			return nullptr;
+		}
+		return (Worker*)t_worker;
+	}
+
+	Scheduler::Worker* Scheduler::prepareTask(ScheduleTask& task, uint64_t now)
+	{
+		if (task.priority < 0 || task.priority >= PRIORITY_COUNT)
+		{
+			//协程沿用上一次的优先级，这样因IO或定时器重新调度的协程不会掉回NORMAL
+			int inherited = task.fiber ? task.fiber->getPriority() : -1;
+			task.priority = inherited >= 0 ? inherited : PRIORITY_NORMAL;
+		}
+		task.enqueue_time = now;
+		if (task.thread == -1)
+		{
+			return nullptr;
+		}
+		Worker* target = getWorker(task.thread);
+		if (!target)
+		{
+			//不是本调度器的工作线程，没有线程能执行它，按不指定线程处理
+			task.thread = -1;
+		}
+		return target;
+	}
+
+	void Scheduler::pushInbox(Worker* target, InboxNode* first, InboxNode* last)
+	{
+		last->next = target->inbox.load(std::memory_order_relaxed);
+		while (!target->inbox.compare_exchange_weak(last->next, first, std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	void Scheduler::pushTask(ScheduleTask&& task, bool front)
+	{
+		Worker* target = prepareTask(task, coarse_now_ns());
+		int thread = task.thread;
+		int priority = task.priority;
+		Worker* worker = getLocalWorker();
+
+		if (target)
+		{
+			//指定了线程的任务只进入目标线程自己的队列，其他线程既看不到也不用跳过它们
+			//先计数再入队，保证任务出队时计数不会减成负数
+			target->pinned++;
+			m_pinnedCount++;
+			m_taskCount++;
+			if (target == worker)
+			{
+				if (front)
+				{
+					worker->own[priority].push_front(std::move(task));
+				}
+				else
+				{
+					worker->own[priority].push_back(std::move(task));
+				}
+				return;
+			}
+			//其他线程通过无锁的收件箱投递，只唤醒目标线程
+			InboxNode* node = new InboxNode(std::move(task));
+			pushInbox(target, node, node);
+			tickleThread(thread);
+			return;
+		}
+
+		if (worker)
+		{
+			std::lock_guard<std::mutex> lock(worker->mutex);
+			if (front)
+			{
+				worker->tasks[priority].push_front(std::move(task));
+			}
+			else
+			{
+				worker->tasks[priority].push_back(std::move(task));
+			}
+			m_taskCount++;
+		}
+		else
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_tasks[priority].push_back(std::move(task));
+			m_injectedCount[priority]++;
+			m_taskCount++;
+		}
+
+		//有空闲线程才需要唤醒
+		if (hasIdleThreads())
+		{
+			tickle();
+		}
+	}
+
+	void Scheduler::ScheduleBatch(TaskBatch& batch)
+	{
+		std::vector<ScheduleTask>& tasks = batch.m_tasks;
+		if (tasks.empty())
+		{
+			return;
+		}
+		uint64_t now = coarse_now_ns();
+		Worker* worker = getLocalWorker();
+		//指定给其他线程的任务按目标线程串成链表，每个收件箱只CAS一次
+		struct Chain
+		{
+			Worker* target;
+			InboxNode* first;//最新的任务
+			InboxNode* last;
+		};
+		std::vector<Chain> chains;
+		//没有指定线程的任务依次前移到tasks的前unpinned个位置
+		size_t unpinned = 0;
+		for (size_t i = 0; i < tasks.size(); i++)
+		{
+			ScheduleTask& task = tasks[i];
+			Worker* target = prepareTask(task, now);
+			if (!target)
+			{
+				if (i != unpinned)
+				{
+					tasks[unpinned] = std::move(task);
+				}
+				unpinned++;
+				continue;
+			}
+			//与pushTask相同，先计数再入队
+			target->pinned++;
+			m_pinnedCount++;
+			m_taskCount++;
+			if (target == worker)
+			{
+				worker->own[task.priority].push_back(std::move(task));
+				continue;
+			}
+			auto chain = std::find_if(chains.begin(), chains.end(), [target](const Chain& c) { return c.target == target; });
+			InboxNode* node = new InboxNode(std::move(task));
+			if (chain == chains.end())
+			{
+				chains.push_back({ target, node, node });
+			}
+			else
+			{
+				node->next = chain->first;
+				chain->first = node;
+			}
+		}
+		for (auto& chain : chains)
+		{
+			pushInbox(chain.target, chain.first, chain.last);
+			tickleThread(chain.target->thread_id);
+		}
+
+		if (unpinned > 0)
+		{
+			if (worker)
+			{
+				std::lock_guard<std::mutex> lock(worker->mutex);
+				for (size_t i = 0; i < unpinned; i++)
+				{
+					worker->tasks[tasks[i].priority].push_back(std::move(tasks[i]));
+				}
+				m_taskCount += unpinned;
+			}
+			else
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				for (size_t i = 0; i < unpinned; i++)
+				{
+					int priority = tasks[i].priority;
+					m_tasks[priority].push_back(std::move(tasks[i]));
+					m_injectedCount[priority]++;
+				}
+				m_taskCount += unpinned;
+			}
+			//只唤醒一个空闲线程：取到任务的线程发现队列中还有任务时会接着唤醒下一个
+			if (hasIdleThreads())
+			{
+				tickle();
+			}
+		}
+		tasks.clear();
+	}
+
+	void Scheduler::drainInbox(Worker* worker)
+	{
+		InboxNode* node = worker->inbox.exchange(nullptr, std::memory_order_acquire);
+		//收件箱是后进先出的栈，先反转成投递顺序
+		InboxNode* list = nullptr;
+		while (node)
+		{
+			InboxNode* next = node->next;
+			node->next = list;
+			list = node;
+			node = next;
+		}
+		while (list)
+		{
+			InboxNode* next = list->next;
+			worker->own[list->task.priority].push_back(std::move(list->task));
+			delete list;
+			list = next;
+		}
+	}
+
+	Scheduler::Worker::~Worker()
+	{
+		//调度器停止时所有任务都已执行完，这里只是防御
+		InboxNode* node = inbox.exchange(nullptr);
+		while (node)
+		{
+			InboxNode* next = node->next;
+			delete node;
+			node = next;
+		}
+	}
+
+	void Scheduler::ScheduleYielded(std::shared_ptr<Fiber> fiber)
+	{
+		Worker* worker = getLocalWorker();
+		if (worker)
+		{
+			worker->poll_pending = true;
+		}
+		pushTask(ScheduleTask(&fiber, -1), true);
+	}
+
+	void Scheduler::recordCpu(Worker* worker, Fiber* fiber)
+	{
+		uint64_t cpu = fiber->getCpuTime();
+		//绝大多数情况下进不了排行，只比较一次，不加锁
+		if (worker->top_cpu.size() >= CPU_TOP_SIZE && cpu <= worker->top_cpu_min)
+		{
+			return;
+		}
+		std::lock_guard<std::mutex> lock(worker->stat_mutex);
+		auto& top = worker->top_cpu;
+		auto it = std::find_if(top.begin(), top.end(),
+			[fiber](const FiberCpuStat& s) { return s.fiber_id == fiber->get_Id(); });
+		if (it == top.end())
+		{
+			if (top.size() < CPU_TOP_SIZE)
+			{
+				top.emplace_back();
+				it = top.end() - 1;
+			}
+			else
+			{
+				//替换排行中最小的一项
+				it = std::min_element(top.begin(), top.end(),
+					[](const FiberCpuStat& a, const FiberCpuStat& b) { return a.cpu_time < b.cpu_time; });
+				*it = FiberCpuStat();
+			}
+			it->fiber_id = fiber->get_Id();
+		}
+		it->cpu_time = std::max(it->cpu_time, cpu);
+		it->max_run_time = std::max(it->max_run_time, fiber->getMaxRunTime());
+		it->resumes = std::max(it->resumes, fiber->getResumeCount());
+		if (top.size() >= CPU_TOP_SIZE)
+		{
+			worker->top_cpu_min = std::min_element(top.begin(), top.end(),
+				[](const FiberCpuStat& a, const FiberCpuStat& b) { return a.cpu_time < b.cpu_time; })->cpu_time;
+		}
+	}
+
+	std::vector<Scheduler::FiberCpuStat> Scheduler::getTopCpuFibers(size_t n)
+	{
+		std::vector<FiberCpuStat> all;
+		for (auto& worker : m_workers)
+		{
+			std::lock_guard<std::mutex> lock(worker->stat_mutex);
+			all.insert(all.end(), worker->top_cpu.begin(), worker->top_cpu.end());
+		}
+		//协程可能先后在多个线程上运行，按id合并，各线程记录的都是当时的累计值，取最大
+		std::sort(all.begin(), all.end(),
+			[](const FiberCpuStat& a, const FiberCpuStat& b) { return a.fiber_id < b.fiber_id; });
+		std::vector<FiberCpuStat> merged;
+		for (auto& s : all)
+		{
+			if (!merged.empty() && merged.back().fiber_id == s.fiber_id)
+			{
+				FiberCpuStat& m = merged.back();
+				m.cpu_time = std::max(m.cpu_time, s.cpu_time);
+				m.max_run_time = std::max(m.max_run_time, s.max_run_time);
+				m.resumes = std::max(m.resumes, s.resumes);
+			}
+			else
+			{
+				merged.push_back(s);
+			}
+		}
+		std::sort(merged.begin(), merged.end(),
+			[](const FiberCpuStat& a, const FiberCpuStat& b) { return a.cpu_time > b.cpu_time; });
+		if (merged.size() > n)
+		{
+			merged.resize(n);
+		}
+		return merged;
+	}
+
+	void Scheduler::dumpTopCpuFibers(std::ostream& os, size_t n)
+	{
+		os << "Scheduler " << m_name << " top cpu fibers:\n";
+		for (auto& s : getTopCpuFibers(n))
+		{
+			os << "  fiber " << s.fiber_id << " cpu=" << s.cpu_time / 1000 << "us max_run="
+				<< s.max_run_time / 1000 << "us resumes=" << s.resumes << "\n";
+		}
+	}
+
+	Scheduler::Worker* Scheduler::getWorker(int thread_id)
+	{
+		int index = getWorkerIndex(thread_id);
+		return index < 0 ? nullptr : m_workers[index].get();
+	}
+
+	int Scheduler::getWorkerIndex(int thread_id)
+	{
+		for (size_t i = 0; i < m_workers.size(); i++)
+		{
+			if (m_workers[i]->thread_id == thread_id)
+			{
+				return (int)i;
+			}
+		}
+		return -1;
+	}
+
+	int Scheduler::getLocalWorkerIndex()
+	{
+		Worker* worker = getLocalWorker();
+		if (!worker)
+		{
+			return -1;
+		}
+		return getWorkerIndex(worker->thread_id);
+	}
+
+	void Scheduler::tickleThread(int thread)
+	{
+		Worker* worker = getWorker(thread);
+		if (worker)
+		{
+			unpark(worker);
+		}
+	}
+
+	bool Scheduler::hasReadyTasks()
+	{
+		Worker* worker = getLocalWorker();
+		return (worker && worker->pinned > 0) || m_taskCount > m_pinnedCount;
+	}
+
+	void Scheduler::park(Worker* worker)
+	{
+		//先声明挂起再检查任务数，与pushTask先入队再检查挂起标志配对，两边至少有一方能看到对方
+		worker->parked = true;
+		if (m_stopping || hasReadyTasks())
+		{
+			worker->parked = false;
+			return;
+		}
+		std::unique_lock<std::mutex> lock(worker->park_mutex);
+		worker->park_cv.wait(lock, [worker]() { return worker->notified; });
+		worker->notified = false;
+	}
+
+	bool Scheduler::unpark(Worker* worker)
+	{
+		if (!worker->parked.exchange(false))
+		{
+			return false;
+		}
+		{
+			std::lock_guard<std::mutex> lock(worker->park_mutex);
+			worker->notified = true;
+		}
+		worker->park_cv.notify_one();
+		return true;
+	}
+
+	bool Scheduler::popInjected(ScheduleTask& task, int priority, bool aged_only, uint64_t now)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto& tasks = m_tasks[priority];
+		if (tasks.empty())
+		{
+			return false;
+		}
+		if (aged_only && tasks.front().enqueue_time + m_agingMs * 1000000 > now)
+		{
+			return false;
+		}
+		assert(tasks.front().fiber || tasks.front().cb);
+		task = std::move(tasks.front());
+		tasks.pop_front();
+		m_injectedCount[priority]--;
+		--m_taskCount;
+		return true;
+	}
+
+	bool Scheduler::popTask(ScheduleTask& task)
+	{
+		if (m_taskCount == 0)
+		{
+			return false;
+		}
+		Worker* worker = getLocalWorker();
+		bool fair = worker && (++worker->tick % FAIRNESS_INTERVAL == 0);
+		uint64_t now = coarse_now_ns();
+		//其他线程指定给本线程的任务，没有投递时只是一次load
+		if (worker && worker->inbox.load(std::memory_order_relaxed))
+		{
+			drainInbox(worker);
+		}
+
+		//指定给本线程的任务按投递顺序执行，只有本线程访问，不加锁
+		auto take_own = [&](int priority)
+		{
+			task = std::move(worker->own[priority].front());
+			worker->own[priority].pop_front();
+			worker->pinned--;
+			m_pinnedCount--;
+			--m_taskCount;
+		};
+		//从本地队列取第priority级的任务，调用时持有worker->mutex
+		//平时取最新的任务（缓存更热），公平轮次取最旧的任务
+		auto take_local = [&](int priority, bool oldest)
+		{
+			auto& tasks = worker->tasks[priority];
+			if (oldest)
+			{
+				task = std::move(tasks.front());
+				tasks.pop_front();
+			}
+			else
+			{
+				task = std::move(tasks.back());
+				tasks.pop_back();
+			}
+			--m_taskCount;
+		};
+		//最高的非空优先级，没有返回PRIORITY_COUNT
+		auto first_priority = [](const std::deque<ScheduleTask>* queues) -> int
+		{
+			int p = 0;
+			while (p < PRIORITY_COUNT && queues[p].empty())
+			{
+				p++;
+			}
+			return p;
+		};
+
+		bool found = false;
+		//老化：低优先级中排队最久的任务超过老化时间就先执行它，防止被持续到来的高优先级任务饿死
+		//每个线程每AGING_INTERVAL最多放行一个老化任务：积压的低优先级任务全都超过老化时间时，
+		//不能因此反过来一直压住高优先级任务；同时也避免每次取任务都要多加锁
+		if (worker && m_agingMs && now >= worker->next_aging_check)
+		{
+			uint64_t aging = m_agingMs * 1000000;
+			for (int p = PRIORITY_COUNT - 1; p > PRIORITY_HIGH && !found; p--)
+			{
+				if (!worker->own[p].empty() && worker->own[p].front().enqueue_time + aging <= now)
+				{
+					take_own(p);
+					found = true;
+					break;
+				}
+				{
+					std::lock_guard<std::mutex> lock(worker->mutex);
+					auto& tasks = worker->tasks[p];
+					if (!tasks.empty() && tasks.front().enqueue_time + aging <= now)
+					{
+						take_local(p, true);
+						found = true;
+					}
+				}
+				if (!found && m_injectedCount[p] > 0)
+				{
+					found = popInjected(task, p, true, now);
+				}
+			}
+			worker->next_aging_check = now + AGING_INTERVAL;
+		}
+
+		//严格优先级：比较三处的最高优先级，同级时先取指定给本线程的，再取本地队列，公平轮次先取注入队列
+		int injected = 0;
+		while (injected < PRIORITY_COUNT && m_injectedCount[injected] == 0)
+		{
+			injected++;
+		}
+		if (!found && worker)
+		{
+			int own = first_priority(worker->own);
+			if (own < PRIORITY_COUNT && own <= injected)
+			{
+				std::lock_guard<std::mutex> lock(worker->mutex);
+				if (own <= first_priority(worker->tasks))
+				{
+					take_own(own);
+					found = true;
+				}
+			}
+		}
+		if (!found && worker)
+		{
+			std::lock_guard<std::mutex> lock(worker->mutex);
+			int local = first_priority(worker->tasks);
+			if (local < injected || (local == injected && local < PRIORITY_COUNT && !fair))
+			{
+				take_local(local, fair);
+				found = true;
+			}
+		}
+		for (int p = injected; p < PRIORITY_COUNT && !found; p++)
+		{
+			if (m_injectedCount[p] > 0)
+			{
+				found = popInjected(task, p, false, now);
+			}
+		}
+		//注入队列在检查之后被其他线程取空了
+		if (!found && worker)
+		{
+			int own = first_priority(worker->own);
+			std::lock_guard<std::mutex> lock(worker->mutex);
+			int local = first_priority(worker->tasks);
+			if (own < PRIORITY_COUNT && own <= local)
+			{
+				take_own(own);
+				found = true;
+			}
+			else if (local < PRIORITY_COUNT)
+			{
+				take_local(local, fair);
+				found = true;
+			}
+		}
+		if (!found && worker)
+		{
+			found = stealTask(task);
+		}
+
+		if (found && worker)
+		{
+			//一直有任务可做时也要定期收集IO事件和定时器，否则等在IO或sleep上的高优先级协程同样会被饿死
+			if (now - worker->last_poll >= POLL_INTERVAL)
+			{
+				worker->poll_pending = true;
+			}
+			//排队延迟，只有本线程写入，不需要原子的读改写
+			int p = task.priority;
+			uint64_t delay = now > task.enqueue_time ? now - task.enqueue_time : 0;
+			worker->delay_tasks[p].store(worker->delay_tasks[p].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			worker->delay_total[p].store(worker->delay_total[p].load(std::memory_order_relaxed) + delay, std::memory_order_relaxed);
+			if (delay > worker->delay_max[p].load(std::memory_order_relaxed))
+			{
+				worker->delay_max[p].store(delay, std::memory_order_relaxed);
+			}
+		}
+		return found;
+	}
+
+	bool Scheduler::stealTask(ScheduleTask& task)
+	{
+		Worker* self = getLocalWorker();
+		size_t n = m_workers.size();
+		//从自己的下一个位置开始轮询，避免所有线程都去窃取同一个队列
+		size_t start = 0;
+		for (size_t i = 0; i < n; i++)
+		{
+			if (m_workers[i].get() == self)
+			{
+				start = i + 1;
+				break;
+			}
+		}
+		for (size_t i = 0; i < n; i++)
+		{
+			Worker* victim = m_workers[(start + i) % n].get();
+			if (victim == self)
+			{
+				continue;
+			}
+			std::unique_lock<std::mutex> lock(victim->mutex, std::try_to_lock);
+			if (!lock.owns_lock())
+			{
+				continue;
+			}
+			//按优先级从高到低，从头部窃取；本地队列里没有指定了线程的任务，它们在所有者的own队列中
+			for (int p = 0; p < PRIORITY_COUNT; p++)
+			{
+				auto& tasks = victim->tasks[p];
+				if (tasks.empty())
+				{
+					continue;
+				}
+				task = std::move(tasks.front());
+				tasks.pop_front();
+				--m_taskCount;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	Scheduler::PriorityStat Scheduler::getPriorityStat(Priority priority)
+	{
+		PriorityStat stat;
+		for (auto& worker : m_workers)
+		{
+			stat.tasks += worker->delay_tasks[priority].load(std::memory_order_relaxed);
+			stat.total_delay += worker->delay_total[priority].load(std::memory_order_relaxed);
+			stat.max_delay = std::max(stat.max_delay, worker->delay_max[priority].load(std::memory_order_relaxed));
+		}
+		return stat;
+	}
+
+	void Scheduler::dumpPriorityStats(std::ostream& os)
+	{
+		static const char* names[PRIORITY_COUNT] = { "high", "normal", "low" };
+		os << "Scheduler " << m_name << " queueing delay:\n";
+		for (int p = 0; p < PRIORITY_COUNT; p++)
+		{
+			PriorityStat stat = getPriorityStat((Priority)p);
+			os << "  " << names[p] << " tasks=" << stat.tasks
+				<< " avg=" << (stat.tasks ? stat.total_delay / stat.tasks / 1000 : 0) << "us"
+				<< " max=" << stat.max_delay / 1000 << "us\n";
+		}
+	}
+
 	void Scheduler::idle()
 	{
+		Worker* worker = getLocalWorker();
 		while (!stopping())
 		{
-			if (debug)std::cout << "Scheduler::idle(), sleeping in thread: " << Thread::GetThreadId() << std::endl;
-			sleep(1);//降低空闲协程在无任务时对cpu占用率，避免空转浪费资源
+			if (debug)std::cout << "Scheduler::idle(), parking in thread: " << Thread::GetThreadId() << std::endl;
+			//挂起线程直到有新任务被tickle()唤醒，避免空转也避免轮询带来的延迟
+			park(worker);
 			Fiber::GetThis()->yield();
 		}
+		//调度器停止时只有最后完成任务的线程能观察到，依次唤醒其余挂起的线程退出
+		tickle();
 	}
 	void Scheduler::stop()
 	{
@@ -220,6 +916,17 @@ namespace sylar {
 	}
 	void Scheduler::tickle()
 	{
-
+		//唤醒一个挂起的工作线程
+		if (!hasIdleThreads())
+		{
+			return;
+		}
+		for (auto& worker : m_workers)
+		{
+			if (unpark(worker.get()))
+			{
+				return;
+			}
+		}
 	}
 }
@@ -3,16 +3,48 @@
 
 #include"fiber.h"
 #include"thread.h"
+#include"InlineFunction.h"
 #include<mutex>
 #include<vector>
+#include<deque>
+#include<atomic>
+#include<condition_variable>
 #include<string>
 #include<time.h>
+#include<ostream>
 namespace sylar {
 
 	
 	class Scheduler
 	{
 	public:
+		//任务优先级，数值越小越优先；严格按优先级取任务，
+		//低优先级任务排队超过老化时间后可以插队，每个工作线程每毫秒最多插队一个
+		enum Priority
+		{
+			PRIORITY_DEFAULT = -1,//协程任务沿用该协程上一次被调度时的优先级，回调任务为NORMAL
+			PRIORITY_HIGH = 0,//延迟敏感的请求处理
+			PRIORITY_NORMAL = 1,
+			PRIORITY_LOW = 2,//后台任务，如日志刷新、缓存更新
+			PRIORITY_COUNT = 3
+		};
+		//一个优先级的排队延迟统计（入队到开始执行），时间单位纳秒，分辨率为一个内核时钟节拍
+		struct PriorityStat
+		{
+			uint64_t tasks = 0;
+			uint64_t total_delay = 0;
+			uint64_t max_delay = 0;
+		};
+
+		//一个协程的运行时间统计，时间单位纳秒
+		struct FiberCpuStat
+		{
+			uint64_t fiber_id = 0;
+			uint64_t cpu_time = 0;//累计运行时间
+			uint64_t max_run_time = 0;//单次连续运行的最长时间，超过时间片很多说明缺少让出点
+			uint64_t resumes = 0;//被恢复的次数
+		};
+
 		//threads指定线程池的线程数量，use_caller指定是否将主线程作为工作线程，name调度器的名称
 		Scheduler(size_t threads = 1, bool use_caller = true, const std::string& name = "Scheduler");
 		virtual ~Scheduler();//防止资源泄露，基类指针删除派生类对象不完全销毁问题’
@@ -25,32 +57,52 @@ namespace sylar {
 	protected:
 		//设置正在运行的调度器
 		void SetThis();
+		//队列中是否有当前线程可以执行的任务
+		bool hasReadyTasks();
+		//唤醒指定线程来执行指定给它的任务，默认只唤醒挂起的该线程
+		virtual void tickleThread(int thread);
+		//第index个工作线程是否正在执行idle协程（可能阻塞在等待上）
+		bool isWorkerIdle(size_t index) const { return m_workers[index]->idle; }
+
+		//工作线程按下标编号：使用调用线程时它是0号，其余按start()创建的顺序，start()之后不再变化
+		size_t getWorkerCount() const { return m_workers.size(); }
+		//线程id对应的工作线程下标，不是本调度器的工作线程返回-1
+		int getWorkerIndex(int thread_id);
+		//当前线程的工作线程下标，不是本调度器的工作线程返回-1
+		int getLocalWorkerIndex();
+		int getWorkerThreadId(size_t index) const { return m_workers[index]->thread_id; }
+		//调用线程（0号工作线程）只在stop()中参与调度
+		bool useCaller() const { return m_useCaller; }
 	public:
 
 		//添加任务到队列
-		//FiberOrCb调度任务类型，可以是协程对象或者函数指针
+		//FiberOrCb调度任务类型，可以是协程对象、可调用对象，或者指向它们的指针（内容被转移走）
+		//可调用对象按值传入后一路移动，不超过Callback内部缓冲区时不分配内存
+		//在本调度器的工作线程中调用时放入该线程的本地队列，否则放入全局注入队列
+		//priority见Priority
 		template <class FiberOrCb>
-		void ScheduleLock(FiberOrCb fc, int thread = -1)
+		void ScheduleLock(FiberOrCb fc, int thread = -1, Priority priority = PRIORITY_DEFAULT)
 		{
-			bool need_tickle;//用于标记任务队列是否为空，判断需要唤醒线程
+			// 创建task任务对象
+			ScheduleTask task(std::move(fc), thread);
+			if (task.fiber || task.cb)//存在就加入
 			{
-				std::lock_guard<std::mutex> lock(m_mutex);
-				//empty-> all thread is idle -> need to be waken uo
-				need_tickle = m_tasks.empty();
-				// 创建task任务对象
-				ScheduleTask task(fc, thread);
-				if (task.fiber || task.cb)//存在就加入
-				{
-					m_tasks.push_back(task);
-				}
-
-				if (need_tickle)//如果检查出队列为空，唤醒线程
-				{
-					tickle();
-				}
+				task.priority = priority;
+				pushTask(std::move(task));
 			}
 		}
 
+		//一批任务，见下文TaskBatch的定义
+		class TaskBatch;
+		//把batch中的任务一次放入队列并清空batch：只读一次时钟，每个队列只加一次锁，
+		//指定给其他线程的任务每个收件箱只投递一次，最后只做一次唤醒决策
+		//用于一次产生很多任务的场合，如IOManager处理一轮epoll_wait返回的事件和到期的定时器
+		void ScheduleBatch(TaskBatch& batch);
+		//把[first, last)中的协程或回调作为一批放入队列，元素按ScheduleLock的方式传入：
+		//Callback只能移动，需要用std::make_move_iterator包装迭代器
+		template<class Iterator>
+		void ScheduleBatch(Iterator first, Iterator last, int thread = -1, Priority priority = PRIORITY_DEFAULT);
+
 		//启动线程池，启动调度器
 		virtual void start();
 		//关闭线程池，停止调度器，等所有调度任务都完成后再返回
@@ -65,16 +117,62 @@ namespace sylar {
 
 		//是否可以关闭
 		virtual bool stopping();
+		//协程挂起等待调度器之外的线程（如阻塞IO线程池）唤醒时加1，被重新调度之后再减1
+		//计数不为0时stop()不会返回，否则调度器可能在协程被唤醒之前就已经销毁
+		void addExternalWait() { ++m_externalWaits; }
+		void removeExternalWait() { --m_externalWaits; }
 		//返回是否有空闲线程
 		//当调度协程进入idle时空闲线程数+1，从idle协程返回时空闲，线程数-1
 		bool hasIdleThreads() { return m_idleThreadCount > 0; }
+
+		//每个工作线程最多缓存多少个已结束的回调协程用于复用，0表示不复用
+		void setFiberCacheLimit(size_t limit) { m_fiberCacheLimit = limit; }
+		size_t getFiberCacheLimit() const { return m_fiberCacheLimit; }
+
+		//时间片，单位微秒：协程连续运行超过它之后Fiber::maybeYield()才会让出，0表示关闭，应在start()之前设置
+		void setTimeslice(uint64_t us) { m_timeslice = us; }
+		uint64_t getTimeslice() const { return m_timeslice; }
+		//重新调度一个主动让出时间片的协程：放到当前线程本地队列最旧的一端，先执行其他任务，
+		//也可以被空闲线程窃取走；不在工作线程上调用时等同于ScheduleLock
+		//本线程在执行下一个任务之前会先插空运行一次idle协程，否则计算密集的协程互相让出时IO和定时器一直得不到处理
+		void ScheduleYielded(std::shared_ptr<Fiber> fiber);
+
+		//累计运行时间最多的n个协程，按运行时间从大到小排序；每个工作线程各自记录前CPU_TOP_SIZE个，这里再合并
+		std::vector<FiberCpuStat> getTopCpuFibers(size_t n = 10);
+		void dumpTopCpuFibers(std::ostream& os, size_t n = 10);
+
+		//低优先级任务排队超过这个时间（毫秒）后不再等待更高优先级的任务，0表示严格优先级，应在start()之前设置
+		void setPriorityAging(uint64_t ms) { m_agingMs = ms; }
+		uint64_t getPriorityAging() const { return m_agingMs; }
+		//各工作线程累计的排队延迟统计
+		PriorityStat getPriorityStat(Priority priority);
+		void dumpPriorityStats(std::ostream& os);
 	private:
+		struct ScheduleTask;
+		struct InboxNode;
+		struct Worker;
+		//按调用线程将任务放入本地队列或注入队列，并决定是否唤醒空闲线程
+		//front为true时放到本地队列最旧的一端，本线程会先执行队列中其他任务
+		void pushTask(ScheduleTask&& task, bool front = false);
+		//入队前解析任务的优先级和入队时刻，返回它指定的工作线程，没有指定或不是本调度器的线程返回nullptr
+		Worker* prepareTask(ScheduleTask& task, uint64_t now);
+		//把一串收件箱节点压入target的收件箱，first是最新的任务，沿next到last越来越旧
+		void pushInbox(Worker* target, InboxNode* first, InboxNode* last);
+		//为当前工作线程取一个任务：先取排队超过老化时间的低优先级任务，
+		//再按优先级从高到低依次尝试本地队列、注入队列，最后从其他工作线程窃取
+		bool popTask(ScheduleTask& task);
+		bool stealTask(ScheduleTask& task);
+		//取出注入队列中第priority级的第一个任务，aged_only时只在它已经超过老化时间时取出
+		bool popInjected(ScheduleTask& task, int priority, bool aged_only, uint64_t now);
+
 		//任务
 		struct ScheduleTask
 		{
 			std::shared_ptr<Fiber>fiber;
-			std::function<void()>cb;
+			Callback cb;
 			int thread;//指定任务需要运行的线程id
+			int priority = PRIORITY_NORMAL;//入队时解析，不再是PRIORITY_DEFAULT
+			uint64_t enqueue_time = 0;//入队时刻，纳秒
 
 			ScheduleTask()
 			{
@@ -85,7 +183,7 @@ namespace sylar {
 
 			ScheduleTask(std::shared_ptr<Fiber>f, int thr)
 			{
-				fiber = f;
+				fiber = std::move(f);
 				thread = thr;
 			}
 			ScheduleTask(std::shared_ptr<Fiber>* f, int thr)
@@ -93,31 +191,105 @@ namespace sylar {
 				fiber.swap(*f);//内容转移，引用计数不会增加
 				thread = thr;
 			}
-			ScheduleTask(std::function<void()>f, int thr)
+			ScheduleTask(Callback f, int thr)
 			{
-				cb = f;
+				cb = std::move(f);
 				thread = thr;
 			}
-			ScheduleTask(std::function<void()>* f, int thr)
+			ScheduleTask(Callback* f, int thr)
 			{
 				cb.swap(*f);//同理
 				thread = thr;
 			}
+			ScheduleTask(std::function<void()>* f, int thr)
+			{
+				cb = std::move(*f);
+				*f = nullptr;
+				thread = thr;
+			}
 			void reset()//重置
 			{
 				fiber = nullptr;
 				cb = nullptr;
 				thread = -1;
+				priority = PRIORITY_NORMAL;
+				enqueue_time = 0;
 			}
 		};
+		//收件箱节点，其他线程投递的指定任务
+		struct InboxNode
+		{
+			ScheduleTask task;
+			InboxNode* next = nullptr;
+			explicit InboxNode(ScheduleTask&& t) : task(std::move(t)) {}
+		};
+		//工作线程，每个线程独占一组本地双端队列，每个优先级一个：
+		//所有者在尾部压入/弹出，其他线程从头部窃取
+		//指定了线程的任务不进入本地队列和注入队列：其他线程通过无锁收件箱投递，所有者取出后放入own
+		struct Worker
+		{
+			~Worker();
+			std::mutex mutex;//保护tasks，所有者和窃取者之间竞争很少
+			std::deque<ScheduleTask> tasks[PRIORITY_COUNT];
+			std::deque<ScheduleTask> own[PRIORITY_COUNT];//指定由本线程执行的任务，只有所有者访问
+			std::atomic<InboxNode*> inbox = { nullptr };//多生产者单消费者的无锁栈
+			std::atomic<bool> idle = { false };//正在执行idle协程
+			int thread_id = -1;
+			uint64_t tick = 0;//调度次数，用于周期性地优先检查注入队列
+
+			//空闲时挂起在条件变量上，由tickle()逐个唤醒
+			std::mutex park_mutex;
+			std::condition_variable park_cv;
+			bool notified = false;//受park_mutex保护，防止丢失唤醒
+			std::atomic<bool> parked = { false };
+			std::atomic<size_t> pinned = { 0 };//指定由本线程执行的任务数，包括还在收件箱中的
+
+			//本线程上运行时间最多的协程，只有所有者写入，读取报告时加stat_mutex
+			std::mutex stat_mutex;
+			std::vector<FiberCpuStat> top_cpu;
+			uint64_t top_cpu_min = 0;//top_cpu已满时其中最小的运行时间，只有所有者访问
+			//队列一直不空时idle协程没有机会收集IO事件和超时定时器，需要插空执行一次：
+			//有协程让出了时间片，或者距上次执行idle协程超过POLL_INTERVAL；只有所有者访问
+			bool poll_pending = false;
+			uint64_t last_poll = 0;
+
+			uint64_t next_aging_check = 0;//下次检查老化任务的时刻，只有所有者访问
+			//各优先级的排队延迟，只有所有者写入，读取时不加锁
+			std::atomic<uint64_t> delay_tasks[PRIORITY_COUNT] = {};
+			std::atomic<uint64_t> delay_total[PRIORITY_COUNT] = {};
+			std::atomic<uint64_t> delay_max[PRIORITY_COUNT] = {};
+		};
+		static const size_t CPU_TOP_SIZE = 16;
+		static const uint64_t POLL_INTERVAL = 1000000;//纳秒，实际受粗粒度时钟的分辨率限制
+		static const uint64_t AGING_INTERVAL = 1000000;//纳秒，同上
+		//把收件箱中的任务按投递顺序移到own，只在所有者线程调用
+		void drainInbox(Worker* worker);
+		//协程从resume返回后更新本线程的运行时间排行，调用时持有协程的m_mutex
+		void recordCpu(Worker* worker, Fiber* fiber);
+		//挂起当前工作线程直到被唤醒，挂起前再次确认确实没有可执行的任务
+		void park(Worker* worker);
+		//唤醒一个挂起的工作线程，没有挂起的返回false
+		bool unpark(Worker* worker);
+		//根据线程id查找工作线程
+		Worker* getWorker(int thread_id);
+		//当前线程对应的本调度器工作线程，不是工作线程返回nullptr
+		Worker* getLocalWorker();
 	private:
 		std::string m_name;//调度器名称
-		//互斥锁 -> 保护队列任务
+		//互斥锁 -> 保护注入队列
 		std::mutex m_mutex;
 		//线程池，存初始化好的线程
 		std::vector<std::shared_ptr<Thread>> m_threads;
-		//任务队列
-		std::vector<ScheduleTask> m_tasks;
+		//注入队列，非工作线程提交的没有指定线程的任务，每个优先级一个
+		std::deque<ScheduleTask> m_tasks[PRIORITY_COUNT];
+		//各注入队列的长度，在m_mutex下修改，取任务时不加锁读取以跳过空队列
+		std::atomic<size_t> m_injectedCount[PRIORITY_COUNT] = {};
+		//所有工作线程的本地队列，构造时按线程总数创建，之后不再变化
+		std::vector<std::unique_ptr<Worker>> m_workers;
+		//所有队列中的任务总数
+		std::atomic<size_t> m_taskCount = { 0 };
+		//其中指定了执行线程的任务数，其他线程不能执行它们
+		std::atomic<size_t> m_pinnedCount = { 0 };
 		//存储工作线程的线程id
 		std::vector<int>m_threadIds;
 		//需要额外创建的线程数
@@ -127,6 +299,8 @@ namespace sylar {
 
 		//空闲线程数
 		std::atomic<size_t> m_idleThreadCount = { 0 };
+		//等待外部线程唤醒的协程数
+		std::atomic<size_t> m_externalWaits = { 0 };
 		//主线程是否为工作线程
 		bool m_useCaller;
 		//如果是，需要额外创建调度协程
@@ -135,8 +309,56 @@ namespace sylar {
 		int m_rootThread = -1;
 		//是否正在关闭
 
-		bool m_stopping = false;
+		std::atomic<bool> m_stopping = { false };
+		//每个工作线程回调协程复用缓存的上限
+		size_t m_fiberCacheLimit = 64;
+		//时间片，单位微秒，默认10ms
+		uint64_t m_timeslice = 10000;
+		//优先级老化时间，单位毫秒
+		uint64_t m_agingMs = 50;
+
+	};
+
+	//一批提交给同一个调度器的任务：先用add在调用者处收集，再用submit一次放入队列
+	//submit之后清空但保留容量，在循环中复用同一个batch时不再分配内存
+	class Scheduler::TaskBatch
+	{
+	public:
+		explicit TaskBatch(Scheduler* scheduler) : m_scheduler(scheduler) {}
+		TaskBatch(const TaskBatch&) = delete;
+		TaskBatch& operator=(const TaskBatch&) = delete;
+
+		//参数同ScheduleLock，传入协程或回调的指针时直接转移内容，不拷贝
+		template <class FiberOrCb>
+		void add(FiberOrCb fc, int thread = -1, Priority priority = PRIORITY_DEFAULT)
+		{
+			ScheduleTask task(std::move(fc), thread);
+			if (task.fiber || task.cb)
+			{
+				task.priority = priority;
+				m_tasks.push_back(std::move(task));
+			}
+		}
+		void submit() { m_scheduler->ScheduleBatch(*this); }
 
+		Scheduler* getScheduler() const { return m_scheduler; }
+		size_t size() const { return m_tasks.size(); }
+		bool empty() const { return m_tasks.empty(); }
+	private:
+		friend class Scheduler;
+		Scheduler* m_scheduler;
+		std::vector<ScheduleTask> m_tasks;
 	};
+
+	template<class Iterator>
+	void Scheduler::ScheduleBatch(Iterator first, Iterator last, int thread, Priority priority)
+	{
+		TaskBatch batch(this);
+		for (; first != last; ++first)
+		{
+			batch.add(*first, thread, priority);
+		}
+		ScheduleBatch(batch);
+	}
 }
 #endif
\ No newline at end of file
@@ -0,0 +1,274 @@
+#include "StackPool.h"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <cstdlib>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace sylar {
+
+	//最小级别64K，每级翻倍，共5级，最大1M
+	static const size_t MIN_CLASS_SHIFT = 16;
+	static const size_t NUM_CLASSES = 5;
+	//缓存槽位：前NUM_CLASSES个放malloc栈，后NUM_CLASSES个放带保护页的栈
+	static const size_t NUM_SLOTS = NUM_CLASSES * 2;
+
+	static std::atomic<size_t> s_high_watermark{ 64 };
+	static std::atomic<size_t> s_low_watermark{ 16 };
+	static std::atomic<size_t> s_global_limit{ 1024 };
+	static std::atomic<bool> s_guarded_stacks{ false };
+
+	static std::atomic<uint64_t> s_local_hits{ 0 };
+	static std::atomic<uint64_t> s_global_hits{ 0 };
+	static std::atomic<uint64_t> s_misses{ 0 };
+	static std::atomic<uint64_t> s_releases{ 0 };
+
+	//size对应的级别，超出最大级别返回NUM_CLASSES
+	static size_t SizeClass(size_t size)
+	{
+		size_t cls = 0;
+		while (cls < NUM_CLASSES && ((size_t)1 << (MIN_CLASS_SHIFT + cls)) < size)
+		{
+			cls++;
+		}
+		return cls;
+	}
+
+	static size_t ClassSize(size_t cls)
+	{
+		return (size_t)1 << (MIN_CLASS_SHIFT + cls);
+	}
+
+	static size_t Slot(size_t cls, bool guarded)
+	{
+		return guarded ? cls + NUM_CLASSES : cls;
+	}
+
+	size_t StackPool::GetGuardSize()
+	{
+		static const size_t s_page = (size_t)sysconf(_SC_PAGESIZE);
+		return s_page;
+	}
+
+	//向系统申请栈。带保护页的栈整体映射后把最低的一页设为不可访问，返回保护页之上的地址；
+	//MAP_NORESERVE不预占提交额度，大量协程各自持有1M的栈时只有访问过的页占用内存
+	static void* SystemAlloc(size_t size, bool guarded)
+	{
+		if (!guarded)
+		{
+			return ::malloc(size);
+		}
+		size_t guard = StackPool::GetGuardSize();
+		void* base = mmap(nullptr, size + guard, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+		if (base == MAP_FAILED)
+		{
+			return nullptr;
+		}
+		if (mprotect(base, guard, PROT_NONE) == -1)
+		{
+			munmap(base, size + guard);
+			return nullptr;
+		}
+		return (char*)base + guard;
+	}
+
+	static void SystemFree(void* stack, size_t size, bool guarded)
+	{
+		if (!guarded)
+		{
+			::free(stack);
+			return;
+		}
+		size_t guard = StackPool::GetGuardSize();
+		munmap((char*)stack - guard, size + guard);
+	}
+
+	//全局溢出层
+	struct GlobalTier
+	{
+		std::mutex mutex;
+		std::vector<void*> free[NUM_SLOTS];
+	};
+
+	//故意不析构，避免线程退出时与静态对象析构顺序冲突
+	static GlobalTier& GetGlobal()
+	{
+		static GlobalTier* s_global = new GlobalTier();
+		return *s_global;
+	}
+
+	//线程本地缓存已析构（线程退出阶段），之后的分配释放直接走全局层
+	static thread_local bool t_cache_dead = false;
+
+	//线程本地缓存，线程退出时全部交还给全局层
+	struct ThreadCache
+	{
+		std::vector<void*> free[NUM_SLOTS];
+
+		~ThreadCache()
+		{
+			t_cache_dead = true;
+			for (size_t slot = 0; slot < NUM_SLOTS; slot++)
+			{
+				flush(slot, 0);
+			}
+		}
+
+		//将本地缓存迁移到全局层直到只剩keep个，全局层满了就释放
+		//带保护页的栈进入全局层前先丢弃已经用过的页，闲置的栈不再占用RSS，下次使用时按需重新分配
+		void flush(size_t slot, size_t keep)
+		{
+			std::vector<void*>& local = free[slot];
+			if (local.size() <= keep)
+			{
+				return;
+			}
+			bool guarded = slot >= NUM_CLASSES;
+			size_t size = ClassSize(guarded ? slot - NUM_CLASSES : slot);
+			if (guarded)
+			{
+				for (size_t i = keep; i < local.size(); i++)
+				{
+					madvise(local[i], size, MADV_DONTNEED);
+				}
+			}
+			GlobalTier& global = GetGlobal();
+			size_t limit = s_global_limit.load(std::memory_order_relaxed);
+			std::lock_guard<std::mutex> lock(global.mutex);
+			while (local.size() > keep)
+			{
+				void* stack = local.back();
+				local.pop_back();
+				if (global.free[slot].size() < limit)
+				{
+					global.free[slot].push_back(stack);
+				}
+				else
+				{
+					SystemFree(stack, size, guarded);
+					s_releases.fetch_add(1, std::memory_order_relaxed);
+				}
+			}
+		}
+
+		//从全局层批量取回至多count个
+		void refill(size_t slot, size_t count)
+		{
+			GlobalTier& global = GetGlobal();
+			std::lock_guard<std::mutex> lock(global.mutex);
+			std::vector<void*>& from = global.free[slot];
+			while (count-- > 0 && !from.empty())
+			{
+				free[slot].push_back(from.back());
+				from.pop_back();
+			}
+		}
+	};
+
+	static thread_local ThreadCache t_cache;
+
+	size_t StackPool::GetAllocSize(size_t size)
+	{
+		size_t cls = SizeClass(size);
+		return cls < NUM_CLASSES ? ClassSize(cls) : size;
+	}
+
+	void* StackPool::Alloc(size_t size, bool guarded)
+	{
+		size_t cls = SizeClass(size);
+		if (cls >= NUM_CLASSES)//超大栈不缓存
+		{
+			s_misses.fetch_add(1, std::memory_order_relaxed);
+			return SystemAlloc(size, guarded);
+		}
+
+		if (t_cache_dead)
+		{
+			s_misses.fetch_add(1, std::memory_order_relaxed);
+			return SystemAlloc(ClassSize(cls), guarded);
+		}
+
+		size_t slot = Slot(cls, guarded);
+		std::vector<void*>& local = t_cache.free[slot];
+		if (!local.empty())
+		{
+			void* stack = local.back();
+			local.pop_back();
+			s_local_hits.fetch_add(1, std::memory_order_relaxed);
+			return stack;
+		}
+
+		size_t low = s_low_watermark.load(std::memory_order_relaxed);
+		t_cache.refill(slot, low ? low : 1);
+		if (!local.empty())
+		{
+			void* stack = local.back();
+			local.pop_back();
+			s_global_hits.fetch_add(1, std::memory_order_relaxed);
+			return stack;
+		}
+
+		s_misses.fetch_add(1, std::memory_order_relaxed);
+		return SystemAlloc(ClassSize(cls), guarded);
+	}
+
+	void StackPool::Dealloc(void* stack, size_t size, bool guarded)
+	{
+		if (!stack)
+		{
+			return;
+		}
+		size_t cls = SizeClass(size);
+		if (cls >= NUM_CLASSES || t_cache_dead)
+		{
+			SystemFree(stack, cls >= NUM_CLASSES ? size : ClassSize(cls), guarded);
+			s_releases.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		size_t slot = Slot(cls, guarded);
+		t_cache.free[slot].push_back(stack);
+		if (t_cache.free[slot].size() > s_high_watermark.load(std::memory_order_relaxed))
+		{
+			t_cache.flush(slot, s_low_watermark.load(std::memory_order_relaxed));
+		}
+	}
+
+	void StackPool::SetWatermarks(size_t high, size_t low)
+	{
+		if (low > high)
+		{
+			low = high;
+		}
+		s_high_watermark = high;
+		s_low_watermark = low;
+	}
+
+	void StackPool::SetGlobalLimit(size_t limit)
+	{
+		s_global_limit = limit;
+	}
+
+	void StackPool::SetGuardedStacks(bool enable)
+	{
+		s_guarded_stacks = enable;
+	}
+
+	bool StackPool::GetGuardedStacks()
+	{
+		return s_guarded_stacks.load(std::memory_order_relaxed);
+	}
+
+	StackPool::Stats StackPool::GetStats()
+	{
+		Stats stats;
+		stats.local_hits = s_local_hits.load(std::memory_order_relaxed);
+		stats.global_hits = s_global_hits.load(std::memory_order_relaxed);
+		stats.misses = s_misses.load(std::memory_order_relaxed);
+		stats.releases = s_releases.load(std::memory_order_relaxed);
+		return stats;
+	}
+}
@@ -0,0 +1,53 @@
+#ifndef _STACK_POOL_H_
+#define _STACK_POOL_H_
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+协程栈内存池
+两级缓存：线程本地缓存（无锁）+ 全局溢出层（互斥锁保护）
+按尺寸分级（64K/128K/256K/512K/1M），超过最大级别的栈直接向系统申请，不进入缓存
+可选带保护页的栈：用mmap申请，栈底（低地址端）留一页PROT_NONE，溢出时立即触发SIGSEGV而不是悄悄改写相邻内存；
+内存按页在第一次访问时才真正分配，1M的栈只有用到的部分计入RSS。两种栈分开缓存，归还时要传入分配时的guarded
+*/
+
+namespace sylar {
+
+	class StackPool
+	{
+	public:
+		//统计计数
+		struct Stats
+		{
+			uint64_t local_hits = 0;//线程本地缓存命中
+			uint64_t global_hits = 0;//全局层命中
+			uint64_t misses = 0;//未命中，向系统申请
+			uint64_t releases = 0;//超出上限，归还给系统
+		};
+
+		//分配一块至少size字节的栈，实际大小由GetAllocSize(size)给出；guarded为true时分配带保护页的mmap栈
+		//失败返回nullptr
+		static void* Alloc(size_t size, bool guarded = false);
+		//归还栈，size和guarded必须与Alloc时传入的一致
+		static void Dealloc(void* stack, size_t size, bool guarded = false);
+		//size向上取整后的实际分配大小
+		static size_t GetAllocSize(size_t size);
+
+		//线程本地缓存的高低水位：本地某级别缓存数超过high时，将多余的栈迁移到全局层，只保留low个；
+		//本地为空时，一次从全局层取回至多low个
+		static void SetWatermarks(size_t high, size_t low);
+		//全局层每个级别最多缓存的栈数量，超出部分直接释放
+		static void SetGlobalLimit(size_t limit);
+
+		//之后新建的协程是否使用带保护页的栈，默认关闭；已经分配的栈不受影响
+		static void SetGuardedStacks(bool enable);
+		static bool GetGuardedStacks();
+		//保护页大小，即系统页大小
+		static size_t GetGuardSize();
+
+		static Stats GetStats();
+	};
+}
+
+#endif
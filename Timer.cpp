@@ -1,24 +1,26 @@
 #include "Timer.h"
 
 namespace sylar {
+    //事件循环线程缓存的当前时间
+    static thread_local bool t_nowCached = false;
+    static thread_local TimerTimePoint t_now;
+    //缓存最多被使用的次数，线程一直有任务可执行、事件循环迟迟不转时限制时间的陈旧程度
+    static const uint32_t TIME_CACHE_USES = 64;
+    static thread_local uint32_t t_nowUses = 0;
+
     bool Timer::cancel()
     {
         std::unique_lock<std::shared_mutex> write_lock(m_manager -> m_mutex);//写锁互斥锁
 
-        if (m_cb == nullptr)//这里就是将回调函数如果存在设置为nullptr
+        if (!m_pending)//已经取消或者一次性定时器已经到期
         {
             return false;
         }
-        else
-        {
-            m_cb= nullptr;
-        }
+        m_pending = false;
+        m_cb = nullptr;
+        m_recurringCb.reset();
 
-        auto it = m_manager->m_timers.find(shared_from_this());//从定时管理器中找到需要删除的定时器
-        if (it != m_manager->m_timers.end())
-        {
-            m_manager->m_timers.erase(it);//删除定时器
-        }
+        m_manager->eraseTimer(shared_from_this());//从定时管理器中删除定时器
         return true;
     }
 
@@ -27,21 +29,19 @@ namespace sylar {
     {
         std::unique_lock<std::shared_mutex>write_lock(m_manager->m_mutex);
 
-        if (!m_cb)
+        if (!m_pending)
         {
             return false;
         }
 
-        auto it = m_manager->m_timers.find(shared_from_this());;//从定时管理器中找到当前定时器
-        if (it == m_manager->m_timers.end())//检查定时器是否存在
+        if (!m_manager->eraseTimer(shared_from_this()))//检查定时器是否存在
         {
             return false;
         }
 
         //删除定时器更新超时时间
-        m_manager->m_timers.erase(it);
-        m_next = std::chrono::system_clock::now() + std::chrono::milliseconds(m_ms);
-        m_manager->m_timers.insert(shared_from_this());//将新的定时器插入到定时管理器中
+        m_next = TimerManager::GetCurrentTime() + std::chrono::milliseconds(m_ms);
+        m_manager->insertTimer(shared_from_this());//将新的定时器插入到定时管理器中
         return true;
     }
     bool Timer::reset(uint64_t ms, bool from_now)
@@ -54,48 +54,95 @@ namespace sylar {
         {
             std::unique_lock<std::shared_mutex> write_lock(m_manager->m_mutex);
 
-            if (!m_cb)//为空说明定时器已被取消或未初始化，无法重置
+            if (!m_pending)//定时器已被取消或已经到期，无法重置
             {
                 return false;
             }
             
-            auto it = m_manager->m_timers.find(shared_from_this());
-            if (it == m_manager->m_timers.end())
+            if (!m_manager->eraseTimer(shared_from_this()))//删除定时器
             {
-                return false;;
+                return false;
             }
-            m_manager->m_timers.erase(it);//删除定时器
         }
 
-        auto start = from_now ? std::chrono::system_clock::now() : m_next - std::chrono::milliseconds(m_ms);//如果为true则重新计算超时时间，为false就需要上一次的起点开始
+        auto start = from_now ? TimerManager::GetCurrentTime() : m_next - std::chrono::milliseconds(m_ms);//如果为true则重新计算超时时间，为false就需要上一次的起点开始
         m_ms = ms;
         m_next = start + std::chrono::milliseconds(m_ms);
         m_manager->addTimer(shared_from_this());
         return true;
     }
-    Timer::Timer(uint64_t ms, std::function<void()>cb, bool recurring, TimerManager* manager)
-        :m_recurring(recurring), m_ms(ms), m_cb(cb), m_manager(manager)
+    Timer::Timer(uint64_t ms, Callback cb, bool recurring, TimerManager* manager)
+        :m_recurring(recurring), m_ms(ms), m_manager(manager)
     {
-        auto now = std::chrono::system_clock::now();
-        m_next = now + std::chrono::milliseconds(m_ms);//下一次超时
+        if (recurring)
+        {
+            m_recurringCb = std::make_shared<Callback>(std::move(cb));
+        }
+        else
+        {
+            m_cb = std::move(cb);
+        }
+        m_next = TimerManager::GetCurrentTime() + std::chrono::milliseconds(m_ms);//下一次超时
+    }
+
+    Callback Timer::takeCallback()
+    {
+        if (m_recurring)
+        {
+            //每次到期只多一个共享引用，回调本身不拷贝
+            std::shared_ptr<Callback> cb = m_recurringCb;
+            if (m_conditional)
+            {
+                return [cb, cond = m_cond]() {
+                    std::shared_ptr<void> tmp = cond.lock();//执行期间保持条件对象存在
+                    if (tmp)
+                    {
+                        (*cb)();
+                    }
+                };
+            }
+            return [cb]() { (*cb)(); };
+        }
+        m_pending = false;
+        if (m_conditional)
+        {
+            //条件和回调都留在定时器里，任务只持有定时器，避免把回调再包一层而放不进Callback的缓冲区
+            //定时器已不再等待触发，cancel/refresh/reset不会再访问m_cb
+            std::shared_ptr<Timer> self = shared_from_this();
+            return [self]() {
+                std::shared_ptr<void> tmp = self->m_cond.lock();
+                if (tmp)
+                {
+                    self->m_cb();
+                }
+                self->m_cb = nullptr;
+            };
+        }
+        return std::move(m_cb);
     }
 
     bool Timer::Comparator::operator()(const std::shared_ptr<Timer>& lhs, const std::shared_ptr<Timer>& rhs)const
     {
         assert(lhs != nullptr && rhs != nullptr);
-        return lhs->m_next < rhs->m_next;
+        if (lhs->m_next != rhs->m_next)
+        {
+            return lhs->m_next < rhs->m_next;
+        }
+        return lhs.get() < rhs.get();//超时时间相同的定时器不能被set当成同一个
     }
-    TimerManager::TimerManager()
+    TimerManager::TimerManager(Backend backend)
+        :m_backend(backend)
     {
-        m_previousTime = std::chrono::system_clock::now();//初始化系统时间
+        m_wheelBase = GetCurrentTime();
+        m_wheelWake = TimerTimePoint::max();
     }
     TimerManager::~TimerManager()
     {
 
     }
-    std::shared_ptr<Timer>TimerManager::addTimer(uint64_t ms, std::function<void()>cb, bool recurring)
+    std::shared_ptr<Timer>TimerManager::addTimer(uint64_t ms, Callback cb, bool recurring)
     {
-        std::shared_ptr<Timer>timer(new Timer(ms, cb, recurring, this));
+        std::shared_ptr<Timer>timer(new Timer(ms, std::move(cb), recurring, this));
         addTimer(timer);
         return timer;
     }
@@ -105,8 +152,7 @@ namespace sylar {
         bool at_front = false;//表示插入的是最早超时的定时器
         {
             std::unique_lock<std::shared_mutex>write_lock(m_mutex);
-            auto it = m_timers.insert(timer).first;
-            at_front = (it == m_timers.begin()) && !m_tickled;;//判断插入的定时器是否是集合超时时间中最早的定时器
+            at_front = insertTimer(timer) && !m_tickled;//判断插入的定时器是否是集合超时时间中最早的定时器
             if (at_front)//有一个新的最早定时器被插入
             {
                 m_tickled = true;
@@ -118,31 +164,42 @@ namespace sylar {
         }
     }
 
-    //如果条件存在->执行cb()
-    static void onTimer(std::weak_ptr<void>weak_cond, std::function<void()>cb)
-    {
-        std::shared_ptr<void>tmp = weak_cond.lock();//确保对象依然存在
-        if (tmp)
-        {
-            cb();
-        }
-    }
-    std::shared_ptr<Timer>TimerManager::addConditionTimer(uint64_t ms, std::function<void()>cb, std::weak_ptr<void>weak_cond, bool recurring)
+    //条件在回调执行时检查，见Timer::takeCallback
+    std::shared_ptr<Timer>TimerManager::addConditionTimer(uint64_t ms, Callback cb, std::weak_ptr<void>weak_cond, bool recurring)
     {
-        return addTimer(ms, std::bind(&onTimer, weak_cond, cb), recurring);//将OnTImer的真正指向交给了第一个addtimer
-                                                                             //然后创建timer对象。
+        std::shared_ptr<Timer>timer(new Timer(ms, std::move(cb), recurring, this));
+        timer->m_cond = std::move(weak_cond);
+        timer->m_conditional = true;
+        addTimer(timer);
+        return timer;
     }
     uint64_t TimerManager::getNextTimer()
     {
-        std::shared_lock<std::shared_mutex>read_lock(m_mutex);//读锁
+        //会修改m_tickled和m_wheelWake，需要写锁
+        std::unique_lock<std::shared_mutex>write_lock(m_mutex);
 
         m_tickled = false;
+        //算等待时长必须读真实时间，本线程的缓存可能在执行其他任务期间已经过期
+        auto now = TimerClock::now();
+        if (m_backend == WHEEL)
+        {
+            uint64_t tick = m_wheel.nextTick();
+            if (tick == ~0ull)
+            {
+                m_wheelWake = TimerTimePoint::max();
+                return ~0ull;
+            }
+            m_wheelWake = m_wheelBase + std::chrono::milliseconds(tick);
+            uint64_t now_tick = now > m_wheelBase ?
+                std::chrono::duration_cast<std::chrono::milliseconds>(now - m_wheelBase).count() : 0;
+            return tick > now_tick ? tick - now_tick : 0;
+        }
+
         if (m_timers.empty())
         {
             return ~0ull;//最大值
         }
 
-        auto now = std::chrono::system_clock::now();
         auto time = (*m_timers.begin())->m_next;
 
         if (now > time)
@@ -155,52 +212,108 @@ namespace sylar {
             return static_cast<uint64_t>(duration.count());
         }
     }
-    void TimerManager::listExpiredCb(std::vector<std::function<void()>>& cbs)
+    void TimerManager::listExpiredCb(std::vector<Callback>& cbs)
     {
-        auto now = std::chrono::system_clock::now();
+        auto now = GetCurrentTime();
         std::unique_lock<std::shared_mutex>write_lock(m_mutex);
 
-        bool rollover = detectClockRollover();//判断系统时间是否出错
-        //回退 ->清理所有timer ||超时 清洗超时timer 如果 rolover false就没发生系统时间回退
-        //如果时间回滚发生或者定时器的超时时间早于或等于当前时间，则需要处理这些定时器。
-        // 为什么说早于或等于都要处理，因为超时时间都是基于now后的
-        while (!m_timers.empty() && (rollover || (*m_timers.begin())->m_next <= now))
+        if (m_backend == WHEEL)
+        {
+            std::vector<std::shared_ptr<Timer>> expired;
+            if (now >= m_wheelBase)
+            {
+                m_wheel.advance(std::chrono::duration_cast<std::chrono::milliseconds>(now - m_wheelBase).count(), expired);
+            }
+            for (auto& temp : expired)
+            {
+                cbs.push_back(temp->takeCallback());
+                if (temp->m_recurring)
+                {
+                    temp->m_next = now + std::chrono::milliseconds(temp->m_ms);
+                    m_wheel.add(temp, toTick(temp->m_next));
+                }
+            }
+            return;
+        }
+        //单调时钟不会回退，只需处理超时时间早于或等于当前时间的定时器
+        while (!m_timers.empty() && (*m_timers.begin())->m_next <= now)
         {
             std::shared_ptr<Timer>temp = *m_timers.begin();
             m_timers.erase(m_timers.begin());
 
-            cbs.push_back(temp->m_cb);
+            cbs.push_back(temp->takeCallback());
             //如果定时器循环，m_next设置为当前时间加上定时器间隔
             if (temp->m_recurring)
             {
                 temp->m_next = now + std::chrono::milliseconds(temp->m_ms);
                 m_timers.insert(temp);
             }
-            else
-            {
-                temp->m_cb = nullptr;
-            }
         }
     }
-    bool TimerManager::detectClockRollover()
+    bool TimerManager::insertTimer(const std::shared_ptr<Timer>& timer)
+    {
+        if (m_backend == WHEEL)
+        {
+            m_wheel.add(timer, toTick(timer->m_next));
+            return timer->m_next < m_wheelWake;//比上次承诺的唤醒时间还早
+        }
+        auto it = m_timers.insert(timer).first;
+        return it == m_timers.begin();
+    }
+
+    bool TimerManager::eraseTimer(const std::shared_ptr<Timer>& timer)
+    {
+        if (m_backend == WHEEL)
+        {
+            return m_wheel.remove(timer.get());
+        }
+        auto it = m_timers.find(timer);
+        if (it == m_timers.end())
+        {
+            return false;
+        }
+        m_timers.erase(it);
+        return true;
+    }
+
+    uint64_t TimerManager::toTick(const TimerTimePoint& tp) const
     {
-        bool rollover = false;
+        if (tp <= m_wheelBase)
+        {
+            return 0;
+        }
+        return std::chrono::ceil<std::chrono::milliseconds>(tp - m_wheelBase).count();
+    }
 
-        //比较当前now与上次m_oreviousTime减去一个小时时间量(60*60*1000)
-        //如果小于则说明系统时间回退了
-        auto now = std::chrono::system_clock::now();
-        if (now < m_previousTime - std::chrono::milliseconds(60 * 60 * 1000))
+    TimerTimePoint TimerManager::GetCurrentTime()
+    {
+        if (!t_nowCached)
+        {
+            return TimerClock::now();
+        }
+        if (++t_nowUses >= TIME_CACHE_USES)
         {
-            rollover = true;
+            return UpdateCurrentTime();
         }
-        m_previousTime = now;
-        return rollover;
+        return t_now;
+    }
 
+    TimerTimePoint TimerManager::UpdateCurrentTime()
+    {
+        t_now = TimerClock::now();
+        t_nowCached = true;
+        t_nowUses = 0;
+        return t_now;
+    }
+
+    void TimerManager::ClearCurrentTime()
+    {
+        t_nowCached = false;
     }
 
     bool TimerManager::hasTimer()
     {
         std::shared_lock<std::shared_mutex>read_lock(m_mutex);
-        return !m_timers.empty();
+        return m_backend == WHEEL ? m_wheel.size() > 0 : !m_timers.empty();
     }
 }
\ No newline at end of file
@@ -1,26 +1,6 @@
 #ifndef __SYLAR_TIMER_H__
 #define __SYLAR_TIMER_H__
 
-#include<memory>//����ָ��
-#include<vector>
-#include<set>
-#include<shared_mutex>
-#include<assert.h>
-#include<functional>
-#include<mutex>
-
-namespace sylar {
-	class TimerManager;//��ʱ��������
-	//�̳е�public��������������ָ��timer��thisֵ
-	class Timer :public std::enable_shared_from_this<Timer>
-	{
-		friend class TimerManager;//���ó���Ԫ
-	public:
-		//��ʱ���ɾ��timer
-		bool cancel();
-		//ˢ��timer#ifndef __SYLAR_TIMER_H__
-#define __SYLAR_TIMER_H__
-
 #include<memory>//智能指针
 #include<vector>
 #include<set>
@@ -28,13 +8,21 @@ namespace sylar {
 #include<assert.h>
 #include<functional>
 #include<mutex>
+#include<chrono>
+#include"TimingWheel.h"
+#include"InlineFunction.h"
 
 namespace sylar {
+	//定时器统一使用单调时钟，不受系统时间调整影响
+	typedef std::chrono::steady_clock TimerClock;
+	typedef TimerClock::time_point TimerTimePoint;
+
 	class TimerManager;//定时器管理类
 	//继承的public是用来返回智能指针timer的this值
 	class Timer :public std::enable_shared_from_this<Timer>
 	{
 		friend class TimerManager;//设置成友元
+		friend class TimingWheel;
 	public:
 		//从时间堆删除timer
 		bool cancel();
@@ -44,18 +32,35 @@ namespace sylar {
 		//1执行间隔ms，2是否从当前时间开始计算
 		bool reset(uint64_t ms, bool from_now);
 	private:
-		Timer(uint64_t ms,std::function<void()>cb, bool recurring,TimerManager* manager);
+		Timer(uint64_t ms, Callback cb, bool recurring, TimerManager* manager);
+		//到期时取出交给调度器执行的任务，调用时持有管理器的写锁
+		Callback takeCallback();
 	    //是否循环
 		bool m_recurring = false;
 		//超时时间
 		uint64_t m_ms = 0;
 		//绝对超时时间，即该定时器下次触发时间点
-		std::chrono::time_point<std::chrono::system_clock> m_next;
-		//超时触发回调函数
-		std::function<void()>m_cb;
+		TimerTimePoint m_next;
+		//超时触发回调函数：一次性定时器到期时移出交给调度器；条件定时器留在这里，由到期后的任务检查条件再调用
+		Callback m_cb;
+		//循环定时器每次到期都要执行同一个回调，放在共享对象里，取消时不影响正在执行的那一次
+		std::shared_ptr<Callback> m_recurringCb;
+		//条件定时器的条件对象，回调执行时它已销毁则不执行
+		std::weak_ptr<void> m_cond;
+		bool m_conditional = false;
+		//还在等待触发：取消或一次性定时器到期之后为false，由管理器的锁保护
+		bool m_pending = true;
 		//管理此timer管理器
 		TimerManager* m_manager = nullptr;
-	    //实现最小堆的比较函数，比较两个Timer，依据绝对超时时间
+
+		//时间轮后端使用：所在槽位的侵入式双向链表，挂在轮上时通过m_wheelRef持有自身
+		Timer* m_wheelPrev = nullptr;
+		Timer* m_wheelNext = nullptr;
+		TimingWheel::Slot* m_wheelSlot = nullptr;
+		uint64_t m_wheelTick = 0;
+		std::shared_ptr<Timer> m_wheelRef;
+
+	    //实现最小堆的比较函数，比较两个Timer，依据绝对超时时间，相同时按地址区分
 		struct Comparator
 		{
 			bool operator()(const std::shared_ptr<Timer>& lhs, const std::shared_ptr<Timer>& rhs) const;
@@ -65,29 +70,47 @@ namespace sylar {
 	{
 		friend class Timer;
 	public:
-		TimerManager();//构造函数
+		//定时器存储后端
+		enum Backend
+		{
+			RBTREE,//有序集合，插入删除O(log n)，最近超时时间精确
+			WHEEL//分层时间轮，插入删除O(1)，精度1ms
+		};
+
+		TimerManager(Backend backend = RBTREE);//构造函数
 		virtual ~TimerManager();
 
 		//添加timer
 		//ms定时器执行间隔时间
 		//cb定时器执行回调函数
 		//recurring是否循环
-        std::shared_ptr<Timer> addTimer(uint64_t ms, std::function<void()> cb, bool recurring = false);
-	    
+        std::shared_ptr<Timer> addTimer(uint64_t ms, Callback cb, bool recurring = false);
+
 
 		//添加条件timer
 		//weak_cond
-		std::shared_ptr<Timer> addConditionTimer(uint64_t ms, std::function<void()> cb, std::weak_ptr<void> weak_cond, bool recurring = false);
+		std::shared_ptr<Timer> addConditionTimer(uint64_t ms, Callback cb, std::weak_ptr<void> weak_cond, bool recurring = false);
 
 		//拿到堆最近超时时间
+		//时间轮后端返回的是不晚于最近超时时间的唤醒时间
 		uint64_t getNextTimer();
 
-		//取出所有超时定时器的回调函数
-		void listExpiredCb(std::vector<std::function<void()>>& cbs);
+		//取出所有超时定时器的回调函数，一次性定时器的回调直接移出，不拷贝
+		void listExpiredCb(std::vector<Callback>& cbs);
 
 		//堆中是否有定时器timer
 		bool hasTimer();
 
+		Backend getBackend() const { return m_backend; }
+
+		//当前时间：在IOManager事件循环线程上返回本轮循环缓存的时间（至多复用64次），其他线程直接读时钟
+		//定时器的起点因此是本轮循环开始的时间，长时间运行的任务可以先调用UpdateCurrentTime()
+		static TimerTimePoint GetCurrentTime();
+		//重新读取时钟并缓存到当前线程，事件循环每轮调用
+		static TimerTimePoint UpdateCurrentTime();
+		//当前线程退出事件循环时清除缓存，之后回到直接读时钟
+		static void ClearCurrentTime();
+
 	protected:
 		//当一个最早的timer加入堆中，调用它
 		virtual void onTimerInsertedAtFront() {};
@@ -96,90 +119,27 @@ namespace sylar {
 		void addTimer(std::shared_ptr<Timer> timer);
 
 	private:
-		//当系统时间改变
-		bool detectClockRollover();
+		//以下在持有写锁时调用，按后端插入/删除定时器
+		//插入返回是否成为最早超时的定时器
+		bool insertTimer(const std::shared_ptr<Timer>& timer);
+		bool eraseTimer(const std::shared_ptr<Timer>& timer);
+		//时间点换算成时间轮的tick（向上取整，保证不会提前触发）
+		uint64_t toTick(const TimerTimePoint& tp) const;
+
 		std::shared_mutex m_mutex;
+		Backend m_backend;
 		//时间堆,存储所有的 Timer 对象，
 		// 并使用 Timer::Comparator 进行排序，确保最早超时的 Timer 在最前面。
 		std::set<std::shared_ptr<Timer>, Timer::Comparator> m_timers;
+		//时间轮及其起点
+		TimingWheel m_wheel;
+		TimerTimePoint m_wheelBase;
+		//时间轮后端上一次getNextTimer()承诺的唤醒时间点，更早的定时器插入时需要通知
+		TimerTimePoint m_wheelWake;
 
 		//在下次获取最近超时时间前检查onTimerInsertedAtFront是否被触发-》在此过程中 onTimerInsertedAtFront()只执行一次。防止重复调用
 	  bool m_tickled = false;
-	  //上次检查时间是否回退的绝对时间
-	  std::chrono::time_point<std::chrono::system_clock> m_previousTime;
-	
-	};
-}
-#endif
-		bool refresh();
-		//����timer��ʱʱ��
-		//1ִ�м��ms��2�Ƿ�ӵ�ǰʱ�俪ʼ����
-		bool reset(uint64_t ms, bool from_now);
-	private:
-		Timer(uint64_t ms,std::function<void()>cb, bool recurring,TimerManager* manager);
-	    //�Ƿ�ѭ��
-		bool m_recurring = false;
-		//��ʱʱ��
-		uint64_t m_ms = 0;
-		//���Գ�ʱʱ�䣬���ö�ʱ���´δ���ʱ���
-		std::chrono::time_point<std::chrono::system_clock> m_next;
-		//��ʱ�����ص�����
-		std::function<void()>m_cb;
-		//������timer������
-		TimerManager* m_manager = nullptr;
-	    //ʵ����С�ѵıȽϺ������Ƚ�����Timer�����ݾ��Գ�ʱʱ��
-		struct Comparator
-		{
-			bool operator()(const std::shared_ptr<Timer>& lhs, const std::shared_ptr<Timer>& rhs) const;
-		};
-	};
-	class TimerManager
-	{
-		friend class Timer;
-	public:
-		TimerManager();//���캯��
-		virtual ~TimerManager();
 
-		//����timer
-		//ms��ʱ��ִ�м��ʱ��
-		//cb��ʱ��ִ�лص�����
-		//recurring�Ƿ�ѭ��
-        std::shared_ptr<Timer> addTimer(uint64_t ms, std::function<void()> cb, bool recurring = false);
-	    
-
-		//��������timer
-		//weak_cond
-		std::shared_ptr<Timer> addConditionTimer(uint64_t ms, std::function<void()> cb, std::weak_ptr<void> weak_cond, bool recurring = false);
-
-		//�õ��������ʱʱ��
-		uint64_t getNextTimer();
-
-		//ȡ�����г�ʱ��ʱ���Ļص�����
-		void listExpiredCb(std::vector<std::function<void()>>& cbs);
-
-		//�����Ƿ��ж�ʱ��timer
-		bool hasTimer();
-
-	protected:
-		//��һ�������timer������У�������
-		virtual void onTimerInsertedAtFront() {};
-
-		//����timer
-		void addTimer(std::shared_ptr<Timer> timer);
-
-	private:
-		//��ϵͳʱ��ı�
-		bool detectClockRollover();
-		std::shared_mutex m_mutex;
-		//ʱ���,�洢���е� Timer ����
-		// ��ʹ�� Timer::Comparator ��������ȷ�����糬ʱ�� Timer ����ǰ�档
-		std::set<std::shared_ptr<Timer>, Timer::Comparator> m_timers;
-
-		//���´λ�ȡ�����ʱʱ��ǰ���onTimerInsertedAtFront�Ƿ񱻴���-���ڴ˹����� onTimerInsertedAtFront()ִֻ��һ�Ρ���ֹ�ظ�����
-	  bool m_tickled = false;
-	  //�ϴμ��ʱ���Ƿ���˵ľ���ʱ��
-	  std::chrono::time_point<std::chrono::system_clock> m_previousTime;
-	
 	};
 }
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,284 @@
+#include "TimingWheel.h"
+#include "Timer.h"
+
+namespace sylar {
+
+	//最高层能表示的最大距离
+	static const uint64_t MAX_DELTA = ((uint64_t)1 << 32) - 1;
+
+	TimingWheel::TimingWheel()
+	{
+		for (int i = 0; i < ROOT_SIZE; i++)
+		{
+			m_root[i].level = 0;
+			m_root[i].index = i;
+		}
+		for (int l = 0; l < LEVELS - 1; l++)
+		{
+			for (int i = 0; i < LEVEL_SIZE; i++)
+			{
+				m_levels[l][i].level = l + 1;
+				m_levels[l][i].index = i;
+			}
+		}
+		for (int i = 0; i < ROOT_SIZE / 64; i++)
+		{
+			m_rootBitmap[i] = 0;
+		}
+		for (int l = 0; l < LEVELS; l++)
+		{
+			m_levelCount[l] = 0;
+		}
+	}
+
+	TimingWheel::~TimingWheel()
+	{
+		//释放轮上持有的引用，打破Timer自引用
+		std::vector<std::shared_ptr<Timer>> all;
+		clear(all);
+	}
+
+	void TimingWheel::add(const std::shared_ptr<Timer>& timer, uint64_t tick)
+	{
+		if (timer->m_wheelSlot)
+		{
+			unlink(timer.get());
+			m_size--;
+		}
+		timer->m_wheelTick = tick;
+		timer->m_wheelRef = timer;
+		link(timer.get());
+		m_size++;
+	}
+
+	bool TimingWheel::remove(Timer* timer)
+	{
+		if (!timer->m_wheelSlot)
+		{
+			return false;
+		}
+		unlink(timer);
+		m_size--;
+		//可能是最后一个引用，放到最后
+		std::shared_ptr<Timer> ref = std::move(timer->m_wheelRef);
+		return true;
+	}
+
+	void TimingWheel::link(Timer* timer)
+	{
+		uint64_t tick = timer->m_wheelTick < m_current ? m_current : timer->m_wheelTick;
+		uint64_t delta = tick - m_current;
+		if (delta > MAX_DELTA)//太远的先按最大距离放置，真正的tick保留在m_wheelTick里
+		{
+			delta = MAX_DELTA;
+			tick = m_current + MAX_DELTA;
+		}
+
+		Slot* slot = nullptr;
+		if (delta < (uint64_t)ROOT_SIZE)
+		{
+			int index = (int)(tick & (ROOT_SIZE - 1));
+			slot = &m_root[index];
+			m_rootBitmap[index >> 6] |= (uint64_t)1 << (index & 63);
+		}
+		else
+		{
+			int level = 1;
+			while (level < LEVELS - 1 && delta >= ((uint64_t)1 << (ROOT_BITS + LEVEL_BITS * level)))
+			{
+				level++;
+			}
+			int shift = ROOT_BITS + LEVEL_BITS * (level - 1);
+			slot = &m_levels[level - 1][(tick >> shift) & (LEVEL_SIZE - 1)];
+		}
+
+		timer->m_wheelSlot = slot;
+		timer->m_wheelPrev = nullptr;
+		timer->m_wheelNext = slot->head;
+		if (slot->head)
+		{
+			slot->head->m_wheelPrev = timer;
+		}
+		slot->head = timer;
+		m_levelCount[slot->level]++;
+	}
+
+	void TimingWheel::unlink(Timer* timer)
+	{
+		Slot* slot = timer->m_wheelSlot;
+		if (timer->m_wheelPrev)
+		{
+			timer->m_wheelPrev->m_wheelNext = timer->m_wheelNext;
+		}
+		else
+		{
+			slot->head = timer->m_wheelNext;
+		}
+		if (timer->m_wheelNext)
+		{
+			timer->m_wheelNext->m_wheelPrev = timer->m_wheelPrev;
+		}
+		if (slot->level == 0 && !slot->head)
+		{
+			m_rootBitmap[slot->index >> 6] &= ~((uint64_t)1 << (slot->index & 63));
+		}
+		m_levelCount[slot->level]--;
+		timer->m_wheelSlot = nullptr;
+		timer->m_wheelPrev = nullptr;
+		timer->m_wheelNext = nullptr;
+	}
+
+	void TimingWheel::cascade(int level, int index)
+	{
+		Slot& slot = m_levels[level - 1][index];
+		Timer* timer = slot.head;
+		slot.head = nullptr;
+		while (timer)
+		{
+			Timer* next = timer->m_wheelNext;
+			m_levelCount[level]--;
+			timer->m_wheelSlot = nullptr;
+			link(timer);
+			timer = next;
+		}
+	}
+
+	int TimingWheel::findRoot(int from) const
+	{
+		for (int word = from >> 6; word < ROOT_SIZE / 64; word++)
+		{
+			uint64_t bits = m_rootBitmap[word];
+			if (word == (from >> 6))
+			{
+				bits &= ~(uint64_t)0 << (from & 63);
+			}
+			if (bits)
+			{
+				return (word << 6) + __builtin_ctzll(bits);
+			}
+		}
+		return ROOT_SIZE;
+	}
+
+	void TimingWheel::advance(uint64_t now, std::vector<std::shared_ptr<Timer>>& expired)
+	{
+		while (m_current <= now)
+		{
+			if (m_size == 0)
+			{
+				m_current = now + 1;
+				break;
+			}
+
+			int index = (int)(m_current & (ROOT_SIZE - 1));
+			if (index == 0)//第0层转完一圈，逐层级联
+			{
+				for (int level = 1; level < LEVELS; level++)
+				{
+					int shift = ROOT_BITS + LEVEL_BITS * (level - 1);
+					int slot = (int)((m_current >> shift) & (LEVEL_SIZE - 1));
+					if (m_levelCount[level])
+					{
+						cascade(level, slot);
+					}
+					if (slot != 0)
+					{
+						break;
+					}
+				}
+			}
+
+			//跳过本圈内的空槽，下一圈的边界还要级联，不能越过
+			int found = findRoot(index);
+			if (found != index)
+			{
+				uint64_t next = (m_current & ~(uint64_t)(ROOT_SIZE - 1)) + found;
+				m_current = next <= now ? next : now + 1;
+				continue;
+			}
+
+			Slot& slot = m_root[index];
+			Timer* timer = slot.head;
+			slot.head = nullptr;
+			m_rootBitmap[index >> 6] &= ~((uint64_t)1 << (index & 63));
+			while (timer)
+			{
+				Timer* next = timer->m_wheelNext;
+				m_levelCount[0]--;
+				timer->m_wheelSlot = nullptr;
+				timer->m_wheelPrev = nullptr;
+				timer->m_wheelNext = nullptr;
+				if (timer->m_wheelTick > m_current)//按最大距离放置的超远定时器，还没到期
+				{
+					link(timer);
+				}
+				else
+				{
+					m_size--;
+					expired.push_back(std::move(timer->m_wheelRef));
+				}
+				timer = next;
+			}
+			m_current++;
+		}
+	}
+
+	void TimingWheel::clear(std::vector<std::shared_ptr<Timer>>& out)
+	{
+		for (int l = 0; l < LEVELS; l++)
+		{
+			int count = l == 0 ? ROOT_SIZE : LEVEL_SIZE;
+			for (int i = 0; i < count; i++)
+			{
+				Slot& slot = l == 0 ? m_root[i] : m_levels[l - 1][i];
+				Timer* timer = slot.head;
+				slot.head = nullptr;
+				while (timer)
+				{
+					Timer* next = timer->m_wheelNext;
+					timer->m_wheelSlot = nullptr;
+					timer->m_wheelPrev = nullptr;
+					timer->m_wheelNext = nullptr;
+					out.push_back(std::move(timer->m_wheelRef));
+					timer = next;
+				}
+			}
+			m_levelCount[l] = 0;
+		}
+		for (int i = 0; i < ROOT_SIZE / 64; i++)
+		{
+			m_rootBitmap[i] = 0;
+		}
+		m_size = 0;
+	}
+
+	uint64_t TimingWheel::nextTick() const
+	{
+		if (m_size == 0)
+		{
+			return ~0ull;
+		}
+		int index = (int)(m_current & (ROOT_SIZE - 1));
+		//停在一圈的起点时这一圈还没有级联，上层的定时器可能就在这一圈内到期
+		if (index == 0 && m_levelCount[0] != m_size)
+		{
+			return m_current;
+		}
+		uint64_t base = m_current & ~(uint64_t)(ROOT_SIZE - 1);
+		int found = findRoot(index);
+		if (found < ROOT_SIZE)
+		{
+			return base + found;
+		}
+		//本圈没有，下一圈的边界是下界；上层没有定时器时可以直接找第0层回绕的槽
+		if (m_levelCount[0] == m_size)
+		{
+			found = findRoot(0);
+			if (found < index)
+			{
+				return base + ROOT_SIZE + found;
+			}
+		}
+		return base + ROOT_SIZE;
+	}
+}
@@ -0,0 +1,75 @@
+#ifndef _TIMING_WHEEL_H_
+#define _TIMING_WHEEL_H_
+
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/*
+分层时间轮，TimerManager的WHEEL后端
+5层：第0层256个槽，每槽1个tick；第1~4层各64个槽，每槽跨度依次是256、2^14、2^20、2^26个tick
+每个槽是Timer的侵入式双向链表，插入和删除都是O(1)，不做任何内存分配
+推进到某层的边界时把上一层对应槽里的定时器重新分配（级联）到下层
+超出2^32个tick（1ms精度约49天）的定时器先挂在最高层，到期前会被重新放置
+不加锁，由TimerManager的写锁保护
+*/
+
+namespace sylar {
+
+	class Timer;
+
+	class TimingWheel
+	{
+	public:
+		struct Slot
+		{
+			Timer* head = nullptr;
+			int level = 0;
+			int index = 0;
+		};
+
+		TimingWheel();
+		~TimingWheel();
+
+		//在tick到期，tick早于当前进度的按当前进度处理
+		void add(const std::shared_ptr<Timer>& timer, uint64_t tick);
+		//从轮上摘除，不在轮上返回false
+		bool remove(Timer* timer);
+		//推进到now（包含），到期的定时器追加到expired
+		void advance(uint64_t now, std::vector<std::shared_ptr<Timer>>& expired);
+		//摘除所有定时器追加到out
+		void clear(std::vector<std::shared_ptr<Timer>>& out);
+		//最早可能有定时器到期的tick（下界），没有定时器返回~0ull
+		uint64_t nextTick() const;
+
+		size_t size() const { return m_size; }
+		//下一个待处理的tick
+		uint64_t current() const { return m_current; }
+
+	private:
+		static const int LEVELS = 5;
+		static const int ROOT_BITS = 8;
+		static const int LEVEL_BITS = 6;
+		static const int ROOT_SIZE = 1 << ROOT_BITS;
+		static const int LEVEL_SIZE = 1 << LEVEL_BITS;
+
+		//按m_current计算所在的槽并挂入
+		void link(Timer* timer);
+		void unlink(Timer* timer);
+		//把level层index槽中的定时器重新放置
+		void cascade(int level, int index);
+		//第0层从from开始第一个非空槽，没有返回ROOT_SIZE
+		int findRoot(int from) const;
+
+		Slot m_root[ROOT_SIZE];
+		Slot m_levels[LEVELS - 1][LEVEL_SIZE];
+		//第0层非空槽位图，用于快速跳过空槽
+		uint64_t m_rootBitmap[ROOT_SIZE / 64];
+		size_t m_levelCount[LEVELS];
+		uint64_t m_current = 0;
+		size_t m_size = 0;
+	};
+}
+
+#endif
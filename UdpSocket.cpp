@@ -0,0 +1,231 @@
+#include "UdpSocket.h"
+#include "Hook.h"
+#include "Fd_manager.h"
+#include "IOManager.h"
+
+#include <netinet/udp.h>
+#include <sys/time.h>
+#include <cstring>
+#include <cerrno>
+#include <iostream>
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+namespace sylar {
+
+	//每个缓冲区的控制消息空间，只用来接收GRO的段大小
+	static const size_t CONTROL_SIZE = CMSG_SPACE(sizeof(int));
+
+	UdpSocket::RecvBatch::RecvBatch(size_t count, size_t buffer_size)
+		:m_bufferSize(buffer_size)
+		, m_buffers(count * buffer_size)
+		, m_msgs(count)
+		, m_iovs(count)
+		, m_addrs(count)
+		, m_control(count * CONTROL_SIZE)
+		, m_segments(count, 0)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			m_iovs[i].iov_base = &m_buffers[i * m_bufferSize];
+			memset(&m_msgs[i], 0, sizeof(mmsghdr));
+			msghdr& hdr = m_msgs[i].msg_hdr;
+			hdr.msg_iov = &m_iovs[i];
+			hdr.msg_iovlen = 1;
+			hdr.msg_name = &m_addrs[i];
+			hdr.msg_control = &m_control[i * CONTROL_SIZE];
+		}
+	}
+
+	void UdpSocket::RecvBatch::prepare()
+	{
+		m_received = 0;
+		for (size_t i = 0; i < m_msgs.size(); i++)
+		{
+			m_iovs[i].iov_len = m_bufferSize;
+			msghdr& hdr = m_msgs[i].msg_hdr;
+			hdr.msg_namelen = sizeof(sockaddr_storage);
+			hdr.msg_controllen = CONTROL_SIZE;
+			hdr.msg_flags = 0;
+		}
+	}
+
+	void UdpSocket::RecvBatch::parse(size_t received)
+	{
+		m_received = received;
+		for (size_t i = 0; i < received; i++)
+		{
+			m_segments[i] = 0;
+			msghdr& hdr = m_msgs[i].msg_hdr;
+			for (cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr); cmsg; cmsg = CMSG_NXTHDR(&hdr, cmsg))
+			{
+				if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO)
+				{
+					int seg;
+					memcpy(&seg, CMSG_DATA(cmsg), sizeof(seg));
+					//只有一段时内核也可能带上段大小，不需要拆
+					m_segments[i] = (size_t)seg < m_msgs[i].msg_len ? seg : 0;
+				}
+			}
+		}
+	}
+
+	UdpSocket::SendBatch::SendBatch(size_t reserve)
+	{
+		m_msgs.reserve(reserve);
+		m_iovs.reserve(reserve);
+	}
+
+	void UdpSocket::SendBatch::add(const void* data, size_t len, const sockaddr* addr, socklen_t addrlen)
+	{
+		iovec iov;
+		iov.iov_base = (void*)data;
+		iov.iov_len = len;
+		m_iovs.push_back(iov);
+
+		mmsghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_hdr.msg_name = (void*)addr;
+		msg.msg_hdr.msg_namelen = addr ? addrlen : 0;
+		msg.msg_hdr.msg_iovlen = 1;//msg_iov在发送前指向m_iovs，vector扩容会让之前的指针失效
+		m_msgs.push_back(msg);
+	}
+
+	void UdpSocket::SendBatch::clear()
+	{
+		m_msgs.clear();
+		m_iovs.clear();
+	}
+
+	UdpSocket::UdpSocket(int family)
+	{
+		m_fd = ::socket(family, SOCK_DGRAM, 0);
+		if (m_fd == -1)
+		{
+			std::cerr << "UdpSocket::socket() failed: " << strerror(errno) << std::endl;
+			return;
+		}
+		//在开启hook的协程中创建时登记FdCtx，底层设为非阻塞，之后的收发挂起协程而不是阻塞线程；
+		//没开hook时保持阻塞，收发和普通的socket一样阻塞线程
+		if (is_hook_enable())
+		{
+			FdMgr::GetInstance()->get(m_fd, true);
+		}
+	}
+
+	UdpSocket::~UdpSocket()
+	{
+		close();
+	}
+
+	bool UdpSocket::bind(const sockaddr* addr, socklen_t addrlen)
+	{
+		return ::bind(m_fd, addr, addrlen) == 0;
+	}
+
+	bool UdpSocket::connect(const sockaddr* addr, socklen_t addrlen)
+	{
+		//UDP的connect只记录对端地址，不会阻塞，不需要走hook的超时逻辑
+		return connect_f(m_fd, addr, addrlen) == 0;
+	}
+
+	bool UdpSocket::setTimeout(int type, uint64_t ms)
+	{
+		FdCtx* ctx = FdMgr::GetInstance()->get(m_fd);
+		if (ctx)
+		{
+			ctx->setTimeout(type, ms);
+			return true;
+		}
+		//没有FdCtx的阻塞socket交给内核计时
+		timeval tv = { (time_t)(ms / 1000), (suseconds_t)(ms % 1000 * 1000) };
+		return setsockopt_f(m_fd, SOL_SOCKET, type, &tv, sizeof(tv)) == 0;
+	}
+
+	bool UdpSocket::setRecvTimeout(uint64_t ms)
+	{
+		return setTimeout(SO_RCVTIMEO, ms);
+	}
+
+	bool UdpSocket::setSendTimeout(uint64_t ms)
+	{
+		return setTimeout(SO_SNDTIMEO, ms);
+	}
+
+	bool UdpSocket::setSendSegmentSize(uint16_t size)
+	{
+		int value = size;
+		return setsockopt_f(m_fd, SOL_UDP, UDP_SEGMENT, &value, sizeof(value)) == 0;
+	}
+
+	bool UdpSocket::setGro(bool enable)
+	{
+		int value = enable ? 1 : 0;
+		return setsockopt_f(m_fd, SOL_UDP, UDP_GRO, &value, sizeof(value)) == 0;
+	}
+
+	int UdpSocket::recv(RecvBatch& batch)
+	{
+		batch.prepare();
+		//非阻塞socket有一个就返回，队列为空时hook挂起协程；阻塞socket靠MSG_WAITFORONE在收到第一个之后不再等整批收满
+		int n = ::recvmmsg(m_fd, batch.m_msgs.data(), batch.m_msgs.size(), MSG_WAITFORONE, nullptr);
+		if (n > 0)
+		{
+			batch.parse(n);
+		}
+		return n;
+	}
+
+	int UdpSocket::send(SendBatch& batch)
+	{
+		for (size_t i = 0; i < batch.m_msgs.size(); i++)
+		{
+			batch.m_msgs[i].msg_hdr.msg_iov = &batch.m_iovs[i];
+		}
+		size_t sent = 0;
+		while (sent < batch.m_msgs.size())
+		{
+			//一次最多发出UIO_MAXIOV个，发送缓冲区满时只发出一部分，hook在EAGAIN时挂起
+			int n = ::sendmmsg(m_fd, &batch.m_msgs[sent], batch.m_msgs.size() - sent, 0);
+			if (n == -1)
+			{
+				return sent ? (int)sent : -1;
+			}
+			sent += n;
+		}
+		return (int)sent;
+	}
+
+	ssize_t UdpSocket::recvFrom(void* buf, size_t len, sockaddr* addr, socklen_t* addrlen)
+	{
+		return ::recvfrom(m_fd, buf, len, 0, addr, addrlen);
+	}
+
+	ssize_t UdpSocket::sendTo(const void* buf, size_t len, const sockaddr* addr, socklen_t addrlen)
+	{
+		return ::sendto(m_fd, buf, len, 0, addr, addrlen);
+	}
+
+	int UdpSocket::close()
+	{
+		if (m_fd == -1)
+		{
+			return 0;
+		}
+		//和hook的close一样先取消事件、注销FdCtx，析构可能发生在没开hook的线程上
+		IOManager* iom = IOManager::GetThis();
+		if (iom)
+		{
+			iom->cancelAll(m_fd);
+		}
+		FdMgr::GetInstance()->del(m_fd);
+		int rt = close_f(m_fd);
+		m_fd = -1;
+		return rt;
+	}
+}
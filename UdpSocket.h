@@ -0,0 +1,137 @@
+#ifndef _UDP_SOCKET_H_
+#define _UDP_SOCKET_H_
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+/*
+协程友好的UDP socket，收发都按批进行
+recv一次recvmmsg取走队列中已有的多个数据报，队列为空时挂起协程；send一次sendmmsg发出一批，发送缓冲区满时挂起协程
+可选GSO（setSendSegmentSize）：一个大缓冲区交给内核按固定大小切成多个数据报，整段只走一次协议栈
+可选GRO（setGro）：内核把同一个流上连续到达的数据报合并成一个大缓冲区交上来，RecvBatch按段大小拆开
+挂起依赖hook：需要在开启hook的IOManager协程中创建和使用，没开hook时创建的socket是阻塞的，收发阻塞线程
+*/
+
+namespace sylar {
+
+	class UdpSocket
+	{
+	public:
+		typedef std::shared_ptr<UdpSocket> ptr;
+
+		//一批接收缓冲区，mmsghdr、iovec、地址和控制消息都预先分配，反复使用不再分配内存
+		class RecvBatch
+		{
+		public:
+			//count个缓冲区，每个buffer_size字节；开启GRO时缓冲区要能放下合并后的数据（最大64K）
+			RecvBatch(size_t count, size_t buffer_size);
+
+			//上一次recv填充的缓冲区个数
+			size_t size() const { return m_received; }
+			size_t capacity() const { return m_msgs.size(); }
+			const char* data(size_t i) const { return &m_buffers[i * m_bufferSize]; }
+			size_t length(size_t i) const { return m_msgs[i].msg_len; }
+			const sockaddr* addr(size_t i) const { return (const sockaddr*)&m_addrs[i]; }
+			socklen_t addrLen(size_t i) const { return m_msgs[i].msg_hdr.msg_namelen; }
+			//GRO合并的缓冲区中每个数据报的大小（最后一个可以更小），没有合并时为0
+			size_t segmentSize(size_t i) const { return m_segments[i]; }
+
+			//对收到的每个数据报调用cb(data, len, addr, addrlen)，GRO合并的缓冲区按段拆开
+			template<class Func>
+			void forEach(Func cb) const
+			{
+				for (size_t i = 0; i < m_received; i++)
+				{
+					const char* p = data(i);
+					size_t left = length(i);
+					size_t seg = m_segments[i] ? m_segments[i] : left;
+					do
+					{
+						size_t len = left < seg ? left : seg;
+						cb(p, len, addr(i), addrLen(i));
+						p += len;
+						left -= len;
+					} while (left > 0);
+				}
+			}
+
+		private:
+			friend class UdpSocket;
+			//内核会改写长度字段，每次接收前恢复
+			void prepare();
+			//从控制消息中取出GRO段大小
+			void parse(size_t received);
+
+		private:
+			size_t m_bufferSize;
+			size_t m_received = 0;
+			std::vector<char> m_buffers;
+			std::vector<mmsghdr> m_msgs;
+			std::vector<iovec> m_iovs;
+			std::vector<sockaddr_storage> m_addrs;
+			std::vector<char> m_control;
+			std::vector<size_t> m_segments;
+		};
+
+		//一批待发送的数据报，只记录指针不拷贝数据，send返回之前数据必须保持有效
+		class SendBatch
+		{
+		public:
+			explicit SendBatch(size_t reserve = 64);
+
+			//addr为空表示发往connect的地址
+			void add(const void* data, size_t len, const sockaddr* addr = nullptr, socklen_t addrlen = 0);
+			size_t size() const { return m_msgs.size(); }
+			bool empty() const { return m_msgs.empty(); }
+			void clear();
+
+		private:
+			friend class UdpSocket;
+			std::vector<mmsghdr> m_msgs;
+			std::vector<iovec> m_iovs;
+		};
+
+		//创建family（AF_INET/AF_INET6）的UDP socket，失败时getFd()返回-1
+		explicit UdpSocket(int family = AF_INET);
+		~UdpSocket();
+		UdpSocket(const UdpSocket&) = delete;
+		UdpSocket& operator=(const UdpSocket&) = delete;
+
+		int getFd() const { return m_fd; }
+		bool isValid() const { return m_fd != -1; }
+		bool bind(const sockaddr* addr, socklen_t addrlen);
+		bool connect(const sockaddr* addr, socklen_t addrlen);
+		//接收和发送超时，单位毫秒，对应SO_RCVTIMEO/SO_SNDTIMEO，超时返回-1且errno为ETIMEDOUT（阻塞socket为EAGAIN）
+		bool setRecvTimeout(uint64_t ms);
+		bool setSendTimeout(uint64_t ms);
+
+		//GSO：长度超过size的数据报由内核切成size大小的多个数据报发出，0关闭；内核不支持时返回false
+		bool setSendSegmentSize(uint16_t size);
+		//GRO：内核不支持时返回false
+		bool setGro(bool enable);
+
+		//接收一批，至少收到一个数据报（或者超时）才返回，返回填充的缓冲区个数，出错返回-1
+		int recv(RecvBatch& batch);
+		//发送整批，发送缓冲区满时挂起直到全部发出，返回发出的个数；
+		//中途出错时返回已经发出的个数（一个都没发出返回-1），没发出的留给调用者处理
+		int send(SendBatch& batch);
+
+		ssize_t recvFrom(void* buf, size_t len, sockaddr* addr = nullptr, socklen_t* addrlen = nullptr);
+		ssize_t sendTo(const void* buf, size_t len, const sockaddr* addr = nullptr, socklen_t addrlen = 0);
+
+		int close();
+
+	private:
+		bool setTimeout(int type, uint64_t ms);
+
+	private:
+		int m_fd = -1;
+	};
+}
+
+#endif
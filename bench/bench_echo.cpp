@@ -0,0 +1,209 @@
+#include "IOManager.h"
+#include "Hook.h"
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+/*
+回环TCP回显服务的压测，对比epoll和io_uring两种反应器
+服务端和客户端跑在同一个IOManager里：每个客户端协程依次建立连接，每个连接做若干次64字节的往返后关闭
+输出每秒完成的连接数和往返延迟的p50/p99
+用法：bench_echo [客户端协程数] [每个客户端的连接数] [每个连接的往返次数] [线程数]
+*/
+
+using namespace sylar;
+using Clock = std::chrono::steady_clock;
+
+//hook开关是线程局部的，协程挂起后可能在另一个线程上恢复，所以每次调用hook的函数前都打开
+static ssize_t hook_read(int fd, void* buf, size_t count)
+{
+	set_hook_enable(true);
+	return read(fd, buf, count);
+}
+
+static ssize_t hook_write(int fd, const void* buf, size_t count)
+{
+	set_hook_enable(true);
+	return write(fd, buf, count);
+}
+
+struct Config
+{
+	int clients = 50;
+	int conns = 200;
+	int rounds = 10;
+	int threads = 4;
+};
+
+static void serve(int fd)
+{
+	int one = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	char buf[4096];
+	while (true)
+	{
+		ssize_t n = hook_read(fd, buf, sizeof(buf));
+		if (n <= 0 || hook_write(fd, buf, n) != n)
+		{
+			break;
+		}
+	}
+	set_hook_enable(true);
+	close(fd);
+}
+
+//返回本客户端建立的连接数，往返延迟（微秒）追加到lat
+static int client(int port, const Config& config, std::vector<long>& lat, int& errors)
+{
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	int done = 0;
+	for (int k = 0; k < config.conns; k++)
+	{
+		set_hook_enable(true);
+		int fd = socket(AF_INET, SOCK_STREAM, 0);
+		set_hook_enable(true);
+		if (connect(fd, (sockaddr*)&addr, sizeof(addr)))
+		{
+			errors++;
+			set_hook_enable(true);
+			close(fd);
+			continue;
+		}
+		int one = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		char buf[64];
+		memset(buf, 'a', sizeof(buf));
+		for (int i = 0; i < config.rounds; i++)
+		{
+			auto start = Clock::now();
+			if (hook_write(fd, buf, sizeof(buf)) != (ssize_t)sizeof(buf))
+			{
+				errors++;
+				break;
+			}
+			size_t got = 0;
+			while (got < sizeof(buf))
+			{
+				ssize_t n = hook_read(fd, buf + got, sizeof(buf) - got);
+				if (n <= 0)
+				{
+					errors++;
+					break;
+				}
+				got += n;
+			}
+			lat.push_back(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count());
+		}
+		set_hook_enable(true);
+		close(fd);
+		done++;
+	}
+	return done;
+}
+
+static void run(IOManager::Reactor reactor, const char* name, const Config& config)
+{
+	std::atomic<int> finished = { 0 };
+	std::atomic<int> conns = { 0 };
+	std::atomic<int> errors = { 0 };
+	std::mutex mutex;
+	std::vector<long> lat;
+	Clock::time_point end;
+	auto start = Clock::now();
+	{
+		IOManager iom(config.threads, true, "bench", TimerManager::RBTREE, reactor);
+		if (iom.getReactor() != reactor)
+		{
+			std::cout << name << " not available, skipped" << std::endl;
+			return;
+		}
+		iom.ScheduleLock([&]()
+		{
+			set_hook_enable(true);
+			int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+			int one = 1;
+			setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+			sockaddr_in addr;
+			memset(&addr, 0, sizeof(addr));
+			addr.sin_family = AF_INET;
+			addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			socklen_t len = sizeof(addr);
+			if (bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) || listen(listen_fd, 4096)
+				|| getsockname(listen_fd, (sockaddr*)&addr, &len))
+			{
+				std::cout << "listen failed: " << strerror(errno) << std::endl;
+				close(listen_fd);
+				return;
+			}
+			int port = ntohs(addr.sin_port);
+
+			for (int c = 0; c < config.clients; c++)
+			{
+				IOManager::GetThis()->ScheduleLock([&, port, listen_fd]()
+				{
+					set_hook_enable(true);
+					std::vector<long> mine;
+					int err = 0;
+					conns += client(port, config, mine, err);
+					errors += err;
+					{
+						std::lock_guard<std::mutex> lock(mutex);
+						lat.insert(lat.end(), mine.begin(), mine.end());
+					}
+					//最后一个客户端结束时关闭监听socket，accept返回后服务端退出
+					if (++finished == config.clients)
+					{
+						end = Clock::now();
+						set_hook_enable(true);
+						shutdown(listen_fd, SHUT_RDWR);
+					}
+				});
+			}
+			while (true)
+			{
+				set_hook_enable(true);
+				int fd = accept(listen_fd, nullptr, nullptr);
+				if (fd < 0)
+				{
+					break;
+				}
+				IOManager::GetThis()->ScheduleLock([fd]() { serve(fd); });
+			}
+			set_hook_enable(true);
+			close(listen_fd);
+		});
+	}
+	set_hook_enable(false);
+
+	double sec = std::chrono::duration<double>(end - start).count();
+	std::sort(lat.begin(), lat.end());
+	long p50 = lat.empty() ? 0 : lat[lat.size() / 2];
+	long p99 = lat.empty() ? 0 : lat[lat.size() * 99 / 100];
+	std::cout << name << " conns=" << conns << " errors=" << errors << "  " << (long)(conns / sec) << " conn/s  "
+		<< "round trips=" << lat.size() << " p50=" << p50 << "us p99=" << p99 << "us" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+	Config config;
+	config.clients = argc > 1 ? atoi(argv[1]) : config.clients;
+	config.conns = argc > 2 ? atoi(argv[2]) : config.conns;
+	config.rounds = argc > 3 ? atoi(argv[3]) : config.rounds;
+	config.threads = argc > 4 ? atoi(argv[4]) : config.threads;
+	run(IOManager::EPOLL, "epoll   ", config);
+	run(IOManager::IO_URING, "io_uring", config);
+	return 0;
+}
@@ -0,0 +1,128 @@
+#include "IOManager.h"
+#include "Hook.h"
+#include "Fd_manager.h"
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+#include <sys/socket.h>
+
+/*
+大量事件同时就绪时IOManager的分发能力
+fd：N个协程各自阻塞在一个socketpair的读端，主线程每轮向N个写端各写一个字节，
+   一次epoll_wait返回大量事件，idle把被唤醒的协程成批交给调度器
+定时器：每轮加入M个同时到期的定时器，到期回调成批投递
+输出每秒分发的事件数
+用法：bench_fanin [fd数] [轮数] [线程数]
+*/
+
+using namespace sylar;
+using Clock = std::chrono::steady_clock;
+
+static void wait_count(const std::atomic<long>& count, long target)
+{
+	while (count.load(std::memory_order_acquire) < target)
+	{
+		std::this_thread::yield();
+	}
+}
+
+static void bench_fd(const char* name, int options, int fds, int rounds, int threads)
+{
+	std::vector<int> readers(fds);
+	std::vector<int> writers(fds);
+	for (int i = 0; i < fds; i++)
+	{
+		int sv[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv))
+		{
+			std::cout << "socketpair failed, raise the fd limit" << std::endl;
+			exit(1);
+		}
+		readers[i] = sv[0];
+		writers[i] = sv[1];
+		//登记后读端变成非阻塞，hook的read才能挂起协程
+		FdMgr::GetInstance()->get(sv[0], true);
+	}
+
+	std::atomic<long> events = { 0 };
+	double sec = 0;
+	{
+		IOManager iom(threads, true, "bench", TimerManager::RBTREE, IOManager::EPOLL, options);
+		for (int i = 0; i < fds; i++)
+		{
+			int fd = readers[i];
+			iom.ScheduleLock([fd, rounds, &events]()
+			{
+				char c;
+				for (int r = 0; r < rounds; r++)
+				{
+					//协程可能在另一个线程上恢复，hook开关是线程局部的
+					set_hook_enable(true);
+					if (read(fd, &c, 1) != 1)
+					{
+						break;
+					}
+					events.fetch_add(1, std::memory_order_release);
+				}
+			});
+		}
+		//调用线程没有打开hook，这里的write是原始的系统调用
+		auto start = Clock::now();
+		for (int r = 0; r < rounds; r++)
+		{
+			for (int i = 0; i < fds; i++)
+			{
+				if (write(writers[i], "x", 1) != 1)
+				{
+					std::cout << "write failed" << std::endl;
+				}
+			}
+			wait_count(events, (long)(r + 1) * fds);
+		}
+		sec = std::chrono::duration<double>(Clock::now() - start).count();
+	}
+	//没有经过hook的close，要自己注销，否则fd号复用时会拿到旧的FdCtx
+	for (int i = 0; i < fds; i++)
+	{
+		FdMgr::GetInstance()->del(readers[i]);
+		close(readers[i]);
+		close(writers[i]);
+	}
+	std::cout << name << " fds=" << fds << " rounds=" << rounds << "  " << (long)(events / sec) << " events/s" << std::endl;
+}
+
+static void bench_timer(TimerManager::Backend backend, const char* name, int timers, int rounds, int threads)
+{
+	std::atomic<long> fired = { 0 };
+	double sec = 0;
+	{
+		IOManager iom(threads, true, "bench", backend);
+		auto start = Clock::now();
+		for (int r = 0; r < rounds; r++)
+		{
+			for (int i = 0; i < timers; i++)
+			{
+				iom.addTimer(1, [&fired]() { fired.fetch_add(1, std::memory_order_release); });
+			}
+			wait_count(fired, (long)(r + 1) * timers);
+		}
+		sec = std::chrono::duration<double>(Clock::now() - start).count();
+	}
+	std::cout << name << " timers=" << timers << " rounds=" << rounds << "  " << (long)(fired / sec) << " callbacks/s" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+	int fds = argc > 1 ? atoi(argv[1]) : 1000;
+	int rounds = argc > 2 ? atoi(argv[2]) : 200;
+	int threads = argc > 3 ? atoi(argv[3]) : 4;
+	bench_fd("epoll shared    ", 0, fds, rounds, threads);
+	bench_fd("per-thread epoll", IOManager::PER_THREAD_EPOLL, fds, rounds, threads);
+	bench_fd("persistent      ", IOManager::PERSISTENT_EVENTS, fds, rounds, threads);
+	bench_timer(TimerManager::RBTREE, "timer rbtree    ", fds * 10, rounds, threads);
+	bench_timer(TimerManager::WHEEL, "timer wheel     ", fds * 10, rounds, threads);
+	return 0;
+}
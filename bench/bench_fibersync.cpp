@@ -0,0 +1,117 @@
+#include "IOManager.h"
+#include "FiberSync.h"
+#include <iostream>
+#include <chrono>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+
+/*
+协程锁与标准库锁的竞争测试
+多个协程在几个工作线程上反复加锁，临界区长度可调：
+std::mutex竞争失败时阻塞整个工作线程，FiberMutex先自旋再挂起协程，工作线程去执行别的协程
+读写锁部分每10次操作中有1次写
+*/
+
+using namespace sylar;
+using Clock = std::chrono::steady_clock;
+
+static const int THREADS = 4;
+static const int FIBERS = 64;
+static const int ITERS = 20000;
+
+//在临界区里忙等ns纳秒，模拟一段很短的计算
+static void busy(int ns)
+{
+	if (ns <= 0)
+	{
+		return;
+	}
+	auto end = Clock::now() + std::chrono::nanoseconds(ns);
+	while (Clock::now() < end)
+	{
+	}
+}
+
+static void report(const std::string& name, int cs_ns, Clock::time_point start, long counter)
+{
+	double ms = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count() / 1000.0;
+	double ops = (double)FIBERS * ITERS;
+	std::cout << name << " cs=" << cs_ns << "ns  " << ms << " ms  " << (long)(ops / ms * 1000) << " ops/s";
+	if (counter != (long)ops)
+	{
+		std::cout << "  ERROR counter=" << counter;
+	}
+	std::cout << std::endl;
+}
+
+template<class Mutex>
+static void bench_mutex(const std::string& name, int cs_ns)
+{
+	Mutex mutex;
+	long counter = 0;
+	auto start = Clock::now();
+	{
+		IOManager iom(THREADS, true, "bench");
+		for (int f = 0; f < FIBERS; f++)
+		{
+			iom.ScheduleLock([&]()
+			{
+				for (int i = 0; i < ITERS; i++)
+				{
+					std::lock_guard<Mutex> lock(mutex);
+					counter++;
+					busy(cs_ns);
+				}
+			});
+		}
+	}
+	report(name, cs_ns, start, counter);
+}
+
+template<class RWMutex>
+static void bench_rwmutex(const std::string& name, int cs_ns)
+{
+	RWMutex mutex;
+	long counter = 0;
+	std::atomic<long> reads = { 0 };
+	auto start = Clock::now();
+	{
+		IOManager iom(THREADS, true, "bench");
+		for (int f = 0; f < FIBERS; f++)
+		{
+			iom.ScheduleLock([&]()
+			{
+				for (int i = 0; i < ITERS; i++)
+				{
+					if (i % 10 == 0)
+					{
+						std::lock_guard<RWMutex> lock(mutex);
+						counter++;
+						busy(cs_ns);
+					}
+					else
+					{
+						std::shared_lock<RWMutex> lock(mutex);
+						reads.fetch_add(counter >= 0, std::memory_order_relaxed);
+						busy(cs_ns);
+					}
+				}
+			});
+		}
+	}
+	//只统计写操作次数是否正确
+	report(name, cs_ns, start, counter * 10);
+}
+
+int main()
+{
+	for (int cs : { 0, 200, 1000 })
+	{
+		bench_mutex<std::mutex>("std::mutex        ", cs);
+		bench_mutex<FiberMutex>("FiberMutex        ", cs);
+		bench_rwmutex<std::shared_mutex>("std::shared_mutex ", cs);
+		bench_rwmutex<FiberRWMutex>("FiberRWMutex      ", cs);
+	}
+	return 0;
+}
@@ -0,0 +1,54 @@
+#include "Scheduler.h"
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <cstdlib>
+
+/*
+调度空回调任务的吞吐量
+每个回调任务都要放进一个协程里执行：关掉协程缓存（上限为0）时每个任务新建一个协程，
+打开时复用已经结束的协程，只剩一次上下文初始化和两次切换
+用法：bench_scheduler [工作线程数] [任务数]
+*/
+
+using namespace sylar;
+using Clock = std::chrono::steady_clock;
+
+static void run(int threads, long tasks, size_t cache_limit)
+{
+	std::atomic<long> done = { 0 };
+	auto start = Clock::now();
+	{
+		//调用线程只负责投递，stop()时才参与调度
+		Scheduler sc(threads + 1, true, "bench");
+		sc.setFiberCacheLimit(cache_limit);
+		sc.start();
+		const long BATCH = 10000;
+		for (long i = 0; i < tasks; i += BATCH)
+		{
+			for (long j = 0; j < BATCH && i + j < tasks; j++)
+			{
+				sc.ScheduleLock([&done]() { done.fetch_add(1, std::memory_order_relaxed); });
+			}
+			//积压太多时等工作线程追上来，不让上千万个任务同时留在队列里
+			while (i + BATCH - done.load(std::memory_order_relaxed) > (1 << 20))
+			{
+				std::this_thread::yield();
+			}
+		}
+		sc.stop();
+	}
+	double sec = std::chrono::duration<double>(Clock::now() - start).count();
+	std::cout << "threads=" << threads << " fiber cache=" << cache_limit << "  tasks=" << done
+		<< "  " << sec * 1000 << " ms  " << (long)(done / sec) << " tasks/s" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+	int threads = argc > 1 ? atoi(argv[1]) : 1;
+	long tasks = argc > 2 ? atol(argv[2]) : 10000000;
+	run(threads, tasks, 0);
+	run(threads, tasks, 64);
+	return 0;
+}
@@ -0,0 +1,74 @@
+#include "fiber.h"
+#include "FiberContext.h"
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <vector>
+#include <ucontext.h>
+
+/*
+协程切换延迟
+第一项是Fiber的resume/yield，走编译时选择的上下文后端（汇编或ucontext，定义SYLAR_FIBER_UCONTEXT重新编译即可切换）
+第二项直接用swapcontext来回切换，作为ucontext的对照：glibc的swapcontext每次切换都有一次rt_sigprocmask系统调用
+用法：bench_switch [往返次数]
+*/
+
+using namespace sylar;
+using Clock = std::chrono::steady_clock;
+
+static ucontext_t s_main;
+static ucontext_t s_peer;
+
+static void peer_main()
+{
+	while (true)
+	{
+		swapcontext(&s_peer, &s_main);
+	}
+}
+
+static double bench_fiber(long rounds)
+{
+	std::shared_ptr<Fiber> fiber = std::make_shared<Fiber>([]()
+	{
+		while (true)
+		{
+			Fiber::GetThis()->yield();
+		}
+	}, 0, false);
+	fiber->resume();//预热，第一次进入协程
+	auto start = Clock::now();
+	for (long i = 0; i < rounds; i++)
+	{
+		fiber->resume();
+	}
+	//一次往返是两次切换
+	return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / rounds / 2;
+}
+
+static double bench_ucontext(long rounds)
+{
+	std::vector<char> stack(128 * 1024);
+	getcontext(&s_peer);
+	s_peer.uc_stack.ss_sp = stack.data();
+	s_peer.uc_stack.ss_size = stack.size();
+	s_peer.uc_link = nullptr;
+	makecontext(&s_peer, peer_main, 0);
+	swapcontext(&s_main, &s_peer);
+	auto start = Clock::now();
+	for (long i = 0; i < rounds; i++)
+	{
+		swapcontext(&s_main, &s_peer);
+	}
+	return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / rounds / 2;
+}
+
+int main(int argc, char** argv)
+{
+	long rounds = argc > 1 ? atol(argv[1]) : 5000000;
+	Fiber::GetThis();
+	std::cout << "Fiber (" << context_backend() << ")  " << bench_fiber(rounds) << " ns/switch" << std::endl;
+	std::cout << "swapcontext        " << bench_ucontext(rounds) << " ns/switch" << std::endl;
+	//两个协程都停在无限循环里，直接退出，不析构还在运行的协程
+	_exit(0);
+}
@@ -0,0 +1,361 @@
+#include "Timer.h"
+#include "TimingWheel.h"
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include <thread>
+#include <algorithm>
+
+/*
+定时器两种后端的对比
+1. 时间轮的到期顺序和时机：用合成的tick直接驱动TimingWheel，跨过第1~4层的边界、超出2^32个tick的定时器、
+   级联前后取消，与RBTREE的规则（按到期时间排序，不早到也不晚到）逐次比较
+2. 真实时间下两种TimerManager后端对同一批定时器的触发顺序和延迟
+3. 插入、取消、到期的耗时
+有不一致时返回1
+*/
+
+using namespace sylar;
+using Clock = std::chrono::steady_clock;
+
+static int s_errors = 0;
+
+static void check(bool ok, const std::string& what)
+{
+	if (!ok)
+	{
+		s_errors++;
+		if (s_errors <= 20)
+		{
+			std::cout << "  MISMATCH: " << what << std::endl;
+		}
+	}
+}
+
+//Timer只能由TimerManager创建：由一个不推进的RBTREE管理器创建（到期时间很远），
+//再按合成的tick挂到独立的TimingWheel上，RBTREE后端不使用Timer的时间轮字段
+class WheelModel
+{
+public:
+	WheelModel() : m_carrier(TimerManager::RBTREE) {}
+
+	int add(uint64_t tick)
+	{
+		int id = (int)m_timers.size();
+		std::shared_ptr<Timer> timer = m_carrier.addTimer(1000000000ull, nullptr);
+		m_timers.push_back(timer);
+		m_ids[timer.get()] = id;
+		m_ticks.push_back(tick);
+		//早于当前进度的按当前进度处理
+		uint64_t due = tick < m_wheel.current() ? m_wheel.current() : tick;
+		m_dues.push_back(due);
+		m_pending.emplace(due, id);
+		m_wheel.add(timer, tick);
+		return id;
+	}
+
+	void cancel(int id)
+	{
+		auto range = m_pending.equal_range(m_dues[id]);
+		bool pending = false;
+		for (auto it = range.first; it != range.second; ++it)
+		{
+			if (it->second == id)
+			{
+				m_pending.erase(it);
+				pending = true;
+				break;
+			}
+		}
+		//已经到期的定时器不在轮上，remove返回false
+		check(m_wheel.remove(m_timers[id].get()) == pending, "remove of timer " + std::to_string(id));
+	}
+
+	//推进到now，到期的定时器必须正好是参考模型中到期时间不晚于now的那些，并按到期时间排列
+	void advance(uint64_t now)
+	{
+		std::vector<std::shared_ptr<Timer>> expired;
+		m_wheel.advance(now, expired);
+		std::vector<int> expect;
+		while (!m_pending.empty() && m_pending.begin()->first <= now)
+		{
+			expect.push_back(m_pending.begin()->second);
+			m_pending.erase(m_pending.begin());
+		}
+		std::vector<int> got;
+		uint64_t last = 0;
+		for (auto& timer : expired)
+		{
+			int id = m_ids[timer.get()];
+			got.push_back(id);
+			uint64_t due = m_ticks[id];
+			check(due >= last, "expiry order at now=" + std::to_string(now));
+			last = std::max(last, due);
+		}
+		std::sort(got.begin(), got.end());
+		std::sort(expect.begin(), expect.end());
+		check(got == expect, "advance(" + std::to_string(now) + ") expired " + std::to_string(got.size())
+			+ " timers, expected " + std::to_string(expect.size()));
+		m_fired += got.size();
+	}
+
+	//nextTick()是下界，不能晚于最早的到期时间
+	void checkNext()
+	{
+		if (m_pending.empty())
+		{
+			check(m_wheel.size() == 0, "wheel not empty");
+			return;
+		}
+		check(m_wheel.nextTick() <= m_pending.begin()->first, "nextTick " + std::to_string(m_wheel.nextTick())
+			+ " later than the earliest timer " + std::to_string(m_pending.begin()->first));
+	}
+
+	uint64_t current() const { return m_wheel.current(); }
+	size_t pending() const { return m_pending.size(); }
+	uint64_t nextDue() const { return m_pending.begin()->first; }
+	size_t fired() const { return m_fired; }
+
+	void finish()
+	{
+		for (auto& timer : m_timers)
+		{
+			m_wheel.remove(timer.get());
+			timer->cancel();
+		}
+	}
+
+private:
+	TimerManager m_carrier;
+	TimingWheel m_wheel;
+	std::vector<std::shared_ptr<Timer>> m_timers;
+	std::unordered_map<Timer*, int> m_ids;
+	std::vector<uint64_t> m_ticks;
+	std::vector<uint64_t> m_dues;
+	std::multimap<uint64_t, int> m_pending;//到期tick -> id
+	size_t m_fired = 0;
+};
+
+//每层的边界和两侧，以及超出2^32的距离；起点不对齐，让级联发生在边界附近
+static void test_boundaries()
+{
+	const uint64_t bounds[] = { 1ull << 8, 1ull << 14, 1ull << 20, 1ull << 26, 1ull << 32, 1ull << 33 };
+	for (uint64_t start : { 0ull, 3ull, 255ull, (1ull << 14) - 2, (1ull << 20) + 77 })
+	{
+		WheelModel model;
+		model.advance(start);
+		for (uint64_t b : bounds)
+		{
+			for (int64_t d = -2; d <= 2; d++)
+			{
+				model.add(start + b + d);
+			}
+		}
+		model.add(start + (1ull << 32) + 12345);
+		model.add(start + (1ull << 33) + (1ull << 20) + 1);
+		//逐个到期时间推进：先到到期前一个tick，不能提前触发，再到到期时刻
+		while (model.pending())
+		{
+			model.checkNext();
+			uint64_t due = model.nextDue();
+			if (due > model.current())
+			{
+				model.advance(due - 1);
+				model.checkNext();
+			}
+			model.advance(due);
+		}
+		model.finish();
+	}
+	std::cout << "boundaries: " << (s_errors ? "FAILED" : "ok") << std::endl;
+}
+
+//级联前后取消：同一个上层槽里的定时器，在级联之前、刚级联到下层之后分别取消一部分
+static void test_cancel_during_cascade()
+{
+	WheelModel model;
+	std::vector<int> ids;
+	const uint64_t base = 3ull << 14;//第2层的一个槽
+	for (int i = 0; i < 300; i++)
+	{
+		ids.push_back(model.add(base + (i * 53) % (1 << 14)));
+	}
+	for (int i = 0; i < 300; i += 5)
+	{
+		model.cancel(ids[i]);
+	}
+	model.advance(base - 1);
+	model.advance(base);//第2层的槽级联到下层
+	for (int i = 1; i < 300; i += 7)
+	{
+		model.cancel(ids[i]);
+	}
+	//级联后又加入的定时器和留下的一起到期
+	for (int i = 0; i < 50; i++)
+	{
+		model.add(base + i * 100);
+	}
+	uint64_t now = base;
+	while (model.pending())
+	{
+		now += 97;
+		model.advance(now);
+		model.checkNext();
+		if (now % 3 == 0 && model.pending())
+		{
+			model.cancel(ids[(now / 97) % ids.size()]);
+		}
+	}
+	model.finish();
+	std::cout << "cancel during cascade: " << (s_errors ? "FAILED" : "ok") << std::endl;
+}
+
+//随机：距离按对数均匀分布到2^34，推进的步长也按对数分布，中间随机取消
+static void test_random()
+{
+	std::mt19937_64 rng(42);
+	WheelModel model;
+	std::vector<int> ids;
+	auto log_uniform = [&](int max_bits)
+	{
+		int bits = (int)(rng() % max_bits);
+		return (rng() & ((1ull << bits) - 1)) + (1ull << bits) - 1;
+	};
+	for (int round = 0; round < 2000; round++)
+	{
+		for (int i = 0; i < 10; i++)
+		{
+			ids.push_back(model.add(model.current() + log_uniform(34)));
+		}
+		if (rng() % 3 == 0)
+		{
+			model.cancel(ids[rng() % ids.size()]);
+		}
+		//偶尔一步跨过很远，大多数时候小步推进
+		model.advance(model.current() + log_uniform(round % 200 == 199 ? 34 : 16));
+		model.checkNext();
+	}
+	model.advance(model.current() + (1ull << 35));
+	check(model.pending() == 0, "timers left after the last advance");
+	model.finish();
+	std::cout << "random: fired=" << model.fired() << " " << (s_errors ? "FAILED" : "ok") << std::endl;
+}
+
+//真实时间：两个后端各自跑同一批定时器（0~600ms，跨过第0/1层的边界256ms），比较触发顺序和延迟
+static void compare_realtime(TimerManager::Backend backend, const char* name)
+{
+	TimerManager manager(backend);
+	std::mt19937 rng(7);
+	const int N = 2000;
+	std::vector<Clock::time_point> due(N);
+	std::vector<Clock::time_point> fired(N);
+	std::vector<std::shared_ptr<Timer>> timers;
+	auto start = Clock::now();
+	for (int i = 0; i < N; i++)
+	{
+		uint64_t ms = rng() % 600;
+		due[i] = Clock::now() + std::chrono::milliseconds(ms);
+		timers.push_back(manager.addTimer(ms, [&fired, i]() { fired[i] = Clock::now(); }));
+	}
+	for (int i = 0; i < N; i += 9)
+	{
+		timers[i]->cancel();
+	}
+	while (Clock::now() - start < std::chrono::milliseconds(700))
+	{
+		uint64_t next = manager.getNextTimer();
+		std::this_thread::sleep_for(std::chrono::milliseconds(std::min<uint64_t>(next, 5)));
+		std::vector<Callback> cbs;
+		manager.listExpiredCb(cbs);
+		for (auto& cb : cbs)
+		{
+			cb();
+		}
+	}
+	int early = 0;
+	int missing = 0;
+	int unordered = 0;
+	long max_late = 0;
+	std::vector<int> order;
+	for (int i = 0; i < N; i++)
+	{
+		if (i % 9 == 0)
+		{
+			check(fired[i] == Clock::time_point(), std::string(name) + " cancelled timer fired");
+			continue;
+		}
+		if (fired[i] == Clock::time_point())
+		{
+			missing++;
+			continue;
+		}
+		early += fired[i] < due[i];
+		max_late = std::max<long>(max_late, std::chrono::duration_cast<std::chrono::milliseconds>(fired[i] - due[i]).count());
+		order.push_back(i);
+	}
+	//按到期时间排序后，触发时间不能倒退超过1ms（时间轮精度1ms）
+	std::sort(order.begin(), order.end(), [&](int a, int b) { return due[a] < due[b]; });
+	for (size_t i = 1; i < order.size(); i++)
+	{
+		unordered += fired[order[i]] + std::chrono::milliseconds(1) < fired[order[i - 1]];
+	}
+	check(early == 0 && missing == 0 && unordered == 0, std::string(name) + " real-time expiry");
+	std::cout << name << " real time: early=" << early << " missing=" << missing << " out of order=" << unordered
+		<< " max late=" << max_late << "ms" << std::endl;
+}
+
+static void bench(TimerManager::Backend backend, const char* name)
+{
+	const int N = 500000;
+	TimerManager manager(backend);
+	std::vector<std::shared_ptr<Timer>> timers;
+	timers.reserve(N);
+	std::mt19937 rng(1);
+	auto ns = [](Clock::time_point a, Clock::time_point b)
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(b - a).count();
+	};
+
+	auto t0 = Clock::now();
+	for (int i = 0; i < N; i++)
+	{
+		timers.push_back(manager.addTimer(1000 + rng() % 60000, nullptr));
+	}
+	auto t1 = Clock::now();
+	for (int i = 0; i < N; i++)
+	{
+		timers[i]->cancel();
+	}
+	auto t2 = Clock::now();
+	timers.clear();
+
+	for (int i = 0; i < N; i++)
+	{
+		manager.addTimer(rng() % 50, nullptr);
+	}
+	std::vector<Callback> cbs;
+	auto t3 = Clock::now();
+	while (manager.hasTimer())
+	{
+		manager.listExpiredCb(cbs);
+	}
+	auto t4 = Clock::now();
+	std::cout << name << " insert " << ns(t0, t1) / N << " ns  cancel " << ns(t1, t2) / N
+		<< " ns  expire " << cbs.size() << " timers over " << ns(t3, t4) / 1000000 << " ms" << std::endl;
+}
+
+int main()
+{
+	test_boundaries();
+	test_cancel_during_cascade();
+	test_random();
+	compare_realtime(TimerManager::RBTREE, "rbtree");
+	compare_realtime(TimerManager::WHEEL, "wheel ");
+	bench(TimerManager::RBTREE, "rbtree");
+	bench(TimerManager::WHEEL, "wheel ");
+	std::cout << (s_errors ? "FAILED" : "all ok") << std::endl;
+	return s_errors ? 1 : 0;
+}
@@ -0,0 +1,164 @@
+#include "IOManager.h"
+#include "Hook.h"
+#include "UdpSocket.h"
+#include "FiberSync.h"
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <arpa/inet.h>
+
+/*
+回环UDP收发的每核吞吐量
+收发两个协程跑在同一个单线程IOManager里，发送方每轮发出WINDOW个64字节的数据报，等接收方收齐后再发下一轮
+三种方式：逐个sendto/recvfrom、sendmmsg/recvmmsg成批收发、GSO发送+GRO接收
+输出每秒的数据报数和每CPU秒的数据报数（收发双方合计消耗的CPU时间）
+用法：bench_udp [轮数]
+*/
+
+using namespace sylar;
+using Clock = std::chrono::steady_clock;
+
+static const int PACKET = 64;
+static const int WINDOW = 256;
+//一个GSO缓冲区最多切成64段
+static const int GSO_SEGMENTS = 64;
+
+enum Mode
+{
+	SINGLE,
+	BATCH,
+	GSO
+};
+
+static double cpu_seconds()
+{
+	timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run(const char* name, Mode mode, int rounds)
+{
+	long received = 0;
+	bool ok = true;
+	double sec = 0;
+	double cpu = 0;
+	{
+		IOManager iom(1, true, "bench");
+		iom.ScheduleLock([&]()
+		{
+			set_hook_enable(true);
+			UdpSocket rx;
+			UdpSocket tx;
+			sockaddr_in addr;
+			memset(&addr, 0, sizeof(addr));
+			addr.sin_family = AF_INET;
+			addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			socklen_t len = sizeof(addr);
+			rx.bind((sockaddr*)&addr, sizeof(addr));
+			getsockname(rx.getFd(), (sockaddr*)&addr, &len);
+			int rcvbuf = 8 << 20;
+			setsockopt(rx.getFd(), SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+			tx.connect((sockaddr*)&addr, sizeof(addr));
+			if (mode == GSO && (!tx.setSendSegmentSize(PACKET) || !rx.setGro(true)))
+			{
+				std::cout << name << " not supported by the kernel, skipped" << std::endl;
+				ok = false;
+				return;
+			}
+
+			//接收方每收齐一轮通知一次发送方
+			FiberSemaphore round_done(0);
+			long total = (long)WINDOW * rounds;
+			iom.ScheduleLock([&]()
+			{
+				set_hook_enable(true);
+				UdpSocket::RecvBatch batch(64, mode == GSO ? 65536 : 2048);
+				char buf[2048];
+				long next = WINDOW;
+				while (received < total)
+				{
+					if (mode == SINGLE)
+					{
+						ssize_t n = rx.recvFrom(buf, sizeof(buf));
+						if (n != PACKET)
+						{
+							ok = false;
+							break;
+						}
+						received++;
+					}
+					else
+					{
+						if (rx.recv(batch) <= 0)
+						{
+							ok = false;
+							break;
+						}
+						batch.forEach([&](const char*, size_t n, const sockaddr*, socklen_t)
+						{
+							ok = ok && n == PACKET;
+							received++;
+						});
+					}
+					while (received >= next)
+					{
+						next += WINDOW;
+						round_done.notify();
+					}
+				}
+				//出错时放行发送方
+				round_done.notify();
+			});
+
+			static char packets[WINDOW * PACKET];
+			for (int i = 0; i < WINDOW; i++)
+			{
+				memset(packets + i * PACKET, i, PACKET);
+			}
+			UdpSocket::SendBatch send_batch(WINDOW);
+			auto start = Clock::now();
+			double cpu_start = cpu_seconds();
+			for (int r = 0; r < rounds && ok; r++)
+			{
+				if (mode == SINGLE)
+				{
+					for (int i = 0; i < WINDOW; i++)
+					{
+						tx.sendTo(packets + i * PACKET, PACKET);
+					}
+				}
+				else
+				{
+					send_batch.clear();
+					int step = mode == GSO ? GSO_SEGMENTS : 1;
+					for (int i = 0; i < WINDOW; i += step)
+					{
+						send_batch.add(packets + i * PACKET, step * PACKET);
+					}
+					tx.send(send_batch);
+				}
+				round_done.wait();
+			}
+			sec = std::chrono::duration<double>(Clock::now() - start).count();
+			cpu = cpu_seconds() - cpu_start;
+		});
+	}
+	set_hook_enable(false);
+	if (sec > 0)
+	{
+		std::cout << name << " packets=" << received << (ok ? "" : " ERROR") << "  " << (long)(received / sec)
+			<< " packets/s  " << (long)(received / cpu) << " packets/cpu-s" << std::endl;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	int rounds = argc > 1 ? atoi(argv[1]) : 2000;
+	run("sendto/recvfrom  ", SINGLE, rounds);
+	run("sendmmsg/recvmmsg", BATCH, rounds);
+	run("GSO/GRO          ", GSO, rounds);
+	return 0;
+}
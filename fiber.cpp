@@ -1,4 +1,12 @@
 #include "fiber.h"
+#include "StackPool.h"
+#include "Scheduler.h"
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <new>
+#include <sys/mman.h>
+#include <ucontext.h>
 
 static bool debug = false;
 
@@ -13,10 +21,186 @@ namespace sylar {
 	//调度协程
 	static thread_local Fiber* t_scheduler_fiber = nullptr;
 
+	//单调时钟，纳秒
+	static inline uint64_t now_ns()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
 	//全局协程ID计数器
 	static std::atomic<uint64_t> s_fiber_id{0};
 	//活跃协程数量计数器
 	static std::atomic<uint64_t> s_fiber_count{0};
+	//未指定栈大小时的默认值
+	static std::atomic<size_t> s_default_stack_size{128000};
+
+	/*
+	栈溢出检测：带保护页的栈溢出时访问保护页触发SIGSEGV，这时协程栈已经用不了，
+	信号处理函数运行在线程的备用信号栈上，判断出错地址是否落在当前协程的保护页中（或栈指针已经低于栈底），
+	是则报告是哪个协程溢出，然后恢复默认处理，返回后重新执行出错的指令按默认方式终止进程（产生core）；
+	不是则交给之前安装的处理函数
+	*/
+	static const size_t ALT_STACK_SIZE = 64 * 1024;
+	//一次分配超过一页的栈帧会越过保护页，栈指针低于栈底不超过这个距离也算溢出
+	static const size_t MAX_FRAME_OVERRUN = 64 * 1024;
+	static struct sigaction s_old_segv_action;
+	static size_t s_guard_size = 0;
+	static std::once_flag s_segv_once;
+
+	//线程的备用信号栈，线程退出时释放
+	struct AltStack
+	{
+		void* mem = nullptr;
+		~AltStack()
+		{
+			if (mem)
+			{
+				stack_t ss;
+				memset(&ss, 0, sizeof(ss));
+				ss.ss_flags = SS_DISABLE;
+				sigaltstack(&ss, nullptr);
+				munmap(mem, ALT_STACK_SIZE);
+			}
+		}
+	};
+	static thread_local AltStack t_alt_stack;
+	static thread_local bool t_alt_stack_checked = false;
+
+	//第一次在本线程上恢复带保护页的协程时设置备用信号栈，线程已经有备用信号栈时沿用
+	static void EnsureAltStack()
+	{
+		t_alt_stack_checked = true;
+		stack_t old;
+		if (sigaltstack(nullptr, &old) == 0 && !(old.ss_flags & SS_DISABLE))
+		{
+			return;
+		}
+		void* mem = mmap(nullptr, ALT_STACK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (mem == MAP_FAILED)
+		{
+			return;
+		}
+		stack_t ss;
+		memset(&ss, 0, sizeof(ss));
+		ss.ss_sp = mem;
+		ss.ss_size = ALT_STACK_SIZE;
+		if (sigaltstack(&ss, nullptr) == -1)
+		{
+			munmap(mem, ALT_STACK_SIZE);
+			return;
+		}
+		t_alt_stack.mem = mem;
+	}
+
+	//信号处理函数里不能用iostream和printf，手工拼接
+	static size_t AppendStr(char* buf, size_t pos, size_t cap, const char* s)
+	{
+		while (*s && pos < cap)
+		{
+			buf[pos++] = *s++;
+		}
+		return pos;
+	}
+	static size_t AppendNum(char* buf, size_t pos, size_t cap, uint64_t v, unsigned base)
+	{
+		char tmp[24];
+		size_t n = 0;
+		do
+		{
+			tmp[n++] = "0123456789abcdef"[v % base];
+			v /= base;
+		} while (v);
+		if (base == 16)
+		{
+			pos = AppendStr(buf, pos, cap, "0x");
+		}
+		while (n > 0 && pos < cap)
+		{
+			buf[pos++] = tmp[--n];
+		}
+		return pos;
+	}
+
+	static void OnSegv(int sig, siginfo_t* info, void* uctx)
+	{
+		Fiber* cur = t_fiber;
+		if (cur && cur->isStackGuarded())
+		{
+			char* lo = (char*)cur->getStack();
+			char* addr = (char*)info->si_addr;
+			bool overflow = addr < lo && addr >= lo - s_guard_size;
+			char* sp = nullptr;
+#if defined(__x86_64__)
+			sp = (char*)((ucontext_t*)uctx)->uc_mcontext.gregs[REG_RSP];
+#elif defined(__aarch64__)
+			sp = (char*)((ucontext_t*)uctx)->uc_mcontext.sp;
+#endif
+			if (sp && sp < lo && sp + MAX_FRAME_OVERRUN >= lo)
+			{
+				overflow = true;
+			}
+			if (overflow)
+			{
+				char buf[256];
+				size_t cap = sizeof(buf) - 1;
+				size_t pos = AppendStr(buf, 0, cap, "Fiber stack overflow: fiber id=");
+				pos = AppendNum(buf, pos, cap, cur->get_Id(), 10);
+				pos = AppendStr(buf, pos, cap, " stack=");
+				pos = AppendNum(buf, pos, cap, (uint64_t)lo, 16);
+				pos = AppendStr(buf, pos, cap, " size=");
+				pos = AppendNum(buf, pos, cap, cur->getStackSize(), 10);
+				pos = AppendStr(buf, pos, cap, " fault addr=");
+				pos = AppendNum(buf, pos, cap, (uint64_t)addr, 16);
+				buf[pos++] = '\n';
+				ssize_t rt = write(STDERR_FILENO, buf, pos);
+				(void)rt;
+				struct sigaction dfl;
+				memset(&dfl, 0, sizeof(dfl));
+				dfl.sa_handler = SIG_DFL;
+				sigaction(SIGSEGV, &dfl, nullptr);
+				return;
+			}
+		}
+		if (s_old_segv_action.sa_flags & SA_SIGINFO)
+		{
+			s_old_segv_action.sa_sigaction(sig, info, uctx);
+			return;
+		}
+		if (s_old_segv_action.sa_handler != SIG_DFL && s_old_segv_action.sa_handler != SIG_IGN)
+		{
+			s_old_segv_action.sa_handler(sig);
+			return;
+		}
+		struct sigaction dfl;
+		memset(&dfl, 0, sizeof(dfl));
+		dfl.sa_handler = SIG_DFL;
+		sigaction(SIGSEGV, &dfl, nullptr);
+	}
+
+	static void InstallOverflowHandler()
+	{
+		s_guard_size = StackPool::GetGuardSize();
+		struct sigaction sa;
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_sigaction = &OnSegv;
+		sa.sa_flags = SA_SIGINFO | SA_ONSTACK;
+		sigemptyset(&sa.sa_mask);
+		if (sigaction(SIGSEGV, &sa, &s_old_segv_action) == -1)
+		{
+			std::cerr << "install SIGSEGV handler for fiber stack overflow failed\n";
+		}
+	}
+
+	void Fiber::SetDefaultStackSize(size_t size)
+	{
+		s_default_stack_size = size;
+	}
+
+	size_t Fiber::GetDefaultStackSize()
+	{
+		return s_default_stack_size.load(std::memory_order_relaxed);
+	}
 
 	void Fiber::SetThis(Fiber* f)
 	{
@@ -53,12 +237,34 @@ namespace sylar {
 		return (uint64_t)-1;//返回-1，
 		                    //(Uint64_t)-1那就会转换成UINT64_max，所以用来表示错误的情况
 	}
+	bool Fiber::IsInScheduler()
+	{
+		return t_fiber && t_fiber->m_run_in_scheduler;
+	}
+	bool Fiber::maybeYield()
+	{
+		Fiber* cur = t_fiber;
+		Scheduler* scheduler = Scheduler::GetThis();
+		if (!cur || !cur->m_run_in_scheduler || !scheduler)
+		{
+			return false;
+		}
+		uint64_t slice = scheduler->getTimeslice();
+		if (slice == 0 || now_ns() - cur->m_resumeTime < slice * 1000)
+		{
+			return false;
+		}
+		//先放回队列再切出，Scheduler::run持有协程的m_mutex，切出之前不会被其他线程恢复
+		scheduler->ScheduleYielded(cur->shared_from_this());
+		cur->yield();
+		return true;
+	}
 	//创建主协程，设置窗台，初始化上下文，分配ID
 	Fiber::Fiber()
 	{
 		SetThis(this);
 		m_state = RUNNING;
-		if (getcontext(&m_ctx))
+		if (context_init(&m_ctx))
 		{
 			std::cerr << "Fiber() failed\n";
 			pthread_exit(NULL);
@@ -74,25 +280,33 @@ namespace sylar {
 	并通过make修改上下文当set或swap激活ucontext_t m_ctx上下文时候
 	会执行make第二个参数的函数。
 	*/
-	Fiber::Fiber(std::function<void()> cb, size_t stack_size, bool run_in_scheduler) :
-		m_cb(cb), m_run_in_scheduler(run_in_scheduler)
+	Fiber::Fiber(Callback cb, size_t stack_size, bool run_in_scheduler) :
+		m_cb(std::move(cb)), m_run_in_scheduler(run_in_scheduler)
 	{
 		m_state= READY;
 
-		//分配协程栈空间
-		m_stacksize= stack_size ? stack_size : 128000;
-		m_stack= malloc(m_stacksize);
+		//从栈内存池分配协程栈空间，实际大小按尺寸级别向上取整
+		size_t request_size = stack_size ? stack_size : GetDefaultStackSize();
+		m_stacksize = StackPool::GetAllocSize(request_size);
+		m_guarded = StackPool::GetGuardedStacks();
+		if (m_guarded)
+		{
+			std::call_once(s_segv_once, &InstallOverflowHandler);
+		}
+		m_stack = StackPool::Alloc(m_stacksize, m_guarded);
+		if (!m_stack)
+		{
+			//带保护页的栈每个占两个内存映射区域，协程很多时可能超过vm.max_map_count
+			std::cerr << "Fiber(Callback cb, size_t stacksize, bool run_in_scheduler) alloc stack failed\n";
+			throw std::bad_alloc();
+		}
 
-		if (getcontext(&m_ctx))
+		//没有后继上下文，所以在运行完mainfunc后协程退出前，会调用一次yield返回主协程。
+		if (context_make(&m_ctx, m_stack, m_stacksize, &Fiber::MainFunc))
 		{
-			std::cerr << "Fiber(std::function<void()> cb, size_t stacksize, bool run_in_scheduler) failed\n";
+			std::cerr << "Fiber(Callback cb, size_t stacksize, bool run_in_scheduler) failed\n";
 			pthread_exit(NULL);
 		}
-
-		m_ctx.uc_link = nullptr;//这里因为没有设置了后继所以在运行完mainfunc后协程退出，会调用一次yield返回主协程。
-	    m_ctx.uc_stack.ss_sp = m_stack ;//设置栈顶
-		m_ctx.uc_stack.ss_size = m_stacksize;//设置栈大小
-		makecontext(&m_ctx, &Fiber::MainFunc, 0);
 		m_id = s_fiber_id++;
 		s_fiber_count++;
 		if (debug)std::cout << "Fiber():child id=" << m_id << std::endl;
@@ -102,27 +316,26 @@ namespace sylar {
 		s_fiber_count--;//活跃协程数量-1
 		if (m_stack)
 		{
-			free(m_stack);
+			StackPool::Dealloc(m_stack, m_stacksize, m_guarded);//归还栈内存池
 		}
 		if (debug)std::cout << "~Fiber(): id=" << m_id << std::endl;
 	}
 	//重置协程回调函数，设置上下文，使用与将协程从TERM状态重置为READY状态
-	void Fiber::reset(std::function<void()> cb)
+	void Fiber::reset(Callback cb)
 	{
 		assert(m_stack != nullptr && m_state == TERM);
 
 		m_state= READY;
-		m_cb = cb;
+		m_cb = std::move(cb);
+		//复用的协程执行的是一个新任务，换一个id，运行时间统计也从头开始
+		m_id = s_fiber_id++;
+		m_cpuTime = m_lastRunTime = m_maxRunTime = m_resumeCount = 0;
 
-		if (getcontext(&m_ctx))
+		if (context_make(&m_ctx, m_stack, m_stacksize, &Fiber::MainFunc))
 		{
-            std::cerr << "Fiber::reset(std::function<void()> cb) failed\n";
+            std::cerr << "Fiber::reset(Callback cb) failed\n";
             pthread_exit(NULL);
 		}
-		m_ctx.uc_link = nullptr;
-		m_ctx.uc_stack.ss_sp = m_stack;
-		m_ctx.uc_stack.ss_size = m_stacksize;
-		makecontext(&m_ctx, &Fiber::MainFunc, 0);
 	}
 	//将协程状态设置为running，恢复协程执行，
 	// m_runInScheduler 为 true，则将上下文切换到调度协程；
@@ -131,11 +344,16 @@ namespace sylar {
 	{
         assert(m_state == READY);
         m_state = RUNNING;
+		m_resumeTime = now_ns();
+		if (m_guarded && !t_alt_stack_checked)
+		{
+			EnsureAltStack();
+		}
 
 		if (m_run_in_scheduler)//类似于非对称协程函数协程切换
 		{
 			SetThis(this);//目前工作的协程
-			if (swapcontext(&(t_scheduler_fiber->m_ctx), &m_ctx))//切换到m_ctx上下文
+			if (context_swap(&t_scheduler_fiber->m_ctx, &m_ctx))//切换到m_ctx上下文
 			{
 				std::cerr<<"resume() to t_scheduler_fibler failed\n";
                 pthread_exit(NULL);
@@ -144,13 +362,21 @@ namespace sylar {
 		else
 		{
 			SetThis(this);
-			if (swapcontext(&(t_thread_fiber->m_ctx), &m_ctx))
+			if (context_swap(&t_thread_fiber->m_ctx, &m_ctx))
 			{
               std::cerr << "resume() to t_thread_fiber failed\n";
               pthread_exit(NULL);
 			}
 
 		}
+		//协程切出（yield或结束）后回到这里，统计这一次的运行时间
+		m_lastRunTime = now_ns() - m_resumeTime;
+		m_cpuTime += m_lastRunTime;
+		if (m_lastRunTime > m_maxRunTime)
+		{
+			m_maxRunTime = m_lastRunTime;
+		}
+		m_resumeCount++;
 	}
 
 	void Fiber::yield()
@@ -165,7 +391,7 @@ namespace sylar {
 		if (m_run_in_scheduler)
 		{
             SetThis(t_scheduler_fiber);
-			if (swapcontext(&m_ctx, &(t_scheduler_fiber->m_ctx)))
+			if (context_swap(&m_ctx, &t_scheduler_fiber->m_ctx))
 			{
                 std::cerr << "yield() to t_scheduler_fiber failed\n";
                 pthread_exit(NULL);
@@ -174,7 +400,7 @@ namespace sylar {
 		else
 		{
             SetThis(t_thread_fiber.get());
-			if (swapcontext(&m_ctx, &(t_thread_fiber->m_ctx)))
+			if (context_swap(&m_ctx, &t_thread_fiber->m_ctx))
 			{
               std::cerr << "yield() to t_thread_fiber failed\n";
               pthread_exit(NULL);
@@ -5,7 +5,8 @@
 #include <atomic>
 #include <functional>
 #include <cassert>
-#include <ucontext.h>
+#include "FiberContext.h"
+#include "InlineFunction.h"
 #include <unistd.h>
 #include <mutex>
 
@@ -23,30 +24,59 @@ namespace sylar {
 		Fiber();//私有函数，只能被GetThis调用，创建主协程
 	public:
 		//创建指定回调函数，栈大小和run_in_scheduler的本协程是否参与调度器调度
-		Fiber(std::function<void()> cb, size_t stacksize = 0, bool run_in_scheduler = true);
+		Fiber(Callback cb, size_t stacksize = 0, bool run_in_scheduler = true);
 		~Fiber();
 	public:
-		void reset(std::function<void()> cb);//重置协程状态和入口函数，复用栈控件==空间，不重新创建栈
+		void reset(Callback cb);//重置协程状态和入口函数，复用栈控件==空间，不重新创建栈
 		void resume();//恢复协程执行
 		void yield();//让出当前协程的执行权
 		uint64_t get_Id() const { return m_id; }//获取唯一标识
 		State get_state() const { return m_state; }//获取协程状态
+
+		//运行时间统计，在resume()前后计时，单位纳秒；reset()后清零
+		uint64_t getCpuTime() const { return m_cpuTime; }//累计运行时间
+		uint64_t getLastRunTime() const { return m_lastRunTime; }//最近一次从resume到切出的时间
+		uint64_t getMaxRunTime() const { return m_maxRunTime; }//单次连续运行的最长时间
+		uint64_t getResumeCount() const { return m_resumeCount; }
+		//最近一次被调度时的优先级（Scheduler::Priority），-1表示从未被调度器执行过
+		int getPriority() const { return m_priority; }
+		void setPriority(int priority) { m_priority = priority; }
+		//协程栈的范围[getStack(), getStack() + getStackSize())，主协程没有独立的栈
+		void* getStack() const { return m_stack; }
+		size_t getStackSize() const { return m_stacksize; }
+		//栈底是否有保护页，由创建时的StackPool::SetGuardedStacks决定
+		bool isStackGuarded() const { return m_guarded; }
 	public:
 
 		static void SetThis(Fiber* f);//设置当前协程
 		static std::shared_ptr<Fiber> GetThis();//获取当前协程的shared_ptr
 		static void SetSchedulerFiber(Fiber* f);//设置调度协程，默认为主
 		static uint64_t GetFiberId();//获取当前运行的协程id
+		//当前是否运行在参与调度的子协程中，是则可以yield回调度协程等待被重新调度
+		static bool IsInScheduler();
+		//检查点：当前协程本次连续运行超过所属调度器的时间片时，把自己放回调度队列并让出，返回是否让出过
+		//未超时只需读一次时钟，可以放在计算密集的循环里频繁调用
+		static bool maybeYield();
+		//未指定栈大小时使用的默认大小，默认128000字节；配合带保护页的栈可以设到1M，只有用到的页占用内存
+		static void SetDefaultStackSize(size_t size);
+		static size_t GetDefaultStackSize();
 		static void MainFunc();//协程主函数，入口点
 
 	private:
 		uint64_t m_id = 0;//唯一标识
 		uint32_t m_stacksize = 0;//栈大小
 		State m_state = READY;//协程状态
-		ucontext_t m_ctx;//协程上下文
+		FiberContext m_ctx;//协程上下文，具体后端见FiberContext.h
 		void* m_stack = nullptr;//协程栈指针
-		std::function<void()> m_cb;//协程入口函数
-		bool m_run_in_scheduler;//是否将执行器交给调度函数
+		bool m_guarded = false;//栈是否带保护页
+		Callback m_cb;//协程入口函数
+		bool m_run_in_scheduler = false;//是否将执行器交给调度函数
+		uint64_t m_resumeTime = 0;//本次恢复运行的时刻
+		uint64_t m_cpuTime = 0;
+		uint64_t m_lastRunTime = 0;
+		uint64_t m_maxRunTime = 0;
+		uint64_t m_resumeCount = 0;
+		int m_priority = -1;
 	public:
 		std::mutex m_mutex;
 	};
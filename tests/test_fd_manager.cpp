@@ -0,0 +1,116 @@
+#include "IOManager.h"
+#include "Hook.h"
+#include "Fd_manager.h"
+#include <iostream>
+#include <string>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+
+/*
+FdManager的测试
+FdCtx在表中原地复用：fd关闭后马上被重新打开（Linux总是分配最小的空闲fd），表项换代
+1. 表项重置后各字段回到新fd的状态，generation加一，旧的超时设置不会带到新fd上
+2. 协程阻塞在fd上时另一个协程关闭它并用同一个fd号打开新socket，阻塞的读必须返回EBADF，不能读到新socket的数据
+有不一致时返回1
+*/
+
+using namespace sylar;
+
+static int s_errors = 0;
+
+static void check(bool ok, const std::string& what)
+{
+	if (!ok)
+	{
+		s_errors++;
+		std::cout << "  FAILED: " << what << std::endl;
+	}
+}
+
+//创建一对socket并登记，登记后底层变成非阻塞，hook的读写才能挂起协程
+static void open_pair(int sv[2])
+{
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv))
+	{
+		std::cout << "socketpair failed" << std::endl;
+		exit(1);
+	}
+	FdMgr::GetInstance()->get(sv[0], true);
+	FdMgr::GetInstance()->get(sv[1], true);
+}
+
+static void test_reset()
+{
+	int sv[2];
+	open_pair(sv);
+	FdCtx* ctx = FdMgr::GetInstance()->get(sv[0]);
+	uint64_t generation = ctx->getGeneration();
+	ctx->setTimeout(SO_RCVTIMEO, 100);
+	ctx->setUderNonblock(true);
+
+	//没经过hook的close要自己注销
+	FdMgr::GetInstance()->del(sv[0]);
+	check(ctx->isClosed(), "closed entry reports isClosed()");
+	close(sv[0]);
+	int fds[2];
+	check(pipe(fds) == 0 && fds[0] == sv[0], "the fd number is reused");
+	FdCtx* reused = FdMgr::GetInstance()->get(fds[0], true);
+	check(reused == ctx, "the entry is reused in place");
+	check(ctx->getGeneration() == generation + 1, "reopening bumps the generation");
+	check(!ctx->isClosed() && !ctx->isSocket() && !ctx->getUserNonblock(), "flags belong to the new fd");
+	check(ctx->getTimeout(SO_RCVTIMEO) == (uint64_t)-1, "the old timeout is dropped");
+
+	FdMgr::GetInstance()->del(fds[0]);
+	close(fds[0]);
+	close(fds[1]);
+	FdMgr::GetInstance()->del(sv[1]);
+	close(sv[1]);
+	std::cout << "reset: " << (s_errors ? "FAILED" : "ok") << std::endl;
+}
+
+static void test_reuse_while_waiting()
+{
+	int sv[2];
+	open_pair(sv);
+	ssize_t n = 0;
+	int error = 0;
+	char c = 0;
+	int reused[2] = { -1, -1 };
+	{
+		IOManager iom(1, true, "test");
+		iom.ScheduleLock([&]()
+		{
+			set_hook_enable(true);
+			n = read(sv[0], &c, 1);
+			error = errno;
+		});
+		iom.ScheduleLock([&]()
+		{
+			//读者已经挂起；关闭会唤醒它，但它要等这个协程让出之后才恢复
+			set_hook_enable(true);
+			close(sv[0]);
+			open_pair(reused);
+			set_hook_enable(true);
+			write(reused[1], "x", 1);
+		});
+	}
+	set_hook_enable(false);
+	check(reused[0] == sv[0], "the fd number is reused");
+	check(n == -1 && error == EBADF, "read on a reused fd returned " + std::to_string(n) + " (" + std::string(1, c)
+		+ "), expected EBADF");
+	for (int fd : { sv[1], reused[0], reused[1] })
+	{
+		FdMgr::GetInstance()->del(fd);
+		close(fd);
+	}
+	std::cout << "reuse while waiting: " << (s_errors ? "FAILED" : "ok") << std::endl;
+}
+
+int main()
+{
+	test_reset();
+	test_reuse_while_waiting();
+	std::cout << (s_errors ? "FAILED" : "all ok") << std::endl;
+	return s_errors ? 1 : 0;
+}
@@ -0,0 +1,113 @@
+#include "IOManager.h"
+#include "Hook.h"
+#include "FileIoPool.h"
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <cstdlib>
+#include <unistd.h>
+
+/*
+FileIoPool的测试
+请求还在排队或执行时调整线程数：减到0、从4减到1，所有请求都要执行完，挂起的协程都要被唤醒，调度器能正常停止
+线程数为0时请求在调用线程上直接执行
+有不一致时返回1，调度器停不下来时看门狗超时退出
+*/
+
+using namespace sylar;
+using Clock = std::chrono::steady_clock;
+
+static int s_errors = 0;
+
+static void check(bool ok, const std::string& what)
+{
+	if (!ok)
+	{
+		s_errors++;
+		std::cout << "  FAILED: " << what << std::endl;
+	}
+}
+
+//等池线程退出，线程在唤醒最后一个请求之后才注销
+static size_t wait_threads(size_t expect)
+{
+	auto deadline = Clock::now() + std::chrono::seconds(2);
+	size_t threads = FileIoPool::GetInstance()->getStats().threads;
+	while (threads != expect && Clock::now() < deadline)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		threads = FileIoPool::GetInstance()->getStats().threads;
+	}
+	return threads;
+}
+
+//提交jobs个每个耗时20ms的请求，第一批开始执行后把线程数改成count
+static void shrink_in_flight(size_t from, size_t count, int jobs)
+{
+	FileIoPool* pool = FileIoPool::GetInstance();
+	pool->setThreadCount(from);
+	uint64_t completed = pool->getStats().completed;
+	std::atomic<int> done = { 0 };
+	{
+		IOManager iom(1, true, "test");
+		for (int i = 0; i < jobs; i++)
+		{
+			iom.ScheduleLock([&done]()
+			{
+				FileIoPool::GetInstance()->run([]() { usleep(20000); });
+				done++;
+			});
+		}
+		iom.ScheduleLock([count]()
+		{
+			set_hook_enable(true);
+			usleep(5000);
+			FileIoPool::GetInstance()->setThreadCount(count);
+		});
+	}
+	set_hook_enable(false);
+	std::string name = std::to_string(from) + " -> " + std::to_string(count);
+	check(done == jobs, name + ": " + std::to_string(done) + " of " + std::to_string(jobs) + " fibers resumed");
+	check(pool->getStats().completed - completed == (uint64_t)jobs, name + ": not every job ran in the pool");
+	check(wait_threads(count) == count, name + ": surplus threads did not exit");
+	std::cout << "shrink " << name << ": " << (s_errors ? "FAILED" : "ok") << std::endl;
+}
+
+//线程数为0时在调用线程上直接执行，不经过队列
+static void test_inline()
+{
+	FileIoPool* pool = FileIoPool::GetInstance();
+	pool->setThreadCount(0);
+	uint64_t submitted = pool->getStats().submitted;
+	bool same_thread = false;
+	{
+		IOManager iom(1, true, "test");
+		iom.ScheduleLock([&same_thread]()
+		{
+			std::thread::id caller = std::this_thread::get_id();
+			FileIoPool::GetInstance()->run([&]() { same_thread = std::this_thread::get_id() == caller; });
+		});
+	}
+	check(same_thread, "zero threads runs the job on the caller");
+	check(pool->getStats().submitted == submitted, "zero threads does not queue");
+	std::cout << "inline: " << (s_errors ? "FAILED" : "ok") << std::endl;
+}
+
+int main()
+{
+	std::thread([]()
+	{
+		std::this_thread::sleep_for(std::chrono::seconds(30));
+		std::cout << "timeout: a scheduler did not stop" << std::endl;
+		_exit(1);
+	}).detach();
+
+	shrink_in_flight(4, 0, 40);
+	shrink_in_flight(4, 1, 40);
+	shrink_in_flight(1, 0, 10);
+	test_inline();
+	std::cout << (s_errors ? "FAILED" : "all ok") << std::endl;
+	return s_errors ? 1 : 0;
+}
@@ -0,0 +1,495 @@
+#include "IOManager.h"
+#include "Hook.h"
+#include "Resolver.h"
+#include <iostream>
+#include <fstream>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <unistd.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+
+/*
+Resolver的测试
+回环上起一个桩DNS服务器，按查询的名字手工构造应答：A/AAAA、CNAME（带压缩指针）、NXDOMAIN+SOA、
+只有SOA的空应答、TC应答、不应答，以及在正确应答前先发一个id不对的报文和一个不完整的报文
+检查hosts文件、search/ndots、TTL过期、否定缓存、并发请求合并、超时和截断时交给原始getaddrinfo
+有不一致时返回1
+*/
+
+using namespace sylar;
+using Clock = std::chrono::steady_clock;
+
+static const char* HOSTS_FILE = "/tmp/test_resolver_hosts";
+static const char* CONFIG_FILE = "/tmp/test_resolver_resolv.conf";
+static const char* NDOTS_FILE = "/tmp/test_resolver_ndots.conf";
+
+static int s_errors = 0;
+
+static void check(bool ok, const std::string& what)
+{
+	if (!ok)
+	{
+		s_errors++;
+		std::cout << "  FAILED: " << what << std::endl;
+	}
+}
+
+//桩DNS服务器，运行在一个普通线程上，没有打开hook
+class StubServer
+{
+public:
+	StubServer()
+	{
+		m_fd = socket(AF_INET, SOCK_DGRAM, 0);
+		sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		socklen_t len = sizeof(addr);
+		bind(m_fd, (sockaddr*)&addr, sizeof(addr));
+		getsockname(m_fd, (sockaddr*)&addr, &len);
+		memset(&m_addr, 0, sizeof(m_addr));
+		memcpy(&m_addr, &addr, sizeof(addr));
+		timeval tv = { 0, 100000 };
+		setsockopt(m_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+		m_thread = std::thread([this]() { run(); });
+	}
+
+	~StubServer()
+	{
+		m_stop = true;
+		m_thread.join();
+		close(m_fd);
+	}
+
+	const sockaddr_storage& addr() const { return m_addr; }
+	int queries() const { return m_queries; }
+
+	//按收到的顺序记录查询的名字
+	std::vector<std::string> names()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_names;
+	}
+
+	void clearNames()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_names.clear();
+	}
+
+private:
+	static void put16(std::string& out, uint16_t v)
+	{
+		out.push_back((char)(v >> 8));
+		out.push_back((char)(v & 0xff));
+	}
+
+	static void put32(std::string& out, uint32_t v)
+	{
+		put16(out, v >> 16);
+		put16(out, v & 0xffff);
+	}
+
+	static std::string encode_name(const std::string& name)
+	{
+		std::string out;
+		size_t begin = 0;
+		while (begin < name.size())
+		{
+			size_t end = name.find('.', begin);
+			end = end == std::string::npos ? name.size() : end;
+			out.push_back((char)(end - begin));
+			out.append(name, begin, end - begin);
+			begin = end + 1;
+		}
+		out.push_back('\0');
+		return out;
+	}
+
+	//一条资源记录，名字是指向offset的压缩指针
+	static void put_record(std::string& out, uint16_t offset, uint16_t type, uint32_t ttl, const std::string& rdata)
+	{
+		put16(out, 0xc000 | offset);
+		put16(out, type);
+		put16(out, 1);
+		put32(out, ttl);
+		put16(out, (uint16_t)rdata.size());
+		out += rdata;
+	}
+
+	static std::string addr_rdata(uint16_t qtype, const char* ip)
+	{
+		char buf[16];
+		inet_pton(qtype == 1 ? AF_INET : AF_INET6, ip, buf);
+		return std::string(buf, qtype == 1 ? 4 : 16);
+	}
+
+	//SOA的TTL为60，MINIMUM为5，否定缓存取5秒
+	static std::string soa_rdata()
+	{
+		std::string rdata = encode_name("ns.test") + encode_name("admin.test");
+		for (uint32_t v : { 1, 7200, 900, 86400, 5 })
+		{
+			put32(rdata, v);
+		}
+		return rdata;
+	}
+
+	void run()
+	{
+		uint8_t buf[512];
+		while (!m_stop)
+		{
+			sockaddr_storage from;
+			socklen_t fromlen = sizeof(from);
+			ssize_t n = recvfrom(m_fd, buf, sizeof(buf), 0, (sockaddr*)&from, &fromlen);
+			if (n < 12)
+			{
+				continue;
+			}
+			m_queries++;
+			std::string name;
+			size_t off = 12;
+			while (off < (size_t)n && buf[off])
+			{
+				if (!name.empty())
+				{
+					name += '.';
+				}
+				name.append((const char*)buf + off + 1, buf[off]);
+				off += buf[off] + 1;
+			}
+			uint16_t qtype = buf[off + 1] << 8 | buf[off + 2];
+			size_t qend = off + 5;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_names.push_back(name);
+			}
+
+			//头部和问题部分照抄，QR=1 RD=1 RA=1
+			std::string reply((const char*)buf, qend);
+			reply[2] = (char)0x81;
+			reply[3] = (char)0x80;
+			for (int i = 6; i < 12; i++)
+			{
+				reply[i] = 0;
+			}
+			std::string body;
+			int an = 0;
+			int ns = 0;
+			if (name == "silent.test")
+			{
+				continue;
+			}
+			else if (name == "slow.test" || name == "ttl.test")
+			{
+				//slow.test的A应答晚一点发，让并发请求有时间合并
+				if (name == "slow.test" && qtype == 1)
+				{
+					std::this_thread::sleep_for(std::chrono::milliseconds(50));
+				}
+				uint32_t ttl = name == "ttl.test" ? 1 : 300;
+				if (qtype == 1)
+				{
+					put_record(body, 12, 1, ttl, addr_rdata(1, "10.0.0.1"));
+					put_record(body, 12, 1, ttl, addr_rdata(1, "10.0.0.2"));
+					an = 2;
+				}
+				else
+				{
+					put_record(body, 12, 28, ttl, addr_rdata(28, "fd00::1"));
+					an = 1;
+				}
+			}
+			else if (name == "alias.test")
+			{
+				//CNAME指向target.test，A记录的名字是指向CNAME目标的压缩指针
+				std::string target = encode_name("target.test");
+				put_record(body, 12, 5, 300, target);
+				uint16_t target_off = (uint16_t)(qend + body.size() - target.size());
+				an = 1;
+				if (qtype == 1)
+				{
+					put_record(body, target_off, 1, 300, addr_rdata(1, "10.0.0.3"));
+					an = 2;
+				}
+			}
+			else if (name == "v4only.test")
+			{
+				if (qtype == 1)
+				{
+					put_record(body, 12, 1, 300, addr_rdata(1, "10.0.0.4"));
+					an = 1;
+				}
+				else
+				{
+					put_record(body, 12, 6, 60, soa_rdata());
+					ns = 1;
+				}
+			}
+			else if (name == "big.test")
+			{
+				reply[2] |= 0x02;
+			}
+			else if (name == "host.corp.test" || name == "x.y.z" || name == "a.b")
+			{
+				const char* ip = name == "host.corp.test" ? "10.0.1.1" : name == "x.y.z" ? "10.0.2.1" : "10.0.3.1";
+				if (qtype == 1)
+				{
+					put_record(body, 12, 1, 300, addr_rdata(1, ip));
+					an = 1;
+				}
+				else
+				{
+					put_record(body, 12, 6, 60, soa_rdata());
+					ns = 1;
+				}
+			}
+			else if (name == "noisy.test")
+			{
+				//先发一个id不对的应答和一个只有半个头部的报文，解析时都要丢弃
+				std::string wrong = reply;
+				wrong[0] ^= 0x5a;
+				put_record(wrong, 12, qtype, 300, addr_rdata(qtype, qtype == 1 ? "10.9.9.9" : "fd00::9"));
+				wrong[7] = 1;
+				sendto(m_fd, wrong.data(), wrong.size(), 0, (sockaddr*)&from, fromlen);
+				sendto(m_fd, reply.data(), 6, 0, (sockaddr*)&from, fromlen);
+				put_record(body, 12, qtype, 300, addr_rdata(qtype, qtype == 1 ? "10.0.0.5" : "fd00::5"));
+				an = 1;
+			}
+			else
+			{
+				reply[3] = (char)0x83;
+				put_record(body, 12, 6, 60, soa_rdata());
+				ns = 1;
+			}
+			reply[7] = (char)an;
+			reply[9] = (char)ns;
+			reply += body;
+			sendto(m_fd, reply.data(), reply.size(), 0, (sockaddr*)&from, fromlen);
+		}
+	}
+
+private:
+	int m_fd = -1;
+	sockaddr_storage m_addr;
+	std::thread m_thread;
+	std::atomic<bool> m_stop = { false };
+	std::atomic<int> m_queries = { 0 };
+	std::mutex m_mutex;
+	std::vector<std::string> m_names;
+};
+
+static std::string to_string(const std::vector<sockaddr_storage>& addrs)
+{
+	std::string out;
+	for (auto& addr : addrs)
+	{
+		char buf[INET6_ADDRSTRLEN];
+		if (addr.ss_family == AF_INET)
+		{
+			inet_ntop(AF_INET, &((const sockaddr_in*)&addr)->sin_addr, buf, sizeof(buf));
+		}
+		else
+		{
+			inet_ntop(AF_INET6, &((const sockaddr_in6*)&addr)->sin6_addr, buf, sizeof(buf));
+		}
+		out += out.empty() ? "" : " ";
+		out += buf;
+	}
+	return out;
+}
+
+//hook开关是线程局部的，调度器不会替协程打开
+static int lookup(const std::string& name, int family, std::string& result)
+{
+	set_hook_enable(true);
+	std::vector<sockaddr_storage> addrs;
+	int rt = Resolver::GetInstance()->resolve(name, family, addrs);
+	result = to_string(addrs);
+	return rt;
+}
+
+static void expect(const std::string& name, int family, int error, const std::string& addrs)
+{
+	std::string result;
+	int rt = lookup(name, family, result);
+	check(rt == error && result == addrs, name + ": got " + std::to_string(rt) + " [" + result + "], expected "
+		+ std::to_string(error) + " [" + addrs + "]");
+}
+
+static void sleep_ms(int ms)
+{
+	set_hook_enable(true);
+	usleep(ms * 1000);
+}
+
+static void test_hosts(StubServer& server)
+{
+	int queries = server.queries();
+	Resolver::Stats before = Resolver::GetInstance()->getStats();
+	expect("myhost", AF_UNSPEC, 0, "10.1.2.3 ::5");
+	expect("MyHost.", AF_INET6, 0, "::5");
+	expect("ALIAS", AF_INET, 0, "10.1.2.3");
+	Resolver::Stats after = Resolver::GetInstance()->getStats();
+	check(after.hostsHits - before.hostsHits == 3, "hosts hits");
+	check(server.queries() == queries, "hosts names must not reach the server");
+	std::cout << "hosts: " << (s_errors ? "FAILED" : "ok") << std::endl;
+}
+
+static void test_answers(StubServer& server)
+{
+	expect("slow.test", AF_UNSPEC, 0, "10.0.0.1 10.0.0.2 fd00::1");
+	expect("slow.test", AF_INET6, 0, "fd00::1");
+	expect("alias.test", AF_INET, 0, "10.0.0.3");
+	expect("noisy.test", AF_UNSPEC, 0, "10.0.0.5 fd00::5");
+	expect("v4only.test", AF_INET6, EAI_NODATA, "");
+	expect("v4only.test", AF_UNSPEC, 0, "10.0.0.4");
+
+	//NXDOMAIN按SOA的MINIMUM缓存，第二次不发查询
+	int queries = server.queries();
+	expect("nx.test.", AF_INET, EAI_NONAME, "");
+	check(server.queries() == queries + 1, "NXDOMAIN sends one query");
+	expect("nx.test.", AF_INET, EAI_NONAME, "");
+	check(server.queries() == queries + 1, "NXDOMAIN is cached");
+	std::cout << "answers: " << (s_errors ? "FAILED" : "ok") << std::endl;
+}
+
+static void test_search(StubServer& server)
+{
+	Resolver::GetInstance()->setConfigFile(NDOTS_FILE);
+	//没有点：先加后缀
+	server.clearNames();
+	expect("host", AF_INET, 0, "10.0.1.1");
+	check(server.names() == std::vector<std::string>{ "host.corp.test" }, "search suffix for a single label");
+
+	//点数不少于ndots：先试原名字
+	server.clearNames();
+	expect("x.y.z", AF_INET, 0, "10.0.2.1");
+	check(server.names() == std::vector<std::string>{ "x.y.z" }, "name with ndots dots goes first");
+
+	//点数少于ndots：后缀的名字NXDOMAIN之后再试原名字
+	server.clearNames();
+	expect("a.b", AF_INET, 0, "10.0.3.1");
+	check(server.names() == std::vector<std::string>{ "a.b.corp.test", "a.b" }, "search suffix before the name");
+
+	//以点结尾的名字不加后缀
+	server.clearNames();
+	expect("host.", AF_INET, EAI_NONAME, "");
+	check(server.names() == std::vector<std::string>{ "host" }, "absolute name skips search");
+	Resolver::GetInstance()->setConfigFile(CONFIG_FILE);
+	std::cout << "search/ndots: " << (s_errors ? "FAILED" : "ok") << std::endl;
+}
+
+static void test_ttl(StubServer& server)
+{
+	int queries = server.queries();
+	expect("ttl.test", AF_INET, 0, "10.0.0.1 10.0.0.2");
+	expect("ttl.test", AF_INET, 0, "10.0.0.1 10.0.0.2");
+	check(server.queries() == queries + 1, "answer is cached until the TTL");
+	sleep_ms(1100);
+	expect("ttl.test", AF_INET, 0, "10.0.0.1 10.0.0.2");
+	check(server.queries() == queries + 2, "answer expires after the TTL");
+	std::cout << "ttl: " << (s_errors ? "FAILED" : "ok") << std::endl;
+}
+
+//同一个名字的并发请求只发一次查询
+static void test_coalesce(StubServer& server)
+{
+	const int N = 20;
+	Resolver::GetInstance()->clearCache();
+	int queries = server.queries();
+	Resolver::Stats before = Resolver::GetInstance()->getStats();
+	std::atomic<int> done = { 0 };
+	std::atomic<int> ok = { 0 };
+	for (int i = 0; i < N; i++)
+	{
+		IOManager::GetThis()->ScheduleLock([&]()
+		{
+			std::string result;
+			if (lookup("slow.test", AF_UNSPEC, result) == 0 && result == "10.0.0.1 10.0.0.2 fd00::1")
+			{
+				ok++;
+			}
+			done++;
+		});
+	}
+	while (done < N)
+	{
+		sleep_ms(10);
+	}
+	Resolver::Stats after = Resolver::GetInstance()->getStats();
+	check(ok == N, "coalesced requests get the answer");
+	check(after.coalesced - before.coalesced == N - 1, "coalesced " + std::to_string(after.coalesced - before.coalesced)
+		+ " requests, expected " + std::to_string(N - 1));
+	check(server.queries() == queries + 2, "one A and one AAAA query for all requests");
+	std::cout << "coalesce: " << (s_errors ? "FAILED" : "ok") << std::endl;
+}
+
+static void test_failures(StubServer& server)
+{
+	//不应答：超时返回EAI_AGAIN，不缓存
+	Resolver::Stats before = Resolver::GetInstance()->getStats();
+	auto start = Clock::now();
+	expect("silent.test", AF_INET, EAI_AGAIN, "");
+	long ms = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count();
+	check(ms >= 250 && ms < 1000, "timeout took " + std::to_string(ms) + "ms");
+	int queries = server.queries();
+	expect("silent.test", AF_INET, EAI_AGAIN, "");
+	check(server.queries() == queries + 1, "EAI_AGAIN is not cached");
+
+	//TC应答交给原始的getaddrinfo，结果取决于本机配置，只检查走了这条路
+	std::string result;
+	lookup("big.test", AF_INET, result);
+	Resolver::Stats after = Resolver::GetInstance()->getStats();
+	check(after.timeouts - before.timeouts == 2, "timeouts counted");
+	check(after.fallbacks - before.fallbacks == 1, "truncated answer falls back to getaddrinfo");
+	std::cout << "failures: " << (s_errors ? "FAILED" : "ok") << std::endl;
+}
+
+int main()
+{
+	std::ofstream(HOSTS_FILE) << "10.1.2.3 MyHost alias\n::5 myhost\n";
+	std::ofstream(CONFIG_FILE) << "search corp.test\n";
+	std::ofstream(NDOTS_FILE) << "search corp.test\noptions ndots:2\n";
+	{
+		StubServer server;
+		Resolver* resolver = Resolver::GetInstance();
+		resolver->setHostsFile(HOSTS_FILE);
+		resolver->setConfigFile(CONFIG_FILE);
+		resolver->setNameservers({ server.addr() });
+		resolver->setTimeout(300);
+		resolver->setAttempts(1);
+		{
+			//调度器不会在工作线程上打开hook，Resolver内部的收发可能在另一个线程上恢复，单线程保证结果确定
+			IOManager iom(1, true, "test");
+			iom.ScheduleLock([&]()
+			{
+				test_hosts(server);
+				test_answers(server);
+				test_search(server);
+				test_ttl(server);
+				test_coalesce(server);
+				test_failures(server);
+			});
+		}
+		set_hook_enable(false);
+		Resolver::Stats stats = resolver->getStats();
+		std::cout << "stats: lookups=" << stats.lookups << " hosts=" << stats.hostsHits << " cache=" << stats.cacheHits
+			<< " coalesced=" << stats.coalesced << " queries=" << stats.queries << " timeouts=" << stats.timeouts
+			<< " fallbacks=" << stats.fallbacks << std::endl;
+	}
+	unlink(HOSTS_FILE);
+	unlink(CONFIG_FILE);
+	unlink(NDOTS_FILE);
+	std::cout << (s_errors ? "FAILED" : "all ok") << std::endl;
+	return s_errors ? 1 : 0;
+}